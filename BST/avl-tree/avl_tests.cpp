@@ -2,7 +2,11 @@
 
 #include <limits>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <set>
+#include <vector>
 
 using namespace std;
 
@@ -18,7 +22,8 @@ const int EveryDeletedImmediately = 5;
 const int EveryDeletedAfter = 3;
 
 
-class avl_test_tree : public avl_tree<int> {
+// Uses avl_node_pool, since some tests check where the nodes are placed.
+class avl_test_tree : public avl_tree<int, avl_node_pool> {
 public:
     int root_val() const {
         return root->value;
@@ -65,6 +70,12 @@ public:
                 " has a large gap in number of nodes on either side (" +
                 to_string(num_on_left) + " vs " + to_string(num_on_right) + ".";
 
+        int expected_subtree_size = 1 + count_size(node->lhs) + count_size(node->rhs);
+        if (expected_subtree_size != node->subtree_size)
+            throw "The node " + to_string(node->value) + " has subtree size " +
+                to_string(node->subtree_size) + " while should have " +
+                to_string(expected_subtree_size) + ".";
+
         int expected_height = 1 + max(num_on_left, num_on_right);
         if (expected_height != node->height)
             throw "The node " + to_string(node->value) + " has height " +
@@ -81,8 +92,46 @@ public:
 
         return 1 + count_size(node->lhs) + count_size(node->rhs);
     }
+
+    int root_height() const {
+        return root == nullptr ? -1 : root->height;
+    }
+
+    size_t node_size() const {
+        return sizeof(Node);
+    }
+
+    // Returns the node storing value, or nullptr if there isn't one.
+    const Node* find_node(int value) const {
+        Node* current = root;
+        while (current != nullptr && current->value != value)
+            current = value < current->value ? current->lhs : current->rhs;
+        return current;
+    }
+};
+
+// Counts how many are alive, to check that the tree destroys every item.
+class counted_item {
+public:
+    counted_item(int value) : value(value) { ++num_alive; }
+    counted_item(const counted_item& other) : value(other.value) { ++num_alive; }
+    ~counted_item() { --num_alive; }
+
+    counted_item& operator=(const counted_item& other) = default;
+
+    bool operator<(const counted_item& other) const { return value < other.value; }
+    bool operator>(const counted_item& other) const { return value > other.value; }
+    bool operator==(const counted_item& other) const { return value == other.value; }
+    bool operator!=(const counted_item& other) const { return value != other.value; }
+
+    static int num_alive;
+
+private:
+    int value;
 };
 
+int counted_item::num_alive = 0;
+
 bool CheckRoot(const avl_test_tree& tree, int expected, const std::string& test_id) {
     if (tree.root_val() != expected) {
         std::cout << "ERROR in " << test_id << ": Root is " << tree.root_val()
@@ -244,6 +293,281 @@ bool Contains(const std::set<int>& s, int num) {
     return s.find(num) != s.end();
 }
 
+// A removed node's slot is the next one to be used.
+bool PoolReusesNodes() {
+    avl_test_tree tree;
+
+    tree.insert(1);
+    tree.insert(2);
+    tree.insert(3);
+
+    // 3 is a leaf, so its own node is removed.
+    const void* removed_node = tree.find_node(3);
+    tree.remove(3);
+    tree.insert(4);
+
+    bool valid = CheckIsValid(tree, "PoolReusesNodes");
+    if (tree.find_node(4) != removed_node) {
+        std::cout << "ERROR in PoolReusesNodes: The new node didn't reuse the removed node\n";
+        valid = false;
+    }
+    return valid;
+}
+
+// Every item is destroyed, whether it was removed, or still in the tree when
+// the tree was destroyed.
+template <template <class> class NodeAllocator>
+bool DestroysEveryItem(const std::string& test_id) {
+    {
+        avl_tree<counted_item, NodeAllocator> tree;
+        for (int i = 0; i < 1000; ++i)
+            tree.insert(i);
+        for (int i = 0; i < 1000; i += 2)
+            tree.remove(i);
+    }
+
+    if (counted_item::num_alive != 0) {
+        std::cout << "ERROR in " << test_id << ": " << counted_item::num_alive <<
+            " items weren't destroyed\n";
+        return false;
+    }
+    return true;
+}
+
+// Compares rank, select and count_range against a sorted std::set, after
+// random inserts and removes.
+bool RankSelectAndCountRange() {
+    avl_test_tree tree;
+    std::set<int> s;
+
+    srand(0);
+    for (int i = 0; i < 5000; ++i) {
+        int num = rand() % 1000;
+        if (rand() % 3 == 0) {
+            tree.remove(num);
+            s.erase(num);
+        } else {
+            tree.insert(num);
+            s.insert(num);
+        }
+    }
+
+    bool valid = CheckIsValid(tree, "RankSelectAndCountRange");
+
+    std::vector<int> sorted(s.begin(), s.end());
+    for (int k = 0; k < static_cast<int>(sorted.size()); ++k) {
+        if (tree.select(k) != sorted[k]) {
+            std::cout << "ERROR in RankSelectAndCountRange: select(" << k << ") is " <<
+                tree.select(k) << " expected " << sorted[k] << '\n';
+            valid = false;
+        }
+    }
+
+    for (int i = -1; i <= 1000; ++i) {
+        int expected_rank = std::lower_bound(sorted.begin(), sorted.end(), i) - sorted.begin();
+        if (tree.rank(i) != expected_rank) {
+            std::cout << "ERROR in RankSelectAndCountRange: rank(" << i << ") is " <<
+                tree.rank(i) << " expected " << expected_rank << '\n';
+            valid = false;
+        }
+    }
+
+    for (int lo = -10; lo <= 1010; lo += 17) {
+        for (int hi = lo - 20; hi <= 1010; hi += 23) {
+            int expected_count = 0;
+            for (int item : sorted)
+                expected_count += lo <= item && item <= hi;
+            if (tree.count_range(lo, hi) != expected_count) {
+                std::cout << "ERROR in RankSelectAndCountRange: count_range(" << lo << ", " <<
+                    hi << ") is " << tree.count_range(lo, hi) << " expected " <<
+                    expected_count << '\n';
+                valid = false;
+            }
+        }
+    }
+    return valid;
+}
+
+// Compares iterating in both directions, lower_bound, upper_bound and range
+// against a std::set, after random inserts and removes.
+bool IteratorsAndRanges() {
+    avl_test_tree tree;
+    std::set<int> s;
+
+    if (tree.begin() != tree.end()) {
+        std::cout << "ERROR in IteratorsAndRanges: An empty tree has items\n";
+        return false;
+    }
+
+    srand(1);
+    for (int i = 0; i < 5000; ++i) {
+        int num = rand() % 1000;
+        if (rand() % 3 == 0) {
+            tree.remove(num);
+            s.erase(num);
+        } else {
+            tree.insert(num);
+            s.insert(num);
+        }
+    }
+
+    bool valid = CheckIsValid(tree, "IteratorsAndRanges");
+
+    std::vector<int> sorted(s.begin(), s.end());
+    std::vector<int> forwards(tree.begin(), tree.end());
+    if (forwards != sorted) {
+        std::cout << "ERROR in IteratorsAndRanges: Iterating forwards gave " <<
+            forwards.size() << " items, not the " << sorted.size() << " sorted items\n";
+        valid = false;
+    }
+
+    std::vector<int> backwards;
+    for (avl_test_tree::const_iterator it = tree.end(); it != tree.begin();)
+        backwards.push_back(*--it);
+    if (!std::equal(backwards.begin(), backwards.end(), sorted.rbegin()) ||
+            backwards.size() != sorted.size()) {
+        std::cout << "ERROR in IteratorsAndRanges: Iterating backwards gave " <<
+            backwards.size() << " items, not the " << sorted.size() << " sorted items\n";
+        valid = false;
+    }
+
+    for (int i = -1; i <= 1000; ++i) {
+        auto lower = tree.lower_bound(i);
+        auto expected_lower = s.lower_bound(i);
+        if ((lower == tree.end()) != (expected_lower == s.end()) ||
+                (lower != tree.end() && *lower != *expected_lower)) {
+            std::cout << "ERROR in IteratorsAndRanges: lower_bound(" << i << ") is wrong\n";
+            valid = false;
+        }
+
+        auto upper = tree.upper_bound(i);
+        auto expected_upper = s.upper_bound(i);
+        if ((upper == tree.end()) != (expected_upper == s.end()) ||
+                (upper != tree.end() && *upper != *expected_upper)) {
+            std::cout << "ERROR in IteratorsAndRanges: upper_bound(" << i << ") is wrong\n";
+            valid = false;
+        }
+    }
+
+    for (int lo = -10; lo <= 1010; lo += 17) {
+        for (int hi = lo - 20; hi <= 1010; hi += 23) {
+            std::vector<int> items;
+            tree.range(lo, hi, [&items](int item) { items.push_back(item); });
+
+            std::vector<int> expected_items;
+            for (int item : sorted)
+                if (lo <= item && item <= hi)
+                    expected_items.push_back(item);
+
+            if (items != expected_items) {
+                std::cout << "ERROR in IteratorsAndRanges: range(" << lo << ", " << hi <<
+                    ") gave " << items.size() << " items, expected " <<
+                    expected_items.size() << '\n';
+                valid = false;
+            }
+        }
+    }
+    return valid;
+}
+
+// Building from every size of input gives a valid tree of the smallest height,
+// with the items in order.
+bool BuildFromSorted() {
+    bool valid = true;
+    for (int n = 0; n <= 300; ++n) {
+        std::vector<int> items;
+        for (int i = 0; i < n; ++i)
+            items.push_back(3 * i);
+
+        avl_test_tree tree;
+        tree.build_from_sorted(items.begin(), items.end());
+
+        std::string test_id = "BuildFromSorted with " + to_string(n) + " items";
+        valid &= CheckIsValid(tree, test_id);
+
+        int expected_height = n == 0 ? -1 : static_cast<int>(std::log2(n));
+        if (tree.root_height() != expected_height) {
+            std::cout << "ERROR in " << test_id << ": Height is " << tree.root_height() <<
+                " expected " << expected_height << '\n';
+            valid = false;
+        }
+
+        if (std::vector<int>(tree.begin(), tree.end()) != items) {
+            std::cout << "ERROR in " << test_id << ": Doesn't have the same items\n";
+            valid = false;
+        }
+    }
+    return valid;
+}
+
+// Replaces the items already in the tree, skips duplicates, and leaves a tree
+// that can still be changed.
+bool BuildFromSortedReplacesItems() {
+    avl_test_tree tree;
+    for (int i = 0; i < 100; ++i)
+        tree.insert(-i);
+
+    std::vector<int> items{1, 1, 2, 3, 3, 3, 5, 8, 8};
+    tree.build_from_sorted(items.begin(), items.end());
+
+    bool valid = CheckIsValid(tree, "BuildFromSortedReplacesItems");
+    if (std::vector<int>(tree.begin(), tree.end()) != std::vector<int>{1, 2, 3, 5, 8}) {
+        std::cout << "ERROR in BuildFromSortedReplacesItems: Has " << tree.size() <<
+            " items, expected 1, 2, 3, 5 and 8\n";
+        valid = false;
+    }
+
+    for (int i = 0; i < 20; ++i)
+        tree.insert(i);
+    tree.remove(5);
+    tree.remove(1);
+    valid &= CheckIsValid(tree, "BuildFromSortedReplacesItems");
+    if (tree.size() != 18 || tree.find(5) || !tree.find(19)) {
+        std::cout << "ERROR in BuildFromSortedReplacesItems: Wrong items after inserting "
+            "and removing\n";
+        valid = false;
+    }
+    return valid;
+}
+
+// Into an empty pool, all of the nodes come from one slab, in order.
+bool BuildFromSortedIsContiguous() {
+    avl_test_tree tree;
+    std::vector<int> items;
+    for (int i = 0; i < 100000; ++i)
+        items.push_back(i);
+    tree.build_from_sorted(items.begin(), items.end());
+
+    const char* first_node = reinterpret_cast<const char*>(tree.find_node(0));
+    for (int i = 0; i < 100000; ++i) {
+        const char* node = reinterpret_cast<const char*>(tree.find_node(i));
+        if (node != first_node + i * tree.node_size()) {
+            std::cout << "ERROR in BuildFromSortedIsContiguous: Node of " << i <<
+                " isn't next to the previous node\n";
+            return false;
+        }
+    }
+    return CheckIsValid(tree, "BuildFromSortedIsContiguous");
+}
+
+bool NewDeleteAllocator() {
+    // Is the default allocator.
+    avl_tree<int> tree;
+    for (int i = 0; i < 1000; ++i)
+        tree.insert(i);
+    for (int i = 0; i < 1000; i += 3)
+        tree.remove(i);
+
+    bool valid = true;
+    for (int i = 0; i < 1000; ++i) {
+        if (tree.find(i) != (i % 3 != 0)) {
+            std::cout << "ERROR in NewDeleteAllocator: find(" << i << ") is wrong\n";
+            valid = false;
+        }
+    }
+    return valid;
+}
+
 void LargeRandomInsertTest() {
     std::cout << "Starting large random insert. "
         << "If this takes longer than ~20 seconds, there is a balancing issue\n";
@@ -358,6 +682,29 @@ void RunLargeDeleteTest() {
 }
 
 
+// Inserts MostInserted increasing keys (removing every EveryDeletedImmediately
+// one right away), removes all of them, then inserts NumRandomInserted random
+// keys. Includes destroying the tree. Returns the time taken, in ms.
+template <template <class> class NodeAllocator>
+long long RunAllocatorBenchmark() {
+    srand(0);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        avl_tree<int, NodeAllocator> tree;
+        for (int i = 0; i < MostInserted; ++i) {
+            tree.insert(i);
+            if (i % EveryDeletedImmediately == 0)
+                tree.remove(i);
+        }
+        for (int i = 0; i < MostInserted; ++i)
+            tree.remove(i);
+        for (int i = 0; i < NumRandomInserted; ++i)
+            tree.insert(rand() % LargestRandomNum);
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
 int main() {
     bool insert_fine = InsertRightRotate();
     insert_fine &= InsertLeftRightRotate();
@@ -369,14 +716,32 @@ int main() {
     delete_fine &= DeleteLeftRotate();
     delete_fine &= DeleteRightLeftRotate();
 
+    bool allocator_fine = PoolReusesNodes();
+    allocator_fine &= DestroysEveryItem<avl_node_pool>("DestroysEveryItem<avl_node_pool>");
+    allocator_fine &= DestroysEveryItem<avl_new_delete_allocator>(
+        "DestroysEveryItem<avl_new_delete_allocator>");
+    allocator_fine &= NewDeleteAllocator();
+
+    bool ordered_queries_fine = RankSelectAndCountRange();
+    ordered_queries_fine &= IteratorsAndRanges();
+
+    bool build_fine = BuildFromSorted();
+    build_fine &= BuildFromSortedReplacesItems();
+    build_fine &= BuildFromSortedIsContiguous();
+
     std::cout << "Completed small tests\n\n";
-    if (insert_fine) {
+    if (insert_fine && allocator_fine && ordered_queries_fine && build_fine) {
         LargeInsertTest();
         LargeRandomInsertTest();
     }
 
-    if (insert_fine && delete_fine) {
+    if (insert_fine && delete_fine && allocator_fine && ordered_queries_fine && build_fine) {
         RunLargeCompleteDeleteTest();
         RunLargeDeleteTest();
     }
+
+    long long pool_time = RunAllocatorBenchmark<avl_node_pool>();
+    long long new_delete_time = RunAllocatorBenchmark<avl_new_delete_allocator>();
+    std::cout << "\nAllocator benchmark: avl_node_pool " << pool_time <<
+        " ms, avl_new_delete_allocator " << new_delete_time << " ms\n";
 }
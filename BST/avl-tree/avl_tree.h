@@ -1,11 +1,123 @@
 #ifndef BST_AVL_TREE
 #define BST_AVL_TREE
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Node allocators for avl_tree, which creates every node with
+// create(args...), and gives it back with destroy(node). reserve(n) is called
+// before creating n nodes at once.
+// If owns_nodes is true, the allocator frees the memory of every node when it is
+// destroyed, so the tree only needs to visit the nodes to run their destructors.
+
+// Allocates every node separately.
+template <class Node>
+class avl_new_delete_allocator {
+public:
+    static const bool owns_nodes = false;
+
+    template <class... Args>
+    Node* create(Args&&... args) {
+        return new Node(std::forward<Args>(args)...);
+    }
+
+    void destroy(Node* node) {
+        delete node;
+    }
+
+    void reserve(size_t num_nodes) {}
+};
+
+// Allocates the nodes from slabs of contiguous slots, which double in size up to
+// max_slab_size slots. Destroyed nodes are kept in a free list, and reused
+// before taking a new slot from the current slab. The slabs are only freed
+// when the pool is destroyed, so its memory never shrinks after removes.
+// reserve(n) adds a slab large enough for all n nodes, if they don't already fit.
+template <class Node>
+class avl_node_pool {
+public:
+    static const bool owns_nodes = true;
+
+    avl_node_pool()
+        : free_list(nullptr),
+        num_free(0),
+        num_used_in_slab(0),
+        slab_size(0) {
+    }
+
+    avl_node_pool(const avl_node_pool&) = delete;
+    avl_node_pool& operator=(const avl_node_pool&) = delete;
+
+    template <class... Args>
+    Node* create(Args&&... args) {
+        slot* free_slot = free_list;
+        if (free_slot != nullptr) {
+            free_list = free_slot->next;
+            --num_free;
+        } else {
+            if (num_used_in_slab == slab_size)
+                add_slab(next_slab_size());
+            free_slot = &slabs.back()[num_used_in_slab++];
+        }
+
+        return new (&free_slot->storage) Node(std::forward<Args>(args)...);
+    }
+
+    void destroy(Node* node) {
+        node->~Node();
+
+        slot* freed = reinterpret_cast<slot*>(node);
+        freed->next = free_list;
+        free_list = freed;
+        ++num_free;
+    }
 
-template <class T>
+    void reserve(size_t num_nodes) {
+        if (num_free + slab_size - num_used_in_slab < num_nodes)
+            add_slab(std::max(num_nodes, next_slab_size()));
+    }
+
+private:
+    static const size_t first_slab_size = 64;
+    static const size_t max_slab_size = 1 << 16;
+
+    // Holds a node, or the next free slot once the node was destroyed.
+    union slot {
+        slot* next;
+        typename std::aligned_storage<sizeof(Node), alignof(Node)>::type storage;
+    };
+
+    size_t next_slab_size() const {
+        if (slab_size == 0)
+            return first_slab_size;
+        return slab_size < max_slab_size ? 2 * slab_size : max_slab_size;
+    }
+
+    // Any slots left in the current slab aren't used.
+    void add_slab(size_t new_slab_size) {
+        slab_size = new_slab_size;
+        slabs.emplace_back(new slot[slab_size]);
+        num_used_in_slab = 0;
+    }
+
+    std::vector<std::unique_ptr<slot[]>> slabs;
+    slot* free_list;
+    size_t num_free;
+    // Slots of slabs.back() that were ever used.
+    size_t num_used_in_slab;
+    size_t slab_size;
+};
+
+// NodeAllocator is avl_new_delete_allocator or avl_node_pool.
+template <class T, template <class> class NodeAllocator = avl_new_delete_allocator>
 class avl_tree {
 public:
     avl_tree();
@@ -25,6 +137,40 @@ public:
 
     int size() const;
 
+    // Returns the number of items smaller than item.
+    int rank(const T& item) const;
+
+    // Returns the k-th smallest item, starting from 0. k must be in [0, size()).
+    T select(int k) const;
+
+    // Returns the number of items in [lo, hi].
+    int count_range(const T& lo, const T& hi) const;
+
+    class const_iterator;
+
+    // Iterate over the items in increasing order. Inserts don't invalidate the
+    // iterators, but a remove may move another item into the removed node, so
+    // invalidates them.
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    // Returns the first item that isn't smaller than item, or end().
+    const_iterator lower_bound(const T& item) const;
+
+    // Returns the first item larger than item, or end().
+    const_iterator upper_bound(const T& item) const;
+
+    // Calls callback(item) for every item in [lo, hi], in increasing order.
+    template <class Callback>
+    void range(const T& lo, const T& hi, Callback callback) const;
+
+    // Replaces the items of the tree with those in [first, last), which must be
+    // sorted forward iterators. Equal items are only added once.
+    // Takes O(n) time: the nodes are all reserved at once, and linked into a
+    // perfectly balanced tree, without any comparisons or rotations.
+    template <class Iterator>
+    void build_from_sorted(Iterator first, Iterator last);
+
 
     void print_out(std::ostream& o = std::cout) const;
 
@@ -37,6 +183,7 @@ protected:
         Node(const T& value, Node* parent)
             : value(value),
             height(0),
+            subtree_size(1),
             lhs(nullptr),
             rhs(nullptr),
             parent(parent) {
@@ -46,6 +193,8 @@ protected:
         // Height is treated as the distance from a leaf.
         // So nullptr nodes will have height -1.
         int height;
+        // Number of nodes in the subtree, including this one.
+        int subtree_size;
         Node* lhs;
         Node* rhs;
         Node* parent;
@@ -67,8 +216,21 @@ protected:
     // Gets the height of a node, with nullptr being -1.
     int height(const Node* node) const;
 
+    // Updates the subtree size of the node based on its two children, which
+    // MUST already have the correct size.
+    void update_subtree_size(Node* node) const;
+
+    // Gets the subtree size of a node, with nullptr being 0.
+    int subtree_size(const Node* node) const;
+
+    // Adds change to the subtree size of node and all of its ancestors.
+    void add_to_subtree_sizes(Node* node, int change) const;
+
+    // Returns the number of items that aren't larger than item.
+    int count_not_larger(const T& item) const;
+
     // Rotates the subtree that has this node as base. Will update the heights
-    // for the nodes that are changed.
+    // and subtree sizes for the nodes that are changed.
     void left_rotate(Node* node);
     void right_rotate(Node* node);
 
@@ -90,38 +252,133 @@ protected:
     // Will delete the sub-tree in O(n) time, where n is the number of nodes in
     // subtree.
     void delete_subtree(Node* node);
+
+    // Builds a perfectly balanced subtree of the next num_items items from
+    // *next, moving next past them, and returns its root. The root's parent
+    // is left as nullptr.
+    template <class Iterator>
+    Node* build_subtree(int num_items, Iterator* next, Iterator last);
+
+    NodeAllocator<Node> allocator;
 };
 
-template <class T>
-avl_tree<T>::avl_tree() 
+// Bidirectional iterator, which finds the next and previous nodes with the
+// parent pointers, so stepping over all n items takes O(n) time.
+template <class T, template <class> class NodeAllocator>
+class avl_tree<T, NodeAllocator>::const_iterator {
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator()
+        : tree(nullptr), node(nullptr) {
+    }
+
+    reference operator*() const { return node->value; }
+    pointer operator->() const { return &node->value; }
+
+    const_iterator& operator++() {
+        if (node->rhs != nullptr) {
+            // Smallest item of the right subtree.
+            node = node->rhs;
+            while (node->lhs != nullptr)
+                node = node->lhs;
+        } else {
+            // First ancestor that has this subtree on its left.
+            const Node* child = node;
+            node = node->parent;
+            while (node != nullptr && child == node->rhs) {
+                child = node;
+                node = node->parent;
+            }
+        }
+        return *this;
+    }
+
+    const_iterator& operator--() {
+        if (node == nullptr) {
+            // end() goes back to the largest item.
+            node = tree->root;
+            while (node->rhs != nullptr)
+                node = node->rhs;
+        } else if (node->lhs != nullptr) {
+            node = node->lhs;
+            while (node->rhs != nullptr)
+                node = node->rhs;
+        } else {
+            const Node* child = node;
+            node = node->parent;
+            while (node != nullptr && child == node->lhs) {
+                child = node;
+                node = node->parent;
+            }
+        }
+        return *this;
+    }
+
+    const_iterator operator++(int) {
+        const_iterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    const_iterator operator--(int) {
+        const_iterator previous = *this;
+        --*this;
+        return previous;
+    }
+
+    bool operator==(const const_iterator& other) const { return node == other.node; }
+    bool operator!=(const const_iterator& other) const { return node != other.node; }
+
+private:
+    friend class avl_tree;
+
+    // node is nullptr for end().
+    const_iterator(const avl_tree* tree, const Node* node)
+        : tree(tree), node(node) {
+    }
+
+    const avl_tree* tree;
+    const Node* node;
+};
+
+template <class T, template <class> class NodeAllocator>
+avl_tree<T, NodeAllocator>::avl_tree() 
     : num_elements(0),
     root(nullptr) {
 }
 
-template <class T>
-avl_tree<T>::~avl_tree() {
-    delete_subtree(root);
+template <class T, template <class> class NodeAllocator>
+avl_tree<T, NodeAllocator>::~avl_tree() {
+    // The allocator frees all of the nodes at once, so they only need to be
+    // visited if they have destructors to run.
+    if (!NodeAllocator<Node>::owns_nodes || !std::is_trivially_destructible<T>::value)
+        delete_subtree(root);
 }
 
-template <class T>
-void avl_tree<T>::delete_subtree(Node* node) {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::delete_subtree(Node* node) {
     if (node == nullptr)
         return;
 
     delete_subtree(node->lhs);
     delete_subtree(node->rhs);
 
-    delete node;
+    allocator.destroy(node);
 }
 
-template <class T>
-void avl_tree<T>::insert(const T& item) {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::insert(const T& item) {
     // Different cases in insert_balance function from
     // https://www.tutorialspoint.com/data_structures_algorithms/avl_tree_algorithm.htm
     // Case where the tree doesn't exist. Just set as root.
     if (root == nullptr) {
         ++num_elements;
-        root = new Node(item, nullptr);
+        root = allocator.create(item, nullptr);
         update_height(root);
         return;
     }
@@ -141,12 +398,16 @@ void avl_tree<T>::insert(const T& item) {
     // Wasn't already in the tree, so should be added.
     if (node == nullptr) {
         ++num_elements;
-        Node* new_node = new Node(item, parent);
+        Node* new_node = allocator.create(item, parent);
         if (item < parent->value)
             parent->lhs = new_node;
         else
             parent->rhs = new_node;
 
+        // Balance may stop after a single rotation, so all of the sizes are
+        // updated first.
+        add_to_subtree_sizes(parent, 1);
+
         // This node will definitely be balanced, since was just added.
         // May need to balance a parent node.
         balance(parent, /*only_rotate_once=*/true);
@@ -154,8 +415,8 @@ void avl_tree<T>::insert(const T& item) {
 }
 
 
-template <class T>
-void avl_tree<T>::remove(const T& item) {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::remove(const T& item) {
     // Cases from https://courses.cs.washington.edu/courses/cse332/10sp/lectures/lecture8.pdf
 
     // Find the node with the value that is being removed.
@@ -182,17 +443,18 @@ void avl_tree<T>::remove(const T& item) {
         node_to_remove->lhs : node_to_remove->rhs;
 
     transfer_subtree_parentship(node_to_remove, moving_up);
+    add_to_subtree_sizes(node_to_remove->parent, -1);
 
     // May need to rotate multiple times.
     balance(node_to_remove->parent, /*only_rotate_once=*/false);
 
-    delete node_to_remove;
+    allocator.destroy(node_to_remove);
     --num_elements;
 }
 
 
-template <class T>
-typename avl_tree<T>::Node* avl_tree<T>::get_removed_node(Node* node_with_removed_value) {
+template <class T, template <class> class NodeAllocator>
+typename avl_tree<T, NodeAllocator>::Node* avl_tree<T, NodeAllocator>::get_removed_node(Node* node_with_removed_value) {
     if (node_with_removed_value->lhs == nullptr ||
             node_with_removed_value->rhs == nullptr) {
         // Can remove this node, since one of its children don't exist.
@@ -219,8 +481,8 @@ typename avl_tree<T>::Node* avl_tree<T>::get_removed_node(Node* node_with_remove
     }
 }
 
-template <class T>
-void avl_tree<T>::balance(Node* current, bool only_rotate_once) {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::balance(Node* current, bool only_rotate_once) {
     if (current == nullptr) {
         return;
     }
@@ -252,8 +514,8 @@ void avl_tree<T>::balance(Node* current, bool only_rotate_once) {
     balance(current->parent, only_rotate_once);
 }
 
-template <class T>
-void avl_tree<T>::left_rotate(Node* node) {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::left_rotate(Node* node) {
     // node becomes the left child of new_base, with new_base's left child
     // becoming the right child of node.
     // new_base will become the owner of the subtree, which may update root.
@@ -265,10 +527,12 @@ void avl_tree<T>::left_rotate(Node* node) {
 
     update_height(node);
     update_height(new_base);
+    update_subtree_size(node);
+    update_subtree_size(new_base);
 }
 
-template <class T>
-void avl_tree<T>::right_rotate(Node* node) {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::right_rotate(Node* node) {
     // node becomes the right child of new_base, with new_base's right child
     // becoming the left child of node.
     // new_base will become the owner of the subtree, which may update root.
@@ -280,26 +544,28 @@ void avl_tree<T>::right_rotate(Node* node) {
 
     update_height(node);
     update_height(new_base);
+    update_subtree_size(node);
+    update_subtree_size(new_base);
 }
 
-template <class T>
-void avl_tree<T>::set_left_child(Node* parent, Node* new_child) const {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::set_left_child(Node* parent, Node* new_child) const {
     if (new_child != nullptr)
         new_child->parent = parent;
 
     parent->lhs = new_child;
 }
 
-template <class T>
-void avl_tree<T>::set_right_child(Node* parent, Node* new_child) const {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::set_right_child(Node* parent, Node* new_child) const {
     if (new_child != nullptr)
         new_child->parent = parent;
 
     parent->rhs = new_child;
 }
 
-template <class T>
-void avl_tree<T>::transfer_subtree_parentship(Node* old_root, Node* new_root) {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::transfer_subtree_parentship(Node* old_root, Node* new_root) {
     Node* parent = old_root->parent;
 
     if (parent != nullptr) {
@@ -314,8 +580,8 @@ void avl_tree<T>::transfer_subtree_parentship(Node* old_root, Node* new_root) {
     }
 }
 
-template <class T>
-bool avl_tree<T>::find(const T& item) const {
+template <class T, template <class> class NodeAllocator>
+bool avl_tree<T, NodeAllocator>::find(const T& item) const {
     Node* current = root;
 
     while (current != nullptr && current->value != item) {
@@ -329,8 +595,8 @@ bool avl_tree<T>::find(const T& item) const {
     return current != nullptr && current->value == item;
 }
 
-template <class T>
-T avl_tree<T>::minimum() const {
+template <class T, template <class> class NodeAllocator>
+T avl_tree<T, NodeAllocator>::minimum() const {
     assert(size() > 0);
 
     Node* current = root;
@@ -340,18 +606,18 @@ T avl_tree<T>::minimum() const {
     return current->value;
 }
 
-template <class T>
-void avl_tree<T>::update_height(Node* node) const {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::update_height(Node* node) const {
     node->height = 1 + std::max(height(node->lhs), height(node->rhs));
 }
 
-template <class T>
-int avl_tree<T>::subtree_difference(const Node* node) const {
+template <class T, template <class> class NodeAllocator>
+int avl_tree<T, NodeAllocator>::subtree_difference(const Node* node) const {
     return height(node->lhs) - height(node->rhs);
 }
 
-template <class T>
-int avl_tree<T>::height(const Node* node) const {
+template <class T, template <class> class NodeAllocator>
+int avl_tree<T, NodeAllocator>::height(const Node* node) const {
     if (node == nullptr) {
         return -1;
     }
@@ -359,18 +625,201 @@ int avl_tree<T>::height(const Node* node) const {
     return node->height;
 }
 
-template <class T>
-int avl_tree<T>::size() const {
+template <class T, template <class> class NodeAllocator>
+int avl_tree<T, NodeAllocator>::size() const {
     return num_elements;
 }
 
-template <class T>
-void avl_tree<T>::print_out(std::ostream& o) const {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::update_subtree_size(Node* node) const {
+    node->subtree_size = 1 + subtree_size(node->lhs) + subtree_size(node->rhs);
+}
+
+template <class T, template <class> class NodeAllocator>
+int avl_tree<T, NodeAllocator>::subtree_size(const Node* node) const {
+    if (node == nullptr) {
+        return 0;
+    }
+
+    return node->subtree_size;
+}
+
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::add_to_subtree_sizes(Node* node, int change) const {
+    for (; node != nullptr; node = node->parent) {
+        node->subtree_size += change;
+    }
+}
+
+template <class T, template <class> class NodeAllocator>
+int avl_tree<T, NodeAllocator>::rank(const T& item) const {
+    // Every node left of the path to item is smaller than it.
+    int num_smaller = 0;
+    Node* current = root;
+    while (current != nullptr) {
+        if (current->value < item) {
+            num_smaller += subtree_size(current->lhs) + 1;
+            current = current->rhs;
+        } else {
+            current = current->lhs;
+        }
+    }
+    return num_smaller;
+}
+
+template <class T, template <class> class NodeAllocator>
+int avl_tree<T, NodeAllocator>::count_not_larger(const T& item) const {
+    int num_not_larger = 0;
+    Node* current = root;
+    while (current != nullptr) {
+        if (current->value > item) {
+            current = current->lhs;
+        } else {
+            num_not_larger += subtree_size(current->lhs) + 1;
+            current = current->rhs;
+        }
+    }
+    return num_not_larger;
+}
+
+template <class T, template <class> class NodeAllocator>
+T avl_tree<T, NodeAllocator>::select(int k) const {
+    assert(k >= 0 && k < size());
+
+    Node* current = root;
+    while (k != subtree_size(current->lhs)) {
+        if (k < subtree_size(current->lhs)) {
+            current = current->lhs;
+        } else {
+            k -= subtree_size(current->lhs) + 1;
+            current = current->rhs;
+        }
+    }
+    return current->value;
+}
+
+template <class T, template <class> class NodeAllocator>
+typename avl_tree<T, NodeAllocator>::const_iterator avl_tree<T, NodeAllocator>::begin() const {
+    if (root == nullptr) {
+        return end();
+    }
+
+    const Node* current = root;
+    while (current->lhs != nullptr) {
+        current = current->lhs;
+    }
+    return const_iterator(this, current);
+}
+
+template <class T, template <class> class NodeAllocator>
+typename avl_tree<T, NodeAllocator>::const_iterator avl_tree<T, NodeAllocator>::end() const {
+    return const_iterator(this, nullptr);
+}
+
+template <class T, template <class> class NodeAllocator>
+typename avl_tree<T, NodeAllocator>::const_iterator avl_tree<T, NodeAllocator>::lower_bound(
+        const T& item) const {
+    // Last node where the path went left is the smallest one that isn't smaller.
+    const Node* bound = nullptr;
+    const Node* current = root;
+    while (current != nullptr) {
+        if (current->value < item) {
+            current = current->rhs;
+        } else {
+            bound = current;
+            current = current->lhs;
+        }
+    }
+    return const_iterator(this, bound);
+}
+
+template <class T, template <class> class NodeAllocator>
+typename avl_tree<T, NodeAllocator>::const_iterator avl_tree<T, NodeAllocator>::upper_bound(
+        const T& item) const {
+    const Node* bound = nullptr;
+    const Node* current = root;
+    while (current != nullptr) {
+        if (current->value > item) {
+            bound = current;
+            current = current->lhs;
+        } else {
+            current = current->rhs;
+        }
+    }
+    return const_iterator(this, bound);
+}
+
+template <class T, template <class> class NodeAllocator>
+template <class Callback>
+void avl_tree<T, NodeAllocator>::range(const T& lo, const T& hi, Callback callback) const {
+    for (const_iterator it = lower_bound(lo); it != end() && !(*it > hi); ++it) {
+        callback(*it);
+    }
+}
+
+template <class T, template <class> class NodeAllocator>
+template <class Iterator>
+void avl_tree<T, NodeAllocator>::build_from_sorted(Iterator first, Iterator last) {
+    delete_subtree(root);
+    root = nullptr;
+
+    // Sorted, so equal items are next to each other.
+    num_elements = 0;
+    if (first != last) {
+        num_elements = 1;
+        Iterator previous = first;
+        for (Iterator it = std::next(first); it != last; previous = it, ++it) {
+            if (*previous < *it)
+                ++num_elements;
+        }
+    }
+
+    allocator.reserve(num_elements);
+    root = build_subtree(num_elements, &first, last);
+}
+
+template <class T, template <class> class NodeAllocator>
+template <class Iterator>
+typename avl_tree<T, NodeAllocator>::Node* avl_tree<T, NodeAllocator>::build_subtree(
+        int num_items, Iterator* next, Iterator last) {
+    if (num_items == 0)
+        return nullptr;
+
+    // The items are used in order, so the left subtree is built first.
+    int num_on_left = (num_items - 1) / 2;
+    Node* lhs = build_subtree(num_on_left, next, last);
+
+    Node* node = allocator.create(**next, nullptr);
+    Iterator previous = *next;
+    do {
+        ++*next;
+    } while (*next != last && !(*previous < **next));
+
+    Node* rhs = build_subtree(num_items - 1 - num_on_left, next, last);
+
+    set_left_child(node, lhs);
+    set_right_child(node, rhs);
+    update_height(node);
+    update_subtree_size(node);
+    return node;
+}
+
+template <class T, template <class> class NodeAllocator>
+int avl_tree<T, NodeAllocator>::count_range(const T& lo, const T& hi) const {
+    if (lo > hi) {
+        return 0;
+    }
+
+    return count_not_larger(hi) - rank(lo);
+}
+
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::print_out(std::ostream& o) const {
     print_out(o, root);
 }
 
-template <class T>
-void avl_tree<T>::print_out(std::ostream& o, Node* node) const {
+template <class T, template <class> class NodeAllocator>
+void avl_tree<T, NodeAllocator>::print_out(std::ostream& o, Node* node) const {
     if (node == nullptr)
         return;
 
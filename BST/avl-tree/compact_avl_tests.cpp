@@ -0,0 +1,449 @@
+#include "compact_avl_tree.h"
+#include "avl_tree.h"
+
+#include <chrono>
+#include <limits>
+#include <iostream>
+#include <set>
+
+using namespace std;
+
+const int MostInserted =      1000000;
+
+const int LargestRandomNum = 10000000;
+const int NumRandomInserted =  500000;
+
+// In large test, will delete multiples of this immediately
+const int EveryDeletedImmediately = 5;
+
+// In large test, will delete multiples of this after everything else was inserted
+const int EveryDeletedAfter = 3;
+
+
+class compact_avl_test_tree : public compact_avl_tree<int> {
+public:
+    int root_val() const {
+        return nodes[root].value;
+    }
+
+    size_t node_size() const {
+        return sizeof(Node);
+    }
+
+    size_t num_nodes() const {
+        return nodes.size();
+    }
+
+    void assert_is_valid_avl_tree() const {
+        if (root == no_index)
+            return;
+
+        if (parent(root) != no_index)
+            throw "The root thinks it has a parent";
+
+        assert_is_valid_avl_tree(root, numeric_limits<int>::min(),
+                numeric_limits<int>::max());
+
+        if (size() != count_size(root))
+            throw "The size wasn't updated properly: is " +
+                to_string(count_size(root)) + " while reports " + to_string(size());
+
+        // Every other node must be on the free list.
+        size_t num_free = 0;
+        for (uint32_t node = free_list; node != no_index; node = nodes[node].lhs)
+            ++num_free;
+        if (num_free + size() != nodes.size())
+            throw "The free list has " + to_string(num_free) + " nodes, but " +
+                to_string(nodes.size() - size()) + " nodes aren't in the tree";
+    }
+
+    // Will return height of subtree.
+    int assert_is_valid_avl_tree(uint32_t node, int min_val, int max_val) const {
+        if (node == no_index)
+            return -1; // Missing nodes are -1, so leaves are 0.
+
+        int value = nodes[node].value;
+        if (value <= min_val || value >= max_val)
+            throw "The value " + to_string(value) +
+                " is outside the bounds (" + to_string(min_val) + ", " +
+                to_string(max_val) + ")";
+
+        if (lhs(node) != no_index && parent(lhs(node)) != node)
+            throw "The node " + to_string(nodes[lhs(node)].value) +
+                " does not have the right parent";
+
+        if (rhs(node) != no_index && parent(rhs(node)) != node)
+            throw "The node " + to_string(nodes[rhs(node)].value) +
+                " does not have the right parent";
+
+        int height_on_left = assert_is_valid_avl_tree(lhs(node), min_val, value);
+        int height_on_right = assert_is_valid_avl_tree(rhs(node), value, max_val);
+
+        if (abs(height_on_left - height_on_right) > 1)
+            throw "The node " + to_string(value) +
+                " has a large gap in height on either side (" +
+                to_string(height_on_left) + " vs " + to_string(height_on_right) + ".";
+
+        if (balance(node) != height_on_left - height_on_right)
+            throw "The node " + to_string(value) + " has balance " +
+                to_string(balance(node)) + " while should have " +
+                to_string(height_on_left - height_on_right) + ".";
+
+        return 1 + max(height_on_left, height_on_right);
+    }
+
+    int count_size(uint32_t node) const
+    {
+        if (node == no_index)
+            return 0;
+
+        return 1 + count_size(lhs(node)) + count_size(rhs(node));
+    }
+};
+
+bool CheckRoot(const compact_avl_test_tree& tree, int expected, const std::string& test_id) {
+    if (tree.root_val() != expected) {
+        std::cout << "ERROR in " << test_id << ": Root is " << tree.root_val()
+            << " expected " << expected << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool CheckMinimum(const compact_avl_test_tree& tree, int expected, const std::string& test_id) {
+    if (tree.minimum() != expected) {
+        std::cout << "ERROR in " << test_id << ": Minimum is " << tree.minimum()
+            << " expected " << expected << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool CheckIsValid(const compact_avl_test_tree& tree, const std::string& test_id) {
+     try {
+        tree.assert_is_valid_avl_tree();
+    } catch (string s) {
+        std::cout << "ERROR in " << test_id << ": " << s << '\n';
+        return false;
+    } catch (const char* s) {
+        std::cout << "ERROR in " << test_id << ": " << s << '\n';
+        return false;
+    }
+     return true;
+}
+
+bool NodeIsCompact() {
+    compact_avl_test_tree tree;
+    if (tree.node_size() != 16) {
+        std::cout << "ERROR in NodeIsCompact: Nodes are " << tree.node_size() <<
+            " bytes, expected 16\n";
+        return false;
+    }
+    return true;
+}
+
+bool InsertRightRotate() {
+    compact_avl_test_tree tree;
+
+    tree.insert(3);
+    tree.insert(1);
+    tree.insert(0);
+
+    bool valid = CheckRoot(tree, 1, "InsertRightRotate");
+    valid &= CheckMinimum(tree, 0, "InsertRightRotate");
+    valid &= CheckIsValid(tree, "InsertRightRotate");
+    return valid;
+}
+
+bool InsertLeftRightRotate() {
+    compact_avl_test_tree tree;
+
+    tree.insert(3);
+    tree.insert(1);
+    tree.insert(2);
+
+    bool valid = CheckRoot(tree, 2, "InsertLeftRightRotate");
+    valid &= CheckMinimum(tree, 1, "InsertLeftRightRotate");
+    valid &= CheckIsValid(tree, "InsertLeftRightRotate");
+    return valid;
+}
+
+bool InsertLeftRotate() {
+    compact_avl_test_tree tree;
+
+    tree.insert(3);
+    tree.insert(5);
+    tree.insert(7);
+
+    bool valid = CheckRoot(tree, 5, "InsertLeftRotate");
+    valid &= CheckMinimum(tree, 3, "InsertLeftRotate");
+    valid &= CheckIsValid(tree, "InsertLeftRotate");
+    return valid;
+}
+
+bool InsertRightLeftRotate() {
+    compact_avl_test_tree tree;
+
+    tree.insert(3);
+    tree.insert(5);
+    tree.insert(4);
+
+    bool valid = CheckRoot(tree, 4, "InsertRightLeftRotate");
+    valid &= CheckMinimum(tree, 3, "InsertRightLeftRotate");
+    valid &= CheckIsValid(tree, "InsertRightLeftRotate");
+    return valid;
+}
+
+bool DeleteRightRotate() {
+    compact_avl_test_tree tree;
+
+    // 6 will be root, with 3 (and its child 1) on left, 8 on right side.
+    tree.insert(6);
+    tree.insert(3);
+    tree.insert(8);
+    tree.insert(1);
+    
+    tree.remove(8);
+
+    if (tree.size() != 3)
+        throw "Failure in DeleteRightRotate: size is wrong. Misconfigured?";
+
+    bool valid = CheckRoot(tree, 3, "DeleteRightRotate");
+    valid &= CheckMinimum(tree, 1, "DeleteRightRotate");
+    valid &= CheckIsValid(tree, "DeleteRightRotate");
+    return valid;
+}
+
+bool DeleteLeftRightRotate() {
+    compact_avl_test_tree tree;
+
+    // 6 will be root, with 3 (and its child 4) on left, 8 on right side.
+    tree.insert(6);
+    tree.insert(3);
+    tree.insert(8);
+    tree.insert(4);
+    
+    tree.remove(8);
+
+    bool valid = CheckRoot(tree, 4, "DeleteLeftRightRotate");
+    valid &= CheckMinimum(tree, 3, "DeleteLeftRightRotate");
+    valid &= CheckIsValid(tree, "DeleteLeftRightRotate");
+    return valid;
+}
+
+bool DeleteLeftRotate() {
+    compact_avl_test_tree tree;
+
+    // 6 will be root, with 8 (and its child 9) on right, 3 on right side.
+    tree.insert(6);
+    tree.insert(3);
+    tree.insert(8);
+    tree.insert(9);
+    
+    tree.remove(3);
+
+    if (tree.size() != 3)
+        throw "Failure in DeleteRightRotate: size is wrong. Misconfigured?";
+
+    bool valid = CheckRoot(tree, 8, "DeleteLeftRotate");
+    valid &= CheckMinimum(tree, 6, "DeleteLeftRotate");
+    valid &= CheckIsValid(tree, "DeleteLeftRotate");
+    return valid;
+}
+
+bool DeleteRightLeftRotate() {
+    compact_avl_test_tree tree;
+
+    // 6 will be root, with 8 (and its child 7) on right, 3 on right side.
+    tree.insert(6);
+    tree.insert(3);
+    tree.insert(8);
+    tree.insert(7);
+    
+    tree.remove(3);
+
+    if (tree.size() != 3)
+        throw "Failure in DeleteRightRotate: size is wrong. Misconfigured?";
+
+    bool valid = CheckRoot(tree, 7, "DeleteRightLeftRotate");
+    valid &= CheckMinimum(tree, 6, "DeleteRightLeftRotate");
+    valid &= CheckIsValid(tree, "DeleteRihgtLeftRotate");
+    return valid;
+}
+
+// Removed nodes are reused, so the nodes only grow to the largest size the
+// tree had.
+bool RemovedNodesAreReused() {
+    compact_avl_test_tree tree;
+
+    for (int i = 0; i < 100; ++i)
+        tree.insert(i);
+    for (int i = 0; i < 100; i += 2)
+        tree.remove(i);
+    bool valid = CheckIsValid(tree, "RemovedNodesAreReused");
+
+    for (int i = 100; i < 150; ++i)
+        tree.insert(i);
+    valid &= CheckIsValid(tree, "RemovedNodesAreReused");
+
+    if (tree.num_nodes() != 100) {
+        std::cout << "ERROR in RemovedNodesAreReused: Has " << tree.num_nodes() <<
+            " nodes, expected 100\n";
+        valid = false;
+    }
+    return valid;
+}
+
+bool Contains(const std::set<int>& s, int num) {
+    return s.find(num) != s.end();
+}
+
+// Checks the tree against a std::set after every few random inserts and removes.
+void RandomInsertRemoveTest() {
+    compact_avl_test_tree tree;
+    std::set<int> s;
+
+    srand(0);
+    for (int i = 0; i < 20000; ++i) {
+        int num = rand() % 1000;
+        if (rand() % 3 == 0) {
+            tree.remove(num);
+            s.erase(num);
+        } else {
+            tree.insert(num);
+            s.insert(num);
+        }
+
+        if (i % 100 == 0 && !CheckIsValid(tree, "RandomInsertRemoveTest"))
+            return;
+    }
+
+    for (int i = 0; i < 1000; ++i)
+        if (tree.find(i) != Contains(s, i))
+            std::cout << "ERROR in RandomInsertRemoveTest: item " << i <<
+                " reported by set as " << Contains(s, i) << " compact avl reports " <<
+                tree.find(i) << '\n';
+
+    if (tree.size() != static_cast<int>(s.size()))
+        std::cout << "ERROR in RandomInsertRemoveTest: size is " << tree.size() <<
+            " expected " << s.size() << '\n';
+}
+
+void LargeRandomInsertTest() {
+    std::cout << "Starting large random insert. "
+        << "If this takes longer than ~20 seconds, there is a balancing issue\n";
+    compact_avl_test_tree tree;
+
+    srand(0);
+
+    std::set<int> s;
+    for (int i = 0; i < NumRandomInserted; ++i) {
+        int num = rand() % LargestRandomNum;
+        tree.insert(num);
+        s.insert(num);
+    }
+
+    for (int i = 0; i < LargestRandomNum; ++i)
+        if (tree.find(i) != Contains(s, i))
+            std::cout << "\nERROR in LargeRandomInsertTest: item " << i <<
+                " reported by set as " << Contains(s, i) << " compact avl reports " <<
+                tree.find(i) << '\n';
+
+    CheckIsValid(tree, "LargeRandomInsertTest");
+
+    std::cout << "Completed large random insert\n\n";
+}
+
+void RunLargeDeleteTest() {
+    std::cout << "Starting large delete test\n";
+
+    compact_avl_test_tree tree;
+
+    for (int i = 0; i < MostInserted; ++i) {
+        tree.insert(i);
+        if (i % EveryDeletedImmediately == 0) {
+            tree.remove(i);
+        }
+    }
+
+    // No point in continuing if invalid already.
+    if (!CheckIsValid(tree, "LargeDeleteTest"))
+        return;
+
+    for (int i = 0; i < MostInserted; i += EveryDeletedAfter) {
+        tree.remove(i);
+    }
+
+    for (int i = 0; i < MostInserted; ++i) {
+        if (i % EveryDeletedImmediately == 0 || i % EveryDeletedAfter == 0) {
+            // Should be deleted.
+            if (tree.find(i))
+                std::cout << "ERROR in LargeDeleteTest: Contains " << i << '\n';
+        } else if (!tree.find(i)) {
+            std::cout << "ERROR in LargeDeleteTest: Doesn't contain " << i << '\n';
+        }
+    }
+
+    CheckIsValid(tree, "LargeDeleteTest");
+    std::cout << "Finished large delete test\n\n";
+}
+
+chrono::milliseconds GetTime() {
+    return chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now().time_since_epoch());
+}
+
+// Inserts NumRandomInserted random keys, then looks up LargestRandomNum keys.
+template <class Tree>
+void RunRandomBenchmark(const std::string& name, size_t node_size) {
+    Tree tree;
+    chrono::milliseconds before = GetTime();
+
+    srand(0);
+    for (int i = 0; i < NumRandomInserted; ++i)
+        tree.insert(rand() % LargestRandomNum);
+
+    int sum = 0;
+    for (int i = 0; i < LargestRandomNum; ++i)
+        sum += tree.find(i);
+
+    chrono::milliseconds after = GetTime();
+    std::cout << name << ": " << node_size << " bytes per node, took " <<
+        (after - before).count() << "ms, found " << sum << " keys\n";
+}
+
+// avl_tree's nodes aren't accessible, so have the same layout as its Node.
+struct avl_tree_node {
+    int value;
+    int height;
+    int subtree_size;
+    void* lhs;
+    void* rhs;
+    void* parent;
+};
+
+
+int main() {
+    bool insert_fine = NodeIsCompact();
+    insert_fine &= InsertRightRotate();
+    insert_fine &= InsertLeftRightRotate();
+    insert_fine &= InsertLeftRotate();
+    insert_fine &= InsertRightLeftRotate();
+
+    bool delete_fine = DeleteRightRotate();
+    delete_fine &= DeleteLeftRightRotate();
+    delete_fine &= DeleteLeftRotate();
+    delete_fine &= DeleteRightLeftRotate();
+    delete_fine &= RemovedNodesAreReused();
+
+    std::cout << "Completed small tests\n\n";
+    if (insert_fine && delete_fine) {
+        RandomInsertRemoveTest();
+        LargeRandomInsertTest();
+        RunLargeDeleteTest();
+    }
+
+    RunRandomBenchmark<avl_tree<int>>("avl_tree", sizeof(avl_tree_node));
+    RunRandomBenchmark<compact_avl_tree<int>>("compact_avl_tree",
+        compact_avl_test_tree().node_size());
+}
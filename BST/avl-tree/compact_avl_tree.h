@@ -0,0 +1,469 @@
+#ifndef BST_COMPACT_AVL_TREE
+#define BST_COMPACT_AVL_TREE
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Version of avl_tree with far smaller nodes, for large trees of small items.
+//
+// The nodes are stored in a single std::vector, and link to each other by their
+// 32 bit index in it instead of by pointers. Rather than its height, each node
+// stores its balance factor (height of lhs - height of rhs, so -1, 0 or 1),
+// which is packed into the 2 lowest bits of its parent index.
+// It also doesn't store the size of its subtree, so a node of an int is 16
+// bytes, rather than the 40 bytes of avl_tree.
+//
+// Removed nodes are kept on a free list, and reused by later inserts. Their
+// items are only destroyed when they are reused, or the tree is destroyed.
+// Can hold at most 2^30 - 2 items.
+template <class T>
+class compact_avl_tree {
+public:
+    compact_avl_tree();
+
+    // Does nothing if item already exists in tree.
+    void insert(const T& item);
+
+    // Does nothing if item is not in tree.
+    void remove(const T& item);
+
+    // Returns true if item is in tree.
+    bool find(const T& item) const;
+
+    // Returns value of minimum item in tree.
+    T minimum() const;
+
+    int size() const;
+
+    // Makes room for num_items nodes, so the vector of nodes doesn't have to
+    // grow until then.
+    void reserve(size_t num_items);
+
+    void print_out(std::ostream& o = std::cout) const;
+
+// Protected to make testing easier.
+protected:
+    // Used for missing children, the parent of the root, and the end of the
+    // free list.
+    static const uint32_t no_index = (1u << 30) - 1;
+
+    struct Node {
+        Node(const T& value, uint32_t parent)
+            : value(value),
+            lhs(no_index),
+            rhs(no_index),
+            parent_and_balance(parent << 2 | 1) {
+        }
+
+        T value;
+        // Removed nodes use lhs as the next node of the free list.
+        uint32_t lhs;
+        uint32_t rhs;
+        // Parent index in the upper 30 bits, and balance + 1 in the lower 2 bits.
+        uint32_t parent_and_balance;
+    };
+
+    int num_elements;
+
+    uint32_t root;
+    std::vector<Node> nodes;
+    // First removed node that can be reused.
+    uint32_t free_list;
+
+    uint32_t lhs(uint32_t node) const { return nodes[node].lhs; }
+    uint32_t rhs(uint32_t node) const { return nodes[node].rhs; }
+
+    uint32_t parent(uint32_t node) const {
+        return nodes[node].parent_and_balance >> 2;
+    }
+
+    void set_parent(uint32_t node, uint32_t parent) {
+        nodes[node].parent_and_balance = parent << 2 | (nodes[node].parent_and_balance & 3);
+    }
+
+    int balance(uint32_t node) const {
+        return static_cast<int>(nodes[node].parent_and_balance & 3) - 1;
+    }
+
+    void set_balance(uint32_t node, int balance) {
+        nodes[node].parent_and_balance = (nodes[node].parent_and_balance & ~3u) | (balance + 1);
+    }
+
+    void set_left_child(uint32_t parent, uint32_t new_child);
+    void set_right_child(uint32_t parent, uint32_t new_child);
+
+    // Will ensure the subtree ownership is completely transfered from
+    // old_root to new_root, which may be no_index.
+    void transfer_subtree_parentship(uint32_t old_root, uint32_t new_root);
+
+    // Rotates the subtree that has this node as base. Only moves the links, so
+    // the balances must be updated by the caller.
+    void left_rotate(uint32_t node);
+    void right_rotate(uint32_t node);
+
+    // Rebalances the subtree of node, whose lhs (or rhs) is 2 taller than its
+    // other child, so its balance of 2 (or -2) can't be stored. Returns whether
+    // the height of the subtree stayed the same as before whatever made it
+    // unbalanced, which is only possible after a remove.
+    bool rebalance_left_heavy(uint32_t node);
+    bool rebalance_right_heavy(uint32_t node);
+
+    // Updates the balances from the parent of a new node, up to the first
+    // subtree whose height didn't change.
+    void balance_after_insert(uint32_t new_node);
+
+    // Updates the balances from node, whose lhs (if left_shrank) or rhs is now
+    // one shorter, up to the first subtree whose height didn't change.
+    void balance_after_remove(uint32_t node, bool left_shrank);
+
+    // Returns the index of a new node, reusing a removed one if there is one.
+    uint32_t create_node(const T& item, uint32_t parent);
+
+    // Returns the node with value item, or no_index.
+    uint32_t find_node(const T& item) const;
+
+    void print_out(std::ostream& o, uint32_t node) const;
+};
+
+template <class T>
+compact_avl_tree<T>::compact_avl_tree()
+    : num_elements(0),
+    root(no_index),
+    free_list(no_index) {
+}
+
+template <class T>
+uint32_t compact_avl_tree<T>::create_node(const T& item, uint32_t parent) {
+    ++num_elements;
+
+    if (free_list != no_index) {
+        uint32_t node = free_list;
+        free_list = nodes[node].lhs;
+        nodes[node] = Node(item, parent);
+        return node;
+    }
+
+    assert(nodes.size() < no_index);
+    nodes.emplace_back(item, parent);
+    return nodes.size() - 1;
+}
+
+template <class T>
+void compact_avl_tree<T>::insert(const T& item) {
+    if (root == no_index) {
+        root = create_node(item, no_index);
+        return;
+    }
+
+    // First, find the parent for this node.
+    uint32_t node = root;
+    uint32_t parent = no_index;
+    while (node != no_index && nodes[node].value != item) {
+        parent = node;
+        if (item < nodes[node].value)
+            node = lhs(node);
+        else
+            node = rhs(node);
+    }
+
+    // Wasn't already in the tree, so should be added.
+    if (node == no_index) {
+        // Created before the reference to parent, since it may grow nodes.
+        uint32_t new_node = create_node(item, parent);
+        if (item < nodes[parent].value)
+            nodes[parent].lhs = new_node;
+        else
+            nodes[parent].rhs = new_node;
+
+        balance_after_insert(new_node);
+    }
+}
+
+template <class T>
+void compact_avl_tree<T>::balance_after_insert(uint32_t new_node) {
+    uint32_t child = new_node;
+    uint32_t node = parent(child);
+
+    while (node != no_index) {
+        int new_balance = balance(node) + (child == lhs(node) ? 1 : -1);
+        if (new_balance == 0) {
+            // The shorter side caught up, so the height didn't change.
+            set_balance(node, 0);
+            return;
+        } else if (new_balance == 2) {
+            // After an insert, the rotations always restore the old height.
+            rebalance_left_heavy(node);
+            return;
+        } else if (new_balance == -2) {
+            rebalance_right_heavy(node);
+            return;
+        }
+
+        // Grew by one, so its parent needs updating too.
+        set_balance(node, new_balance);
+        child = node;
+        node = parent(node);
+    }
+}
+
+template <class T>
+void compact_avl_tree<T>::remove(const T& item) {
+    // Cases from https://courses.cs.washington.edu/courses/cse332/10sp/lectures/lecture8.pdf
+
+    uint32_t node = find_node(item);
+    // It didn't exist in the first place
+    if (node == no_index) {
+        return;
+    }
+
+    // Will remove (and swap with) node with largest value still smaller, or node
+    // with smallest values still larger, from the larger of sub-trees.
+    uint32_t node_to_remove = node;
+    if (lhs(node) != no_index && rhs(node) != no_index) {
+        if (balance(node) > 0) {
+            node_to_remove = lhs(node);
+            while (rhs(node_to_remove) != no_index)
+                node_to_remove = rhs(node_to_remove);
+        } else {
+            node_to_remove = rhs(node);
+            while (lhs(node_to_remove) != no_index)
+                node_to_remove = lhs(node_to_remove);
+        }
+        nodes[node].value = nodes[node_to_remove].value;
+    }
+
+    // At most one will not be no_index
+    uint32_t moving_up = lhs(node_to_remove) != no_index ?
+        lhs(node_to_remove) : rhs(node_to_remove);
+
+    uint32_t parent_of_removed = parent(node_to_remove);
+    bool left_shrank = parent_of_removed != no_index && lhs(parent_of_removed) == node_to_remove;
+    transfer_subtree_parentship(node_to_remove, moving_up);
+
+    if (parent_of_removed != no_index)
+        balance_after_remove(parent_of_removed, left_shrank);
+
+    nodes[node_to_remove].lhs = free_list;
+    free_list = node_to_remove;
+    --num_elements;
+}
+
+template <class T>
+void compact_avl_tree<T>::balance_after_remove(uint32_t node, bool left_shrank) {
+    while (node != no_index) {
+        // Found before any rotation moves node.
+        uint32_t next = parent(node);
+        bool next_left_shrank = next != no_index && lhs(next) == node;
+
+        int new_balance = balance(node) + (left_shrank ? -1 : 1);
+        if (new_balance == 1 || new_balance == -1) {
+            // Was balanced, so the other side keeps the height the same.
+            set_balance(node, new_balance);
+            return;
+        } else if (new_balance == 2) {
+            if (rebalance_left_heavy(node))
+                return;
+        } else if (new_balance == -2) {
+            if (rebalance_right_heavy(node))
+                return;
+        } else {
+            set_balance(node, 0);
+        }
+
+        // Shrank by one, so its parent needs updating too.
+        node = next;
+        left_shrank = next_left_shrank;
+    }
+}
+
+template <class T>
+bool compact_avl_tree<T>::rebalance_left_heavy(uint32_t node) {
+    uint32_t child = lhs(node);
+    int child_balance = balance(child);
+
+    if (child_balance >= 0) {
+        right_rotate(node);
+        if (child_balance == 0) {
+            set_balance(node, 1);
+            set_balance(child, -1);
+            return true;
+        }
+        set_balance(node, 0);
+        set_balance(child, 0);
+        return false;
+    }
+
+    // In this case, need to do a double rotate.
+    uint32_t grandchild = rhs(child);
+    int grandchild_balance = balance(grandchild);
+    left_rotate(child);
+    right_rotate(node);
+
+    set_balance(node, grandchild_balance == 1 ? -1 : 0);
+    set_balance(child, grandchild_balance == -1 ? 1 : 0);
+    set_balance(grandchild, 0);
+    return false;
+}
+
+template <class T>
+bool compact_avl_tree<T>::rebalance_right_heavy(uint32_t node) {
+    uint32_t child = rhs(node);
+    int child_balance = balance(child);
+
+    if (child_balance <= 0) {
+        left_rotate(node);
+        if (child_balance == 0) {
+            set_balance(node, -1);
+            set_balance(child, 1);
+            return true;
+        }
+        set_balance(node, 0);
+        set_balance(child, 0);
+        return false;
+    }
+
+    // In this case, need to do a double rotate.
+    uint32_t grandchild = lhs(child);
+    int grandchild_balance = balance(grandchild);
+    right_rotate(child);
+    left_rotate(node);
+
+    set_balance(node, grandchild_balance == -1 ? 1 : 0);
+    set_balance(child, grandchild_balance == 1 ? -1 : 0);
+    set_balance(grandchild, 0);
+    return false;
+}
+
+template <class T>
+void compact_avl_tree<T>::left_rotate(uint32_t node) {
+    // node becomes the left child of new_base, with new_base's left child
+    // becoming the right child of node.
+    // new_base will become the owner of the subtree, which may update root.
+    uint32_t new_base = rhs(node);
+    transfer_subtree_parentship(node, new_base);
+
+    set_right_child(node, lhs(new_base));
+    set_left_child(new_base, node);
+}
+
+template <class T>
+void compact_avl_tree<T>::right_rotate(uint32_t node) {
+    // node becomes the right child of new_base, with new_base's right child
+    // becoming the left child of node.
+    // new_base will become the owner of the subtree, which may update root.
+    uint32_t new_base = lhs(node);
+    transfer_subtree_parentship(node, new_base);
+
+    set_left_child(node, rhs(new_base));
+    set_right_child(new_base, node);
+}
+
+template <class T>
+void compact_avl_tree<T>::set_left_child(uint32_t parent, uint32_t new_child) {
+    if (new_child != no_index)
+        set_parent(new_child, parent);
+
+    nodes[parent].lhs = new_child;
+}
+
+template <class T>
+void compact_avl_tree<T>::set_right_child(uint32_t parent, uint32_t new_child) {
+    if (new_child != no_index)
+        set_parent(new_child, parent);
+
+    nodes[parent].rhs = new_child;
+}
+
+template <class T>
+void compact_avl_tree<T>::transfer_subtree_parentship(uint32_t old_root, uint32_t new_root) {
+    uint32_t old_parent = parent(old_root);
+
+    if (old_parent != no_index) {
+        if (old_root == lhs(old_parent))
+            set_left_child(old_parent, new_root);
+        else
+            set_right_child(old_parent, new_root);
+    } else {
+        root = new_root;
+        if (new_root != no_index)
+            set_parent(new_root, no_index);
+    }
+}
+
+template <class T>
+uint32_t compact_avl_tree<T>::find_node(const T& item) const {
+    uint32_t current = root;
+
+    while (current != no_index && nodes[current].value != item) {
+        if (nodes[current].value > item) {
+            current = lhs(current);
+        } else {
+            current = rhs(current);
+        }
+    }
+
+    return current;
+}
+
+template <class T>
+bool compact_avl_tree<T>::find(const T& item) const {
+    return find_node(item) != no_index;
+}
+
+template <class T>
+T compact_avl_tree<T>::minimum() const {
+    assert(size() > 0);
+
+    uint32_t current = root;
+    while (lhs(current) != no_index) {
+        current = lhs(current);
+    }
+    return nodes[current].value;
+}
+
+template <class T>
+int compact_avl_tree<T>::size() const {
+    return num_elements;
+}
+
+template <class T>
+void compact_avl_tree<T>::reserve(size_t num_items) {
+    nodes.reserve(num_items);
+}
+
+template <class T>
+void compact_avl_tree<T>::print_out(std::ostream& o) const {
+    print_out(o, root);
+}
+
+template <class T>
+void compact_avl_tree<T>::print_out(std::ostream& o, uint32_t node) const {
+    if (node == no_index)
+        return;
+
+    o << nodes[node].value << " balance " << balance(node) << " and goes to: ";
+    if (lhs(node) == no_index)
+        o << "nullptr";
+    else
+        o << nodes[lhs(node)].value;
+
+    o << " and ";
+    if (rhs(node) == no_index)
+        o << "nullptr";
+    else
+        o << nodes[rhs(node)].value;
+
+    o << ". Parent: ";
+    if (parent(node) == no_index)
+        o << "nullptr";
+    else
+        o << nodes[parent(node)].value;
+
+    o << ".\n";
+    print_out(o, lhs(node));
+    print_out(o, rhs(node));
+}
+
+#endif
@@ -22,6 +22,7 @@ public:
     virtual Wrapper* CopyWrapper() const = 0;
 };
 
+template <template <class> class NodeAllocator>
 class AvlWrapper : public Wrapper {
 public:
     void insert(int item) override {
@@ -41,7 +42,7 @@ public:
     }
 
 private:
-    avl_tree<int> tree;
+    avl_tree<int, NodeAllocator> tree;
 };
 
 class RedBlackWrapper : public Wrapper {
@@ -234,7 +235,8 @@ int RunTestAndPrintTime(const string tree_name, const Wrapper& base_tree) {
 
 int main() {
     int sum = 0;
-    sum += RunTestAndPrintTime("Avl Tree", AvlWrapper{});
+    sum += RunTestAndPrintTime("Avl Tree", AvlWrapper<avl_new_delete_allocator>{});
+    sum += RunTestAndPrintTime("Avl Tree (node pool)", AvlWrapper<avl_node_pool>{});
     sum += RunTestAndPrintTime("Red Black Tree", RedBlackWrapper{});
     sum += RunTestAndPrintTime("Skip List", SkipListWrapper{});
     sum += RunTestAndPrintTime("std::set", StandardSetWrapper{});
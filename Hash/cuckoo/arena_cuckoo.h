@@ -0,0 +1,210 @@
+#ifndef HASH_ARENA_CUCKOO_H
+#define HASH_ARENA_CUCKOO_H
+
+#include "cuckoo.h"
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Version of cuckoo_hashing for large items, which are stored out of line.
+//
+// The items are kept next to each other in an arena (a std::vector<T>), and each
+// slot of the tables only stores an 8 byte reference to one: a 32 bit fingerprint
+// of the item, and its index in the arena. Displacements and rehashes only ever
+// move references, and never copy the items.
+// The slots of an item are from Hash, which hashes the whole item like in
+// cuckoo_hashing, so items which share a fingerprint still get different slots
+// whenever the hashing functions change. Finding the other slot of a displaced
+// reference, and rehashing, read its item from the arena.
+// Lookups compare the fingerprint first, so will usually only read the item from
+// the arena if it is the one being looked for.
+//
+// Removing an item moves the last item of the arena into its place, so the arena
+// never has any gaps. The indices are 32 bits, so it can hold at most 2^32 - 1 items.
+//
+// Is implemented as a cuckoo_hashing of references, with a hash adapter that
+// hashes the items they refer to.
+
+namespace cuckoo_internal {
+
+// Reference to an item in the arena.
+struct arena_ref {
+    static const uint32_t no_index = std::numeric_limits<uint32_t>::max();
+
+    bool operator==(const arena_ref& other) const {
+        return fingerprint == other.fingerprint && index == other.index;
+    }
+
+    bool operator!=(const arena_ref& other) const {
+        return !(*this == other);
+    }
+
+    uint32_t fingerprint;
+    uint32_t index;
+};
+
+// An item being looked up, along with its fingerprint and the arena the
+// references point into.
+template <class T>
+struct arena_lookup {
+    uint32_t fingerprint;
+    const T* item;
+    const std::vector<T>* arena;
+};
+
+// Only reads the referenced item if the fingerprints match.
+template <class T>
+bool operator==(const arena_ref& ref, const arena_lookup<T>& lookup) {
+    return ref.fingerprint == lookup.fingerprint && ref.index != arena_ref::no_index &&
+        (*lookup.arena)[ref.index] == *lookup.item;
+}
+
+template <class T>
+bool operator==(const arena_lookup<T>& lookup, const arena_ref& ref) {
+    return ref == lookup;
+}
+
+}  // namespace cuckoo_internal
+
+// Empty slots have no index, so each slot is exactly 8 bytes.
+template <>
+struct cuckoo_empty_item<cuckoo_internal::arena_ref> {
+    static const bool exists = true;
+
+    static cuckoo_internal::arena_ref value() {
+        return {0, cuckoo_internal::arena_ref::no_index};
+    }
+};
+
+// Allows Hash, which hashes items, to hash references to items in the arena,
+// and lookups.
+template <class T, class Hash>
+class arena_item_hash {
+public:
+    arena_item_hash(Hash hash, const std::vector<T>* arena)
+        : hash(std::move(hash)),
+        arena(arena) {
+    }
+
+    void reset_hash(int p) {
+        hash.reset_hash(p);
+    }
+
+    int get_hash(const cuckoo_internal::arena_ref& ref) const {
+        return hash.get_hash((*arena)[ref.index]);
+    }
+
+    int get_hash(const cuckoo_internal::arena_lookup<T>& lookup) const {
+        return hash.get_hash(*lookup.item);
+    }
+
+private:
+    Hash hash;
+    const std::vector<T>* arena;
+};
+
+// Hash has the same requirements as for cuckoo_hashing. ItemHash is used to
+// compute the fingerprints, like std::hash, which only decide whether a lookup
+// compares against an item, so items sharing a fingerprint just make those
+// lookups slower.
+// Can't be copied, since the hash adapters point at the arena.
+template <class T, class Hash = multiply_shift_hashing_function<T>,
+    class ItemHash = std::hash<T>>
+class arena_cuckoo_hashing : protected cuckoo_hashing<cuckoo_internal::arena_ref,
+        arena_item_hash<T, Hash>> {
+public:
+    arena_cuckoo_hashing(Hash first_table, Hash second_table, double eps=0.4,
+        ItemHash item_hash=ItemHash());
+
+    arena_cuckoo_hashing(const arena_cuckoo_hashing&) = delete;
+    arena_cuckoo_hashing& operator=(const arena_cuckoo_hashing&) = delete;
+
+    void insert(const T& item);
+
+    bool contains(const T& item) const;
+
+    void remove(const T& item);
+
+    size_t size() const { return base::size(); }
+
+protected:
+    using ref = cuckoo_internal::arena_ref;
+    using base = cuckoo_hashing<ref, arena_item_hash<T, Hash>>;
+
+    uint32_t fingerprint(const T& item) const;
+
+    cuckoo_internal::arena_lookup<T> lookup(const T& item) const {
+        return {fingerprint(item), &item, &arena};
+    }
+
+    // Every item in the set, in no particular order.
+    std::vector<T> arena;
+
+    ItemHash item_hash;
+};
+
+template <class T, class Hash, class ItemHash>
+arena_cuckoo_hashing<T, Hash, ItemHash>::arena_cuckoo_hashing(
+        Hash first_table, Hash second_table, double eps, ItemHash item_hash)
+        // The arena isn't constructed yet, but is only read once it has items.
+        : base(arena_item_hash<T, Hash>(std::move(first_table), &arena),
+            arena_item_hash<T, Hash>(std::move(second_table), &arena), eps),
+        item_hash(std::move(item_hash)) {
+}
+
+template <class T, class Hash, class ItemHash>
+uint32_t arena_cuckoo_hashing<T, Hash, ItemHash>::fingerprint(const T& item) const {
+    // Finalizer from MurmurHash3, since std::hash is often the identity for integers.
+    uint64_t hash = item_hash(item);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return static_cast<uint32_t>(hash >> 32);
+}
+
+template <class T, class Hash, class ItemHash>
+void arena_cuckoo_hashing<T, Hash, ItemHash>::insert(const T& item) {
+    const cuckoo_internal::arena_lookup<T> item_lookup = lookup(item);
+    if (this->find_slot(item_lookup) != nullptr) {
+        return;
+    }
+
+    // The new index must fit in 32 bits, and not be no_index.
+    assert(arena.size() < ref::no_index);
+    // Hashing the reference reads the item, so it must be in the arena first.
+    arena.push_back(item);
+    // The item was just looked up, so doesn't need to be again.
+    typename base::ItemOr current{
+        ref{item_lookup.fingerprint, static_cast<uint32_t>(arena.size() - 1)}, true};
+    this->insert_new_item(&current);
+}
+
+template <class T, class Hash, class ItemHash>
+bool arena_cuckoo_hashing<T, Hash, ItemHash>::contains(const T& item) const {
+    return this->find_slot(lookup(item)) != nullptr;
+}
+
+template <class T, class Hash, class ItemHash>
+void arena_cuckoo_hashing<T, Hash, ItemHash>::remove(const T& item) {
+    typename base::ItemOr* slot = this->find_slot(lookup(item));
+    if (slot == nullptr) {
+        return;
+    }
+
+    // Fill the gap with the last item, and point its reference at the new index.
+    const uint32_t index = slot->item.index;
+    if (index != arena.size() - 1) {
+        typename base::ItemOr* last_slot = this->find_slot(lookup(arena.back()));
+        last_slot->item.index = index;
+        arena[index] = std::move(arena.back());
+    }
+    arena.pop_back();
+
+    this->remove_slot(slot);
+}
+
+#endif  // HASH_ARENA_CUCKOO_H
@@ -0,0 +1,336 @@
+#include "arena_cuckoo.h"
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+using milliseconds = std::chrono::milliseconds;
+using Time = std::chrono::system_clock;
+using std::to_string;
+
+const int NumElementsInserted =        1000000;
+const int EveryIndexRemovedAfterInsert =    10;
+
+using multiply_shift = multiply_shift_hashing_function<std::string>;
+
+// Gives every item the same fingerprint, so every lookup has to compare the items.
+struct constant_item_hash {
+    size_t operator()(const std::string& item) const {
+        return 0;
+    }
+};
+
+// Done differently than other Data Structures since want to get access to the data in the class
+template <class ItemHash = std::hash<std::string>>
+class arena_cuckoo_tests : public arena_cuckoo_hashing<std::string, multiply_shift, ItemHash> {
+public:
+    using base = arena_cuckoo_hashing<std::string, multiply_shift, ItemHash>;
+    using ref = cuckoo_internal::arena_ref;
+
+    // The rngs aren't randomly seeded, so the tests are repeatable.
+    arena_cuckoo_tests()
+        : base(multiply_shift{std::mt19937_64{}, false},
+            multiply_shift{std::mt19937_64{1}, false}) {
+    }
+
+    size_t get_slot_size() const {
+        return sizeof(typename base::base::ItemOr);
+    }
+
+    size_t get_stash_size() const {
+        return this->stash.size();
+    }
+
+    // Every item in the arena must be referenced by exactly one slot, which is
+    // valid for the item.
+    void assert_is_valid() const {
+        std::vector<int> num_references(this->arena.size(), 0);
+        auto check_reference = [this, &num_references](const ref& reference) {
+            if (reference.index >= this->arena.size())
+                throw "Reference to index " + to_string(reference.index) +
+                    " but the arena only has " + to_string(this->arena.size()) + " items";
+
+            const std::string& item = this->arena[reference.index];
+            if (reference.fingerprint != this->fingerprint(item))
+                throw "Fingerprint " + to_string(reference.fingerprint) + " is wrong for " + item;
+
+            ++num_references[reference.index];
+        };
+
+        for (int table = 0; table < 2; ++table) {
+            for (size_t i = 0; i < this->table_size; ++i) {
+                const ref& reference = this->tables[table][i].item;
+                if (!this->tables[table][i].contains_item()) {
+                    continue;
+                }
+
+                check_reference(reference);
+                size_t hash_using_tables_hash = this->hashes[table].get_hash(reference);
+                if (i != hash_using_tables_hash)
+                    throw "Invalid index to store " + this->arena[reference.index] +
+                        " at index " + to_string(i) + " but hashes to " +
+                        to_string(hash_using_tables_hash);
+            }
+        }
+
+        for (const typename base::base::ItemOr& stashed : this->stash) {
+            check_reference(stashed.item);
+        }
+
+        for (size_t index = 0; index < this->arena.size(); ++index) {
+            if (num_references[index] != 1)
+                throw "Item " + this->arena[index] + " has " + to_string(num_references[index]) +
+                    " references";
+        }
+
+        if (this->size() != this->arena.size())
+            throw "The size wasn't updated properly: is " +
+                to_string(this->arena.size()) + " while reports " + to_string(this->size());
+    }
+};
+
+template <class ItemHash>
+void CheckContainsElement(const arena_cuckoo_tests<ItemHash>& cuckoo, const std::string& val) {
+    if (!cuckoo.contains(val))
+        throw "Expected cuckoo to contain " + val;
+}
+
+template <class ItemHash>
+void CheckDoesntContainElement(const arena_cuckoo_tests<ItemHash>& cuckoo, const std::string& val) {
+    if (cuckoo.contains(val))
+        throw "Expected cuckoo to not contain " + val;
+}
+
+template <class ItemHash>
+void CheckNumberElements(const arena_cuckoo_tests<ItemHash>& cuckoo, size_t expected_size) {
+    if (cuckoo.size() != expected_size)
+        throw "Cuckoo size is wrong: expected " + to_string(expected_size) + " got " + to_string(cuckoo.size());
+}
+
+void SimpleInsertion() {
+    arena_cuckoo_tests<> cuckoo;
+
+    cuckoo.insert("five");
+    cuckoo.insert("six");
+    cuckoo.insert("seven");
+    cuckoo.insert("seven");
+
+    try {
+        if (cuckoo.get_slot_size() != 8)
+            throw "Slots should be 8 bytes, are " + to_string(cuckoo.get_slot_size());
+
+        CheckContainsElement(cuckoo, "five");
+        CheckContainsElement(cuckoo, "six");
+        CheckContainsElement(cuckoo, "seven");
+
+        CheckDoesntContainElement(cuckoo, "four");
+        CheckDoesntContainElement(cuckoo, "");
+
+        CheckNumberElements(cuckoo, 3);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in SimpleInsertion: " << s << '\n';
+        throw s;
+    }
+}
+
+// Removing an item moves the last item of the arena, whose reference must follow it.
+void RemoveMovesLastItem() {
+    arena_cuckoo_tests<> cuckoo;
+
+    for (int i = 0; i < 100; ++i) {
+        cuckoo.insert("item " + to_string(i));
+    }
+
+    try {
+        for (int i = 0; i < 100; i += 3) {
+            cuckoo.remove("item " + to_string(i));
+            cuckoo.assert_is_valid();
+        }
+        cuckoo.remove("not an item");
+
+        for (int i = 0; i < 100; ++i) {
+            if (i % 3 == 0)
+                CheckDoesntContainElement(cuckoo, "item " + to_string(i));
+            else
+                CheckContainsElement(cuckoo, "item " + to_string(i));
+        }
+
+        CheckNumberElements(cuckoo, 66);
+    } catch (std::string& s) {
+        std::cout << "Error in RemoveMovesLastItem: " << s << '\n';
+        throw s;
+    }
+}
+
+// Items with the same fingerprint still get different slots, so far more of them
+// than the stash can hold can be inserted, and lookups compare the items themselves.
+void ItemsWithSameFingerprint() {
+    arena_cuckoo_tests<constant_item_hash> cuckoo;
+
+    const int num_inserted = 1000;
+    for (int i = 0; i < num_inserted; ++i) {
+        cuckoo.insert("key" + to_string(i));
+    }
+
+    try {
+        for (int i = 0; i < num_inserted; ++i) {
+            CheckContainsElement(cuckoo, "key" + to_string(i));
+        }
+        CheckDoesntContainElement(cuckoo, "key" + to_string(num_inserted));
+        CheckNumberElements(cuckoo, num_inserted);
+
+        cuckoo.assert_is_valid();
+
+        for (int i = 0; i < num_inserted; i += 2) {
+            cuckoo.remove("key" + to_string(i));
+        }
+        for (int i = 0; i < num_inserted; ++i) {
+            if (i % 2 == 0)
+                CheckDoesntContainElement(cuckoo, "key" + to_string(i));
+            else
+                CheckContainsElement(cuckoo, "key" + to_string(i));
+        }
+        CheckNumberElements(cuckoo, num_inserted / 2);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in ItemsWithSameFingerprint: " << s << '\n';
+        throw s;
+    }
+}
+
+void LargeTest() {
+    arena_cuckoo_tests<> cuckoo;
+
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        cuckoo.insert("key" + to_string(i));
+        if (i % EveryIndexRemovedAfterInsert == 0)
+            cuckoo.remove("key" + to_string(i / 2));
+    }
+
+    try {
+        for (int i = 0; i < NumElementsInserted; ++i) {
+            // Only the first half of the keys were removed.
+            bool removed = i % (EveryIndexRemovedAfterInsert / 2) == 0 &&
+                i < NumElementsInserted / 2;
+            if (removed)
+                CheckDoesntContainElement(cuckoo, "key" + to_string(i));
+            else
+                CheckContainsElement(cuckoo, "key" + to_string(i));
+        }
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in LargeTest: " << s << '\n';
+        throw s;
+    }
+}
+
+
+// Large composite record, of which only some fields identify it.
+struct record {
+    bool operator==(const record& other) const {
+        return id == other.id && region == other.region;
+    }
+
+    int64_t id;
+    int64_t region;
+    double values[14];
+};
+
+struct record_hash {
+    size_t operator()(const record& r) const {
+        return r.id * 31 + r.region;
+    }
+};
+
+// Allows cuckoo_hashing to store records directly, hashing them by their id.
+class record_table_hash {
+public:
+    record_table_hash(multiply_shift_hashing_function<int64_t> hash)
+        : hash(std::move(hash)) {
+    }
+
+    void reset_hash(int p) {
+        hash.reset_hash(p);
+    }
+
+    int get_hash(const record& r) const {
+        return hash.get_hash(r.id * 31 + r.region);
+    }
+
+private:
+    multiply_shift_hashing_function<int64_t> hash;
+};
+
+record CreateRecord(int i) {
+    record r;
+    r.id = i * 2654435761u;
+    r.region = i % 7;
+    for (int value = 0; value < 14; ++value) {
+        r.values[value] = i + value;
+    }
+    return r;
+}
+
+milliseconds GetCurrentTime() {
+    return std::chrono::duration_cast<milliseconds>(
+        Time::now().time_since_epoch());
+}
+
+// Inserts NumElementsInserted records, then looks up 10 times as many, half of
+// which are misses.
+template <class Set>
+void RunRecordBenchmark(const std::string& name, Set* set) {
+    std::vector<record> records;
+    for (int i = 0; i < 2 * NumElementsInserted; ++i) {
+        records.push_back(CreateRecord(i));
+    }
+
+    milliseconds start_time = GetCurrentTime();
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        set->insert(records[i]);
+    }
+    milliseconds insert_time = GetCurrentTime() - start_time;
+
+    size_t num_found = 0;
+    start_time = GetCurrentTime();
+    for (int round = 0; round < 5; ++round) {
+        for (const record& r : records) {
+            num_found += set->contains(r);
+        }
+    }
+    milliseconds lookup_time = GetCurrentTime() - start_time;
+
+    if (num_found != 5 * static_cast<size_t>(NumElementsInserted))
+        throw "Record benchmark for " + name + " found " + to_string(num_found) + " records";
+
+    std::cout << "  " << name << ": insert " << insert_time.count() << " ms, lookups " <<
+        lookup_time.count() << " ms.\n";
+}
+
+
+int main() {
+    SimpleInsertion();
+    RemoveMovesLastItem();
+    ItemsWithSameFingerprint();
+    LargeTest();
+
+    std::cout << "Records of " << sizeof(record) << " bytes, inserting " <<
+        NumElementsInserted << " then doing " << 10 * NumElementsInserted << " lookups:\n";
+
+    // Both use the same hashing functions for the tables.
+    cuckoo_hashing<record, record_table_hash> inline_cuckoo{
+        record_table_hash{multiply_shift_hashing_function<int64_t>{std::mt19937_64{}, false}},
+        record_table_hash{multiply_shift_hashing_function<int64_t>{std::mt19937_64{1}, false}}};
+    RunRecordBenchmark("cuckoo_hashing", &inline_cuckoo);
+
+    arena_cuckoo_hashing<record, record_table_hash, record_hash> arena_cuckoo{
+        record_table_hash{multiply_shift_hashing_function<int64_t>{std::mt19937_64{}, false}},
+        record_table_hash{multiply_shift_hashing_function<int64_t>{std::mt19937_64{1}, false}}};
+    RunRecordBenchmark("arena_cuckoo_hashing", &arena_cuckoo);
+}
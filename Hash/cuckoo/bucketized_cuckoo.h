@@ -0,0 +1,406 @@
+#ifndef HASH_BUCKETIZED_CUCKOO_H
+#define HASH_BUCKETIZED_CUCKOO_H
+
+#include "cuckoo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Set-associative version of cuckoo_hashing. Each hash index refers to a bucket
+// of BucketSize slots instead of a single slot, and an item can be stored in any
+// slot of its bucket in either table. Most collisions are then absorbed by the
+// bucket itself, and displacements are only needed once both buckets are full.
+//
+// With a BucketSize of 4, load factors of 0.9 (over all slots in both tables)
+// are sustainable, while the single slot version must stay under 0.5.
+//
+// When both buckets are full, a random slot in the bucket is evicted and moved
+// to its alternate bucket (random walk), until either a free slot is found or
+// max_loop is reached, in which case the tables are rehashed.
+//
+// Each slot also has a one byte tag, computed from std::hash of the item. Lookups
+// will compare the tags of both buckets at once (using SSE2 if available), and
+// only compare the full item for slots whose tag matched.
+// Note: The tag can't be computed from the two indices, since with
+// basic_hashing_function both indices only depend on item % p, so every item in
+// a bucket would share the same tag.
+//
+// The tags of each table are kept in their own array, separate from the items,
+// so a bucket's tags or items never straddle two cache lines (as long as
+// BucketSize * sizeof(T) divides 64), and a miss usually only reads the tags.
+
+// Some intuition on sizes with max_load_factor=0.9 and BucketSize=4
+//  num buckets  min size     max size
+//  2            0            14
+//  4            1            28
+//  10           6            72
+
+// Hash has the same requirements as for cuckoo_hashing. The default is inlined,
+// unlike virtual_hashing_function, which costs a virtual call per table.
+template <class T, size_t BucketSize = 4, class Hash = multiply_shift_hashing_function<T>>
+class bucketized_cuckoo_hashing {
+public:
+    bucketized_cuckoo_hashing(Hash first_table, Hash second_table,
+        double max_load_factor=0.9);
+
+    void insert(const T& item);
+
+    bool contains(const T& item) const;
+
+    void remove(const T& item);
+
+    size_t size() const { return num_elements; }
+
+    // Fraction of all slots, in both tables, that contain an item.
+    double load_factor() const;
+
+    void print_out() const;
+
+protected:
+    static_assert(BucketSize > 0 && BucketSize <= 8,
+        "Tags for both buckets must fit into 16 bytes");
+
+    // The BucketSize tags and items of bucket index in table.
+    unsigned char* bucket_tags(int table, size_t index) {
+        return &tags[table][index * BucketSize];
+    }
+    const unsigned char* bucket_tags(int table, size_t index) const {
+        return &tags[table][index * BucketSize];
+    }
+    T* bucket_items(int table, size_t index) {
+        return &items[table][index * BucketSize];
+    }
+    const T* bucket_items(int table, size_t index) const {
+        return &items[table][index * BucketSize];
+    }
+
+    // Will never be 0.
+    static unsigned char compute_tag(const T& item);
+
+    // Returns a mask with bit slot set if first[slot] == tag, and
+    // bit 8 + slot set if second[slot] == tag.
+    static unsigned match_tags(const unsigned char* first,
+        const unsigned char* second, unsigned char tag);
+
+    // Will find the table and slot storing item. Returns false if it isn't stored.
+    bool find_item(const T& item, int* table, size_t* index, int* slot) const;
+
+    // Returns an empty slot of the bucket with slot_tags, or -1 if it is full.
+    int free_slot(const unsigned char* slot_tags) const;
+
+    // Will place item into one of its two buckets, evicting other items until either:
+    //   1) Found an empty slot, which means successfully inserted, and returns true.
+    //   2) reached max_loop iterations, in which case returns false and item will
+    //      hold the (possibly different) item that still needs to be placed.
+    bool attempt_to_insert_item(T& item);
+
+    // Chooses the number of buckets based off of the current number of elements,
+    // and then rebuilds the tables.
+    void resize();
+    size_t num_resize;
+
+    // Will reset both hashing functions and re-insert every item, including leftover
+    // if it isn't nullptr. Will repeat until every item has been placed.
+    void rehash(const T* leftover);
+    size_t num_rehash;
+
+    // Number of times an item was evicted from its slot.
+    size_t num_displacements;
+
+    // Tables will be resized once more than this fraction of all slots are used.
+    double max_load_factor;
+
+    // Maximum number of evictions before a rehash.
+    int max_loop;
+
+    size_t num_elements;
+    size_t max_number_elements;
+    size_t min_number_elements;
+
+    size_t num_buckets;
+    // num_buckets * BucketSize slots for each table. A tag of 0 means the slot
+    // doesn't contain an item.
+    std::vector<unsigned char> tags[2];
+    std::vector<T> items[2];
+    Hash hashes[2];
+
+    // Used to choose which slot is evicted.
+    std::mt19937 rng;
+};
+
+template <class T, size_t BucketSize, class Hash>
+bucketized_cuckoo_hashing<T, BucketSize, Hash>::bucketized_cuckoo_hashing(
+        Hash first_table, Hash second_table, double max_load_factor)
+        : num_resize(0),
+        num_rehash(0),
+        num_displacements(0),
+        max_load_factor(max_load_factor),
+        max_loop(0),
+        num_elements(0),
+        max_number_elements(0),
+        min_number_elements(0),
+        num_buckets(0),
+        hashes{std::move(first_table), std::move(second_table)} {
+    resize();
+}
+
+template <class T, size_t BucketSize, class Hash>
+void bucketized_cuckoo_hashing<T, BucketSize, Hash>::resize() {
+    ++num_resize;
+
+    // Aim to be half of max_load_factor after the resize, with a few extra buckets
+    // to ensure weird stuff doesn't happen when there is a small # of elements.
+    num_buckets = std::ceil(size() / (BucketSize * max_load_factor)) + 2;
+
+    max_number_elements = 2 * num_buckets * BucketSize * max_load_factor;
+    // Don't let the table get too empty.
+    min_number_elements = size() / 4;
+
+    // max_loop = 3 log2(num_buckets), with a floor since small tables often
+    // have every slot in the walk be full.
+    max_loop = 16 + 3 * std::ceil(std::log2(num_buckets));
+
+    rehash(nullptr);
+}
+
+template <class T, size_t BucketSize, class Hash>
+void bucketized_cuckoo_hashing<T, BucketSize, Hash>::rehash(const T* leftover) {
+    std::vector<T> to_place;
+    to_place.reserve(size());
+    if (leftover != nullptr) {
+        to_place.push_back(*leftover);
+    }
+
+    for (int table = 0; table < 2; ++table) {
+        for (size_t slot = 0; slot < tags[table].size(); ++slot) {
+            if (tags[table][slot] != 0) {
+                to_place.push_back(items[table][slot]);
+            }
+        }
+    }
+
+    bool placed_all = false;
+    while (!placed_all) {
+        ++num_rehash;
+
+        hashes[0].reset_hash(num_buckets);
+        hashes[1].reset_hash(num_buckets);
+
+        for (int table = 0; table < 2; ++table) {
+            tags[table].assign(num_buckets * BucketSize, 0);
+            tags[table].shrink_to_fit();
+            items[table].assign(num_buckets * BucketSize, T());
+            items[table].shrink_to_fit();
+        }
+
+        placed_all = true;
+        for (const T& item : to_place) {
+            T current = item;
+            if (!attempt_to_insert_item(current)) {
+                placed_all = false;
+                break;
+            }
+        }
+    }
+}
+
+template <class T, size_t BucketSize, class Hash>
+void bucketized_cuckoo_hashing<T, BucketSize, Hash>::insert(const T& item) {
+    if (contains(item)) {
+        return;
+    }
+
+    ++num_elements;
+
+    if (num_elements > max_number_elements) {
+        resize();
+    }
+
+    T current = item;
+    if (!attempt_to_insert_item(current)) {
+        rehash(&current);
+    }
+}
+
+template <class T, size_t BucketSize, class Hash>
+bool bucketized_cuckoo_hashing<T, BucketSize, Hash>::attempt_to_insert_item(T& current) {
+    size_t indices[2];
+    unsigned char tag = compute_tag(current);
+
+    // Try to put it into either of its buckets first.
+    for (int table = 0; table < 2; ++table) {
+        indices[table] = hashes[table].get_hash(current);
+        unsigned char* slot_tags = bucket_tags(table, indices[table]);
+        int slot = free_slot(slot_tags);
+        if (slot != -1) {
+            bucket_items(table, indices[table])[slot] = current;
+            slot_tags[slot] = tag;
+            return true;
+        }
+    }
+
+    std::uniform_int_distribution<int> slot_dist(0, BucketSize - 1);
+
+    // Both buckets are full, so evict a random item from the first and place it
+    // into its alternate bucket.
+    int current_table = 0;
+    for (int num_loops = 0; num_loops < max_loop;
+            ++num_loops, current_table = 1 - current_table) {
+        // The evicted item keeps its tag.
+        ++num_displacements;
+        int evicted_slot = slot_dist(rng);
+        std::swap(bucket_items(current_table, indices[current_table])[evicted_slot], current);
+        std::swap(bucket_tags(current_table, indices[current_table])[evicted_slot], tag);
+
+        // The evicted item can only go into the other table.
+        int other_table = 1 - current_table;
+        indices[other_table] = hashes[other_table].get_hash(current);
+        unsigned char* alternate_tags = bucket_tags(other_table, indices[other_table]);
+        int slot = free_slot(alternate_tags);
+        if (slot != -1) {
+            bucket_items(other_table, indices[other_table])[slot] = current;
+            alternate_tags[slot] = tag;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template <class T, size_t BucketSize, class Hash>
+void bucketized_cuckoo_hashing<T, BucketSize, Hash>::remove(const T& item) {
+    int table;
+    size_t index;
+    int slot;
+    if (!find_item(item, &table, &index, &slot)) {
+        return;
+    }
+
+    bucket_tags(table, index)[slot] = 0;
+    --num_elements;
+
+    // Resize table if necessary.
+    if (num_elements < min_number_elements) {
+        resize();
+    }
+}
+
+template <class T, size_t BucketSize, class Hash>
+bool bucketized_cuckoo_hashing<T, BucketSize, Hash>::contains(const T& item) const {
+    int table;
+    size_t index;
+    int slot;
+    return find_item(item, &table, &index, &slot);
+}
+
+template <class T, size_t BucketSize, class Hash>
+bool bucketized_cuckoo_hashing<T, BucketSize, Hash>::find_item(
+        const T& item, int* table, size_t* index, int* slot) const {
+    size_t indices[2] = {
+        static_cast<size_t>(hashes[0].get_hash(item)),
+        static_cast<size_t>(hashes[1].get_hash(item))};
+
+    unsigned matches = match_tags(bucket_tags(0, indices[0]), bucket_tags(1, indices[1]),
+        compute_tag(item));
+
+    // Only need to look at the items whose tag matched.
+    while (matches != 0) {
+        int bit = __builtin_ctz(matches);
+        matches &= matches - 1;
+
+        *table = bit / 8;
+        *index = indices[*table];
+        *slot = bit % 8;
+        if (bucket_items(*table, *index)[*slot] == item) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class T, size_t BucketSize, class Hash>
+unsigned char bucketized_cuckoo_hashing<T, BucketSize, Hash>::compute_tag(const T& item) {
+    // Finalizer from MurmurHash3, since std::hash is often the identity for integers.
+    uint64_t hash = std::hash<T>()(item);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    unsigned char tag = hash >> 56;
+    return tag == 0 ? 1 : tag;
+}
+
+template <class T, size_t BucketSize, class Hash>
+unsigned bucketized_cuckoo_hashing<T, BucketSize, Hash>::match_tags(
+        const unsigned char* first, const unsigned char* second, unsigned char tag) {
+    // Unused bytes stay 0, which will never match tag.
+    uint64_t first_tags = 0;
+    uint64_t second_tags = 0;
+    std::memcpy(&first_tags, first, BucketSize);
+    std::memcpy(&second_tags, second, BucketSize);
+
+#if defined(__SSE2__)
+    __m128i all_tags = _mm_set_epi64x(second_tags, first_tags);
+    __m128i matches = _mm_cmpeq_epi8(all_tags, _mm_set1_epi8(tag));
+    return _mm_movemask_epi8(matches);
+#else
+    unsigned matches = 0;
+    for (int byte = 0; byte < 8; ++byte) {
+        if (((first_tags >> (8 * byte)) & 0xFF) == tag)
+            matches |= 1 << byte;
+        if (((second_tags >> (8 * byte)) & 0xFF) == tag)
+            matches |= 1 << (8 + byte);
+    }
+    return matches;
+#endif
+}
+
+template <class T, size_t BucketSize, class Hash>
+int bucketized_cuckoo_hashing<T, BucketSize, Hash>::free_slot(const unsigned char* slot_tags) const {
+    for (size_t slot = 0; slot < BucketSize; ++slot) {
+        if (slot_tags[slot] == 0) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+template <class T, size_t BucketSize, class Hash>
+double bucketized_cuckoo_hashing<T, BucketSize, Hash>::load_factor() const {
+    return static_cast<double>(size()) / (2 * num_buckets * BucketSize);
+}
+
+template <class T, size_t BucketSize, class Hash>
+void bucketized_cuckoo_hashing<T, BucketSize, Hash>::print_out() const {
+    for (int table = 0; table < 2; ++table) {
+        std::cout << "Table " << table << ":\n";
+        for (size_t i = 0; i < num_buckets; ++i) {
+            std::cout << i << ":";
+            const unsigned char* slot_tags = bucket_tags(table, i);
+            const T* slot_items = bucket_items(table, i);
+            for (size_t slot = 0; slot < BucketSize; ++slot) {
+                if (slot_tags[slot] != 0) {
+                    std::cout << ' ' << slot_items[slot] << " (alt: " <<
+                        hashes[1 - table].get_hash(slot_items[slot]) << ")";
+                } else {
+                    std::cout << " _";
+                }
+            }
+            std::cout << '\n';
+        }
+    }
+}
+
+#endif  // HASH_BUCKETIZED_CUCKOO_H
@@ -0,0 +1,491 @@
+#include "bucketized_cuckoo.h"
+
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+
+using milliseconds = std::chrono::milliseconds;
+using Time = std::chrono::system_clock;
+using std::to_string;
+
+const int NumElementsInserted =        1000000;
+const int EveryIndexRemovedAfterInsert =    10;
+// Lookups are done for [0, NumElementsInserted * LookupRange), so most will be misses.
+const int NumLookupRounds =                 10;
+const int LookupRange =                      2;
+
+
+// Maps every item to the same index, so all items collide in both tables.
+class constant_hashing_function : public hashing_function<int> {
+public:
+    constant_hashing_function(int index)
+        : index(index) {
+    }
+
+    void reset_hash(int p) override {}
+
+    int get_hash(const int& t) const override {
+        return index;
+    }
+
+    const int index;
+};
+
+std::unique_ptr<hashing_function<int>> CreateBasicHash() {
+    return std::unique_ptr<hashing_function<int>>(
+        new basic_hashing_function<int>{std::mt19937{}, true});
+}
+
+using multiply_shift = multiply_shift_hashing_function<int>;
+
+// Done differently than other Data Structures since want to get access to the data in the class
+// Uses virtual hashing functions, so tests can choose where every item goes.
+template <size_t BucketSize>
+class bucketized_cuckoo_tests
+        : public bucketized_cuckoo_hashing<int, BucketSize, virtual_hashing_function<int>> {
+public:
+    using base = bucketized_cuckoo_hashing<int, BucketSize, virtual_hashing_function<int>>;
+
+    bucketized_cuckoo_tests(double max_load_factor=0.9)
+        : base(CreateBasicHash(), CreateBasicHash(), max_load_factor) {
+    }
+
+    bucketized_cuckoo_tests(std::unique_ptr<hashing_function<int>> first_table,
+        std::unique_ptr<hashing_function<int>> second_table,
+        double max_load_factor=0.9)
+        : base(std::move(first_table), std::move(second_table), max_load_factor) {
+    }
+
+    size_t get_num_resize() const {
+        return this->num_resize;
+    }
+
+    size_t get_num_rehash() const {
+        return this->num_rehash;
+    }
+
+    size_t get_num_displacements() const {
+        return this->num_displacements;
+    }
+
+    int get_number_inserts_required_to_increase_tablesize() const {
+        return this->max_number_elements - this->num_elements + 1;
+    }
+
+    int get_number_removes_required_to_decrease_tablesize() const {
+        return this->num_elements - this->min_number_elements + 1;
+    }
+
+    void assert_is_valid() const {
+        size_t number_elements =
+            assert_table_is_valid(0) + assert_table_is_valid(1);
+
+        if (this->size() != number_elements)
+            throw "The size wasn't updated properly: is " +
+                to_string(number_elements) + " while reports " + to_string(this->size());
+
+        if (number_elements < this->min_number_elements)
+            throw "Table should have been resized, number elements is " + to_string(number_elements) +
+                " vs min of " + to_string(this->min_number_elements);
+
+        if (number_elements > this->max_number_elements)
+            throw "Table should have been resized, number elements is " + to_string(number_elements) +
+                " vs max of " + to_string(this->max_number_elements);
+
+        if (this->load_factor() > this->max_load_factor)
+            throw "The load factor " + to_string(this->load_factor()) +
+                " is larger than the max of " + to_string(this->max_load_factor);
+    }
+
+private:
+
+    size_t assert_table_is_valid(int table_num) const {
+        // Count the number of elements, and ensure each element is in the correct bucket.
+        size_t number_elements = 0;
+        for (size_t i = 0; i < this->num_buckets; ++i) {
+            for (size_t slot = 0; slot < BucketSize; ++slot) {
+                unsigned char tag = this->bucket_tags(table_num, i)[slot];
+                if (tag == 0) {
+                    continue;
+                }
+
+                ++number_elements;
+
+                int item_stored = this->bucket_items(table_num, i)[slot];
+
+                size_t hash_using_tables_hash = this->hashes[table_num].get_hash(item_stored);
+                if (i != hash_using_tables_hash)
+                    throw "Invalid bucket to store value " + to_string(item_stored) + ": " +
+                       " in bucket " + to_string(i) + " but hashes to " +
+                       to_string(hash_using_tables_hash) + " in table " + to_string(table_num);
+
+                unsigned char expected_tag = base::compute_tag(item_stored);
+                if (tag != expected_tag)
+                    throw "Invalid tag for value " + to_string(item_stored) + ": " +
+                        to_string(tag) + " but should be " + to_string(expected_tag);
+            }
+        }
+
+        return number_elements;
+    }
+};
+
+template <size_t BucketSize>
+void CheckContainsElement(const bucketized_cuckoo_tests<BucketSize>& cuckoo, int val) {
+    if (!cuckoo.contains(val))
+        throw "Expected cuckoo to contain " + to_string(val);
+}
+
+template <size_t BucketSize>
+void CheckDoesntContainElement(const bucketized_cuckoo_tests<BucketSize>& cuckoo, int val) {
+    if (cuckoo.contains(val))
+        throw "Expected cuckoo to not contain " + to_string(val);
+}
+
+template <size_t BucketSize>
+void CheckNumberElements(const bucketized_cuckoo_tests<BucketSize>& cuckoo, size_t expected_size) {
+    if (cuckoo.size() != expected_size)
+        throw "Cuckoo size is wrong: expected " + to_string(expected_size) + " got " + to_string(cuckoo.size());
+}
+
+template <size_t BucketSize>
+void CheckNumberResize(const bucketized_cuckoo_tests<BucketSize>& cuckoo, size_t expected_count) {
+    if (cuckoo.get_num_resize() != expected_count)
+        throw "Unexpected number of resize, expected " + to_string(expected_count) +
+            " got " + to_string(cuckoo.get_num_resize());
+}
+
+void SimpleInsertion() {
+    bucketized_cuckoo_tests<4> cuckoo;
+
+    cuckoo.insert(5);
+    cuckoo.insert(6);
+    cuckoo.insert(7);
+    cuckoo.insert(7);
+
+    try {
+        CheckContainsElement(cuckoo, 5);
+        CheckContainsElement(cuckoo, 6);
+        CheckContainsElement(cuckoo, 7);
+
+        CheckDoesntContainElement(cuckoo, 4);
+        CheckDoesntContainElement(cuckoo, 9);
+
+        CheckNumberElements(cuckoo, 3);
+
+        // Only the initial setup when creating the object
+        CheckNumberResize(cuckoo, 1);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in SimpleInsertion: " << s << '\n';
+        throw s;
+    }
+}
+
+void InsertionFillsBothBuckets() {
+    // Every item collides, so can only store 2 * BucketSize items without a rehash
+    // being impossible. All must end up in bucket 0 of table 0 or bucket 1 of table 1.
+    bucketized_cuckoo_tests<4> cuckoo{
+        std::unique_ptr<hashing_function<int>>(new constant_hashing_function{0}),
+        std::unique_ptr<hashing_function<int>>(new constant_hashing_function{1}),
+        /*max_load_factor=*/1
+    };
+
+    for (int i = 0; i < 8; ++i) {
+        cuckoo.insert(i);
+    }
+
+    try {
+        for (int i = 0; i < 8; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+
+        CheckDoesntContainElement(cuckoo, 8);
+
+        CheckNumberElements(cuckoo, 8);
+
+        // Never needed to evict anything, since the two buckets had space.
+        if (cuckoo.get_num_displacements() != 0)
+            throw "Expected no displacements, got " + to_string(cuckoo.get_num_displacements());
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in InsertionFillsBothBuckets: " << s << '\n';
+        throw s;
+    }
+}
+
+void InsertionForceTableResize() {
+    bucketized_cuckoo_tests<4> cuckoo;
+
+    int to_insert = cuckoo.get_number_inserts_required_to_increase_tablesize();
+
+    for (int i = 0; i < to_insert; ++i) {
+        cuckoo.insert(i);
+    }
+
+    try {
+        for (int i = 0; i < to_insert; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+
+        CheckDoesntContainElement(cuckoo, to_insert);
+
+        CheckNumberElements(cuckoo, to_insert);
+
+        // Initial setup when creating the object, and an additional resize
+        CheckNumberResize(cuckoo, 2);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in InsertionForceTableResize: " << s << '\n';
+        throw s;
+    }
+}
+
+void RemoveItemsWhenHadManyBefore() {
+    bucketized_cuckoo_tests<8> cuckoo;
+
+    int to_insert = cuckoo.get_number_inserts_required_to_increase_tablesize();
+
+    // Insert enough items to force it to resize.
+    for (int i = 0; i < to_insert; ++i) {
+        cuckoo.insert(i);
+    }
+
+    int to_remove = cuckoo.get_number_removes_required_to_decrease_tablesize();
+    // Remove enough items to force it to decrease in size.
+    for (int i = 0; i < to_remove; ++i) {
+        cuckoo.remove(i);
+    }
+
+    try {
+        for (int i = 0; i < to_remove; ++i) {
+            CheckDoesntContainElement(cuckoo, i);
+        }
+        for (int i = to_remove; i < to_insert; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+
+        CheckNumberElements(cuckoo, to_insert - to_remove);
+
+        // Initial setup when creating the object, additional increase
+        // additional decrease.
+        CheckNumberResize(cuckoo, 3);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in RemoveItemsWhenHadManyBefore: " << s << '\n';
+        throw s;
+    }
+}
+
+
+milliseconds GetCurrentTime() {
+    return std::chrono::duration_cast<milliseconds >(
+            Time::now().time_since_epoch());
+}
+
+template <size_t BucketSize>
+milliseconds RunLargeTest(bucketized_cuckoo_tests<BucketSize>* cuckoo) {
+    milliseconds start_time = GetCurrentTime();
+
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        cuckoo->insert(i);
+        if (!cuckoo->contains(i))
+            throw "Something funky happened, lost element " + to_string(i) + " during insertion";
+        if (i % EveryIndexRemovedAfterInsert == 0)
+            cuckoo->remove(i);
+    }
+
+    // Search for all elements, to add time taken.
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        // Wasn't supposed to be removed.
+        if (i % EveryIndexRemovedAfterInsert != 0 && !cuckoo->contains(i))
+            throw "Hash didn't include " + to_string(i);
+    }
+
+    milliseconds operations_time = GetCurrentTime() - start_time;
+
+    // Check it is valid. Don't count this time
+    try {
+        cuckoo->assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in RunLargeTest: " << s << '\n';
+        throw s;
+    }
+
+    return operations_time;
+}
+
+// Only does inserts, so the time is dominated by how often items are evicted
+// or the tables are rebuilt.
+template <size_t BucketSize>
+void RunLoadFactorBenchmark(double max_load_factor) {
+    bucketized_cuckoo_tests<BucketSize> cuckoo(max_load_factor);
+
+    milliseconds start_time = GetCurrentTime();
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        cuckoo.insert(i);
+    }
+    milliseconds insert_time = GetCurrentTime() - start_time;
+
+    try {
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in RunLoadFactorBenchmark: " << s << '\n';
+        throw s;
+    }
+
+    std::cout << "  bucket size " << BucketSize << ", max load " << max_load_factor <<
+        ": " << insert_time.count() << " ms, " <<
+        static_cast<double>(cuckoo.get_num_displacements()) / NumElementsInserted <<
+        " displacements per insert, " << cuckoo.get_num_rehash() << " rehashes, " <<
+        cuckoo.get_num_resize() << " resizes\n";
+}
+
+// Read heavy workload, where NumLookupRounds * NumElementsInserted / num_inserted
+// lookups are done for every insert, so there are always as many lookups.
+// Half of the lookups will be for items that weren't inserted.
+template <class Set>
+milliseconds RunContainsBenchmark(Set* set, int num_inserted) {
+    for (int i = 0; i < num_inserted; ++i) {
+        set->insert(i);
+    }
+
+    const int num_rounds = NumLookupRounds * (NumElementsInserted / num_inserted);
+    milliseconds start_time = GetCurrentTime();
+    size_t num_found = 0;
+    for (int round = 0; round < num_rounds; ++round) {
+        for (int i = 0; i < num_inserted * LookupRange; ++i) {
+            num_found += set->count(i);
+        }
+    }
+    milliseconds lookup_time = GetCurrentTime() - start_time;
+
+    if (num_found != static_cast<size_t>(num_inserted) * num_rounds)
+        throw "Found " + to_string(num_found) + " items during lookups, expected " +
+            to_string(static_cast<size_t>(num_inserted) * num_rounds);
+
+    return lookup_time;
+}
+
+// Gives bucketized_cuckoo_hashing, with its default inlined Hash, the same lookup
+// interface as std::unordered_set. Without UseTags, lookups compare the items of
+// both buckets directly, and only read the tag of a slot whose item matched.
+// The rngs aren't randomly seeded, so the tests are repeatable.
+template <bool UseTags>
+class bucketized_count_wrapper : public bucketized_cuckoo_hashing<int> {
+public:
+    bucketized_count_wrapper()
+        : bucketized_cuckoo_hashing<int>(multiply_shift{std::mt19937_64{}, false},
+            multiply_shift{std::mt19937_64{1}, false}) {
+    }
+
+    size_t count(int item) const {
+        return UseTags ? contains(item) : contains_without_tags(item);
+    }
+
+private:
+    bool contains_without_tags(int item) const {
+        bool found = false;
+        for (int table = 0; table < 2; ++table) {
+            size_t index = hashes[table].get_hash(item);
+            const int* slot_items = bucket_items(table, index);
+            // The default BucketSize is 4.
+            for (size_t slot = 0; slot < 4; ++slot) {
+                found |= slot_items[slot] == item && bucket_tags(table, index)[slot] != 0;
+            }
+        }
+        return found;
+    }
+};
+
+// The previous default, with basic_hashing_function called virtually.
+class bucketized_virtual_count_wrapper : public bucketized_cuckoo_tests<4> {
+public:
+    size_t count(int item) const { return this->contains(item); }
+};
+
+// The single slot version, with the same hashing functions.
+class cuckoo_count_wrapper : public cuckoo_hashing<int, multiply_shift> {
+public:
+    cuckoo_count_wrapper()
+        : cuckoo_hashing<int, multiply_shift>(multiply_shift{std::mt19937_64{}, false},
+            multiply_shift{std::mt19937_64{1}, false}) {
+    }
+
+    size_t count(int item) const { return contains(item); }
+};
+
+void RunUnorderedSetInsertBenchmark() {
+    std::unordered_set<int> s;
+
+    milliseconds start_time = GetCurrentTime();
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        s.insert(i);
+    }
+    milliseconds insert_time = GetCurrentTime() - start_time;
+
+    std::cout << "  unordered_set, max load " << s.max_load_factor() <<
+        ": " << insert_time.count() << " ms\n";
+}
+
+
+int main() {
+    SimpleInsertion();
+    InsertionFillsBothBuckets();
+    InsertionForceTableResize();
+    RemoveItemsWhenHadManyBefore();
+
+    bucketized_cuckoo_tests<4> cuckoo;
+    milliseconds time_for_bucketized_cuckoo =
+        RunLargeTest(&cuckoo);
+
+    std::cout << "Time for bucketized cuckoo: " << time_for_bucketized_cuckoo.count() << " ms.\n";
+
+    std::cout << "Inserting " << NumElementsInserted << " elements:\n";
+    RunLoadFactorBenchmark<4>(0.5);
+    RunLoadFactorBenchmark<4>(0.7);
+    RunLoadFactorBenchmark<4>(0.8);
+    RunLoadFactorBenchmark<4>(0.9);
+    RunLoadFactorBenchmark<4>(0.95);
+    RunLoadFactorBenchmark<8>(0.9);
+    RunLoadFactorBenchmark<8>(0.95);
+    RunLoadFactorBenchmark<8>(0.98);
+    RunUnorderedSetInsertBenchmark();
+
+    // The small sets fit in the cache, so only time computing the hashes and tags.
+    for (int num_inserted : {NumElementsInserted, NumElementsInserted / 100}) {
+        bucketized_count_wrapper<true> bucketized_for_lookups;
+        bucketized_count_wrapper<false> bucketized_without_tags_for_lookups;
+        bucketized_virtual_count_wrapper bucketized_virtual_for_lookups;
+        cuckoo_count_wrapper cuckoo_for_lookups;
+        std::unordered_set<int> unordered_set_for_lookups;
+        milliseconds time_for_bucketized_lookups =
+            RunContainsBenchmark(&bucketized_for_lookups, num_inserted);
+        milliseconds time_for_bucketized_without_tags_lookups =
+            RunContainsBenchmark(&bucketized_without_tags_for_lookups, num_inserted);
+        milliseconds time_for_bucketized_virtual_lookups =
+            RunContainsBenchmark(&bucketized_virtual_for_lookups, num_inserted);
+        milliseconds time_for_cuckoo_lookups =
+            RunContainsBenchmark(&cuckoo_for_lookups, num_inserted);
+        milliseconds time_for_unordered_set_lookups =
+            RunContainsBenchmark(&unordered_set_for_lookups, num_inserted);
+
+        std::cout << "Time for " << NumLookupRounds * LookupRange << "M lookups in a set of " <<
+            num_inserted << ":\n" <<
+            "  bucketized cuckoo " << time_for_bucketized_lookups.count() << " ms,\n" <<
+            "  bucketized cuckoo without tags " <<
+            time_for_bucketized_without_tags_lookups.count() << " ms,\n" <<
+            "  bucketized cuckoo with virtual basic hashing " <<
+            time_for_bucketized_virtual_lookups.count() << " ms,\n" <<
+            "  cuckoo_hashing " << time_for_cuckoo_lookups.count() << " ms,\n" <<
+            "  unordered_set " << time_for_unordered_set_lookups.count() << " ms.\n";
+    }
+}
@@ -0,0 +1,666 @@
+#ifndef HASH_CONCURRENT_CUCKOO_H
+#define HASH_CONCURRENT_CUCKOO_H
+
+#include "cuckoo.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Version of cuckoo_hashing that any number of threads can use at the same time.
+// Readers never take a lock, and writers only lock the slots they change.
+//
+// Every slot belongs to one of num_stripes stripes, each of which has a version.
+// A writer locks a stripe by making its version odd, and unlocks it by making it
+// even again. A reader reads the versions of its two stripes, then the two slots,
+// then the versions again, and retries if any of them changed.
+//
+// Inserts work like libcuckoo: if both slots of the item are full, the path of
+// items that need to be moved is found without holding any locks. The items are
+// then moved starting from the empty end of the path, each move locking just the
+// two stripes involved, and checking that nothing changed since the path was found.
+// Each item is written into its new slot before being removed from its old one,
+// so readers can never miss an item while it is being displaced.
+//
+// The hashing functions never change, and table sizes are powers of two, so when
+// the tables double the item at index i can only move to 2i or 2i + 1. That index
+// belongs to the same stripe, so each stripe can be moved to the new tables on its
+// own. Resizing publishes the new tables, then migrates one stripe at a time,
+// while other threads keep using the stripes it isn't migrating (and migrate
+// any stripe they need first). Nothing ever waits for the whole table to move.
+//
+// The tables only ever grow, when they are more than 1 / (1 + eps) full or
+// no path was found for an insert.
+//
+// Threads may still be reading the tables a resize replaced, so they are freed
+// using epochs. Every operation announces the epoch it started in, and the epoch
+// can only advance once no running operation announced an older one. Tables
+// replaced in epoch e are freed once the epoch reaches e + 2, by the insert that
+// resized after it finishes, or by reclaim_retired_tables().
+//
+// The hashes are 30 bits, so each table has at most 2^30 slots, and the set can
+// hold at most 2^30 / (1 + eps) items. A resize past that fails an assert.
+//
+// T must be trivially copyable, since readers may read a slot while it is being
+// written (and will then discard what they read).
+
+template <class T, class Hash>
+class concurrent_cuckoo_hashing {
+public:
+    concurrent_cuckoo_hashing(Hash first_table, Hash second_table, double eps=0.4);
+
+    ~concurrent_cuckoo_hashing();
+
+    bool contains(const T& item) const;
+
+    void insert(const T& item);
+
+    void remove(const T& item);
+
+    size_t size() const { return num_elements.load(std::memory_order_relaxed); }
+
+    // Frees the tables replaced by resizes which no thread can still be using.
+    // Inserts that resize already do this, so it only frees them sooner.
+    void reclaim_retired_tables();
+
+protected:
+    static_assert(std::is_trivially_copyable<T>::value,
+        "Readers copy items while they may be written");
+
+    // Hashes are in [0, 2^hash_bits), and the top stripe_bits of the hash is the stripe.
+    static const int hash_bits = 30;
+    static const int stripe_bits = 10;
+    static const size_t num_stripes = size_t(1) << stripe_bits;
+    // Every index is the top bits of the hash, so no table can be larger.
+    static const size_t max_table_size = size_t(1) << hash_bits;
+    // Longest path of displacements that will be looked for before resizing.
+    static const int max_path_length = 64;
+
+    struct Slot {
+        Slot()
+            : contains_item(false)
+        {}
+
+        std::atomic<T> item;
+        std::atomic<bool> contains_item;
+    };
+
+    struct Tables {
+        explicit Tables(size_t table_size)
+            : table_size(table_size),
+            index_shift(hash_bits) {
+            assert(table_size <= max_table_size);
+            while ((size_t(1) << (hash_bits - index_shift)) < table_size) {
+                --index_shift;
+            }
+            for (int table = 0; table < 2; ++table) {
+                slots[table].reset(new Slot[table_size]);
+            }
+        }
+
+        size_t index(int hash) const {
+            return static_cast<size_t>(hash) >> index_shift;
+        }
+
+        size_t table_size;
+        int index_shift;
+        std::unique_ptr<Slot[]> slots[2];
+    };
+
+    // The tables in use. While a resize is in progress, stripes that haven't been
+    // migrated yet are still in old_tables.
+    struct State {
+        State(Tables* old_tables, Tables* tables, size_t max_number_elements)
+            : old_tables(old_tables),
+            tables(tables),
+            max_number_elements(max_number_elements),
+            migrated(new std::atomic<bool>[num_stripes]) {
+            for (size_t stripe = 0; stripe < num_stripes; ++stripe) {
+                migrated[stripe].store(old_tables == nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        // Tables the stripe should be read from.
+        const Tables* tables_for(size_t stripe) const {
+            if (old_tables == nullptr || migrated[stripe].load(std::memory_order_acquire)) {
+                return tables;
+            }
+            return old_tables;
+        }
+
+        Tables* old_tables;
+        Tables* tables;
+        size_t max_number_elements;
+        std::unique_ptr<std::atomic<bool>[]> migrated;
+    };
+
+    // Holds the epoch announced by the operation using the slot, or no_epoch.
+    // Is padded to a cache line, so operations don't write the same one.
+    struct EpochSlot {
+        EpochSlot()
+            : epoch(no_epoch)
+        {}
+
+        std::atomic<uint64_t> epoch;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    static const uint64_t no_epoch = ~uint64_t(0);
+    // Each thread starts looking for a free slot at its own one, so there only
+    // needs to be enough for the threads running operations at once.
+    static const size_t num_epoch_slots = 64;
+
+    // Announces the calling thread as running an operation until destroyed, so
+    // nothing it can see is freed.
+    class epoch_guard {
+    public:
+        explicit epoch_guard(const concurrent_cuckoo_hashing* set);
+        ~epoch_guard();
+
+        epoch_guard(const epoch_guard&) = delete;
+        epoch_guard& operator=(const epoch_guard&) = delete;
+
+    private:
+        std::atomic<uint64_t>* slot;
+    };
+
+    // What a resize replaced, which is freed once the epoch reaches epoch + 2.
+    struct RetiredResize {
+        uint64_t epoch;
+        std::unique_ptr<State> old_state;
+        // Was used while migrating, and shares its tables with the current state.
+        std::unique_ptr<State> migrating_state;
+        std::unique_ptr<Tables> old_tables;
+    };
+
+    // Location of a slot in the tables, and the item it held when the path was found.
+    struct PathEntry {
+        int table;
+        int hash;
+        T item;
+    };
+
+    static size_t stripe_of(int hash) {
+        return static_cast<size_t>(hash) >> (hash_bits - stripe_bits);
+    }
+
+    // Makes the version of the stripe odd, waiting for any other writer first.
+    void lock_stripe(size_t stripe);
+    void unlock_stripe(size_t stripe);
+
+    // Locks in order of stripe, so two writers can never wait on each other.
+    // Then migrates both stripes, so their slots can be used from state->tables.
+    // Returns the state, which won't change for these stripes until unlocked.
+    State* lock_stripes(size_t first, size_t second);
+    void unlock_stripes(size_t first, size_t second);
+
+    // Moves the items of the stripe from old_tables into tables. Must hold the
+    // stripe's lock.
+    void migrate_stripe(State* state, size_t stripe);
+
+    // Finds the path of items to move so item can be placed in one of its slots,
+    // by searching the displacements from both slots at the same time.
+    // Doesn't hold any locks, so the path may no longer be valid when it is used.
+    // Returns false if there was no path of at most max_path_length.
+    bool find_path(const State* state, const int hashes[2], std::vector<PathEntry>* path) const;
+
+    // Moves the items along the path, starting from its end. Returns false if the
+    // tables changed since the path was found, which stops moving items.
+    bool move_along_path(const std::vector<PathEntry>& path);
+
+    // Inserts item, returning whether it resized the tables. Must hold an epoch_guard.
+    bool insert_item(const T& item);
+
+    // Doubles the tables, unless another thread already replaced expected_state.
+    void resize(State* expected_state);
+
+    // Advances the epoch as far as the running operations allow, then frees what
+    // was retired at least two epochs ago. Must hold resize_mutex.
+    void reclaim_retired_resizes();
+
+    // The oldest epoch announced by a running operation, or no_epoch.
+    uint64_t oldest_announced_epoch() const;
+
+    double eps;
+    Hash hashes[2];
+
+    std::atomic<size_t> num_elements;
+    size_t num_resize;
+
+    std::atomic<State*> current;
+    std::unique_ptr<std::atomic<uint64_t>[]> versions;
+
+    std::atomic<uint64_t> epoch;
+    std::unique_ptr<EpochSlot[]> epoch_slots;
+
+    // Held while resizing, which also protects the retired resizes.
+    std::mutex resize_mutex;
+    std::vector<RetiredResize> retired;
+};
+
+template <class T, class Hash>
+concurrent_cuckoo_hashing<T, Hash>::concurrent_cuckoo_hashing(
+        Hash first_table, Hash second_table, double eps)
+        : eps(eps),
+        hashes{std::move(first_table), std::move(second_table)},
+        num_elements(0),
+        num_resize(0),
+        current(nullptr),
+        versions(new std::atomic<uint64_t>[num_stripes]),
+        epoch(0),
+        epoch_slots(new EpochSlot[num_epoch_slots]) {
+    for (int table = 0; table < 2; ++table) {
+        hashes[table].reset_hash(1 << hash_bits);
+    }
+    for (size_t stripe = 0; stripe < num_stripes; ++stripe) {
+        versions[stripe].store(0, std::memory_order_relaxed);
+    }
+
+    // Every stripe needs at least one index.
+    Tables* tables = new Tables(num_stripes);
+    current.store(new State(nullptr, tables, num_stripes / (1 + eps)),
+        std::memory_order_relaxed);
+}
+
+template <class T, class Hash>
+concurrent_cuckoo_hashing<T, Hash>::~concurrent_cuckoo_hashing() {
+    State* state = current.load(std::memory_order_relaxed);
+    delete state->tables;
+    delete state;
+}
+
+template <class T, class Hash>
+concurrent_cuckoo_hashing<T, Hash>::epoch_guard::epoch_guard(
+        const concurrent_cuckoo_hashing* set) {
+    static thread_local const size_t first_slot =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) % num_epoch_slots;
+
+    // If the epoch advances before this is announced, the announced epoch is just
+    // older than needed, which only holds back the next advance.
+    const uint64_t current_epoch = set->epoch.load(std::memory_order_acquire);
+    for (size_t index = first_slot; ; index = (index + 1) % num_epoch_slots) {
+        slot = &set->epoch_slots[index].epoch;
+        uint64_t expected = no_epoch;
+        // Is a full barrier, so the announcement is visible before the operation
+        // loads the current state.
+        if (slot->load(std::memory_order_relaxed) == no_epoch &&
+                slot->compare_exchange_strong(expected, current_epoch, std::memory_order_seq_cst)) {
+            return;
+        }
+    }
+}
+
+template <class T, class Hash>
+concurrent_cuckoo_hashing<T, Hash>::epoch_guard::~epoch_guard() {
+    slot->store(no_epoch, std::memory_order_release);
+}
+
+template <class T, class Hash>
+void concurrent_cuckoo_hashing<T, Hash>::reclaim_retired_tables() {
+    std::lock_guard<std::mutex> lock(resize_mutex);
+    reclaim_retired_resizes();
+}
+
+template <class T, class Hash>
+void concurrent_cuckoo_hashing<T, Hash>::reclaim_retired_resizes() {
+    if (retired.empty()) {
+        return;
+    }
+
+    // Only resize_mutex's holder changes the epoch. It can't advance while an
+    // operation that started in an older epoch is still running.
+    uint64_t current_epoch = epoch.load(std::memory_order_relaxed);
+    for (int step = 0; step < 2 && oldest_announced_epoch() >= current_epoch; ++step) {
+        ++current_epoch;
+        epoch.store(current_epoch, std::memory_order_seq_cst);
+    }
+
+    // Every operation still running started in current_epoch - 1 or later, so
+    // after anything retired in current_epoch - 2 was replaced.
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+        [current_epoch](const RetiredResize& resize) {
+            return resize.epoch + 2 <= current_epoch;
+        }), retired.end());
+}
+
+template <class T, class Hash>
+uint64_t concurrent_cuckoo_hashing<T, Hash>::oldest_announced_epoch() const {
+    uint64_t oldest = no_epoch;
+    for (size_t index = 0; index < num_epoch_slots; ++index) {
+        oldest = std::min(oldest, epoch_slots[index].epoch.load(std::memory_order_seq_cst));
+    }
+    return oldest;
+}
+
+template <class T, class Hash>
+bool concurrent_cuckoo_hashing<T, Hash>::contains(const T& item) const {
+    epoch_guard guard(this);
+
+    int item_hashes[2] = {hashes[0].get_hash(item), hashes[1].get_hash(item)};
+    size_t stripes[2] = {stripe_of(item_hashes[0]), stripe_of(item_hashes[1])};
+
+    int num_tries = 0;
+    while (true) {
+        uint64_t first_before = versions[stripes[0]].load(std::memory_order_acquire);
+        uint64_t second_before = versions[stripes[1]].load(std::memory_order_acquire);
+
+        // A writer is changing one of the slots.
+        if ((first_before | second_before) & 1) {
+            // The writer may be waiting for this thread's core.
+            if (++num_tries % 64 == 0) {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        // Loaded after the versions, so is at least as new as the last change
+        // to the stripes.
+        const State* state = current.load(std::memory_order_acquire);
+
+        bool found = false;
+        for (int table = 0; table < 2; ++table) {
+            const Tables* tables = state->tables_for(stripes[table]);
+            const Slot& slot = tables->slots[table][tables->index(item_hashes[table])];
+            found |= slot.contains_item.load(std::memory_order_relaxed) &&
+                slot.item.load(std::memory_order_relaxed) == item;
+        }
+
+        // Ensures the slots are read before the versions are checked again.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (versions[stripes[0]].load(std::memory_order_relaxed) == first_before &&
+                versions[stripes[1]].load(std::memory_order_relaxed) == second_before) {
+            return found;
+        }
+    }
+}
+
+template <class T, class Hash>
+void concurrent_cuckoo_hashing<T, Hash>::lock_stripe(size_t stripe) {
+    std::atomic<uint64_t>& version = versions[stripe];
+    uint64_t expected = version.load(std::memory_order_relaxed);
+    while (true) {
+        if (!(expected & 1) && version.compare_exchange_weak(
+                expected, expected + 1, std::memory_order_acquire)) {
+            break;
+        }
+        std::this_thread::yield();
+        expected = version.load(std::memory_order_relaxed);
+    }
+    // Ensures the odd version is visible before any of the slots change.
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <class T, class Hash>
+void concurrent_cuckoo_hashing<T, Hash>::unlock_stripe(size_t stripe) {
+    versions[stripe].fetch_add(1, std::memory_order_release);
+}
+
+template <class T, class Hash>
+typename concurrent_cuckoo_hashing<T, Hash>::State*
+concurrent_cuckoo_hashing<T, Hash>::lock_stripes(size_t first, size_t second) {
+    if (first > second) {
+        std::swap(first, second);
+    }
+    lock_stripe(first);
+    if (second != first) {
+        lock_stripe(second);
+    }
+
+    // A resize can't start migrating while these are locked, but may have
+    // published a new state, so this must be loaded after locking.
+    State* state = current.load(std::memory_order_acquire);
+    migrate_stripe(state, first);
+    migrate_stripe(state, second);
+    return state;
+}
+
+template <class T, class Hash>
+void concurrent_cuckoo_hashing<T, Hash>::unlock_stripes(size_t first, size_t second) {
+    unlock_stripe(first);
+    if (second != first) {
+        unlock_stripe(second);
+    }
+}
+
+template <class T, class Hash>
+void concurrent_cuckoo_hashing<T, Hash>::migrate_stripe(State* state, size_t stripe) {
+    if (state->migrated[stripe].load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    const Tables* old_tables = state->old_tables;
+    Tables* tables = state->tables;
+    const size_t stripe_size = old_tables->table_size / num_stripes;
+    for (int table = 0; table < 2; ++table) {
+        for (size_t index = stripe * stripe_size; index < (stripe + 1) * stripe_size; ++index) {
+            const Slot& old_slot = old_tables->slots[table][index];
+            if (!old_slot.contains_item.load(std::memory_order_relaxed)) {
+                continue;
+            }
+
+            // Is either 2 * index or 2 * index + 1, so can't already be used.
+            T item = old_slot.item.load(std::memory_order_relaxed);
+            Slot& slot = tables->slots[table][tables->index(hashes[table].get_hash(item))];
+            slot.item.store(item, std::memory_order_relaxed);
+            slot.contains_item.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    // The old slots are left as is, since readers of an older state may still
+    // use them. Those readers will retry, since the stripe is locked.
+    state->migrated[stripe].store(true, std::memory_order_release);
+}
+
+template <class T, class Hash>
+void concurrent_cuckoo_hashing<T, Hash>::insert(const T& item) {
+    bool resized;
+    {
+        epoch_guard guard(this);
+        resized = insert_item(item);
+    }
+
+    // Without its own guard, this thread doesn't stop the epoch advancing.
+    if (resized) {
+        reclaim_retired_tables();
+    }
+}
+
+template <class T, class Hash>
+bool concurrent_cuckoo_hashing<T, Hash>::insert_item(const T& item) {
+    bool resized = false;
+    int item_hashes[2] = {hashes[0].get_hash(item), hashes[1].get_hash(item)};
+    size_t stripes[2] = {stripe_of(item_hashes[0]), stripe_of(item_hashes[1])};
+
+    std::vector<PathEntry> path;
+    while (true) {
+        State* state = lock_stripes(stripes[0], stripes[1]);
+        Tables* tables = state->tables;
+        Slot* slots[2] = {
+            &tables->slots[0][tables->index(item_hashes[0])],
+            &tables->slots[1][tables->index(item_hashes[1])]};
+
+        bool found = false;
+        for (int table = 0; table < 2; ++table) {
+            found |= slots[table]->contains_item.load(std::memory_order_relaxed) &&
+                slots[table]->item.load(std::memory_order_relaxed) == item;
+        }
+        if (found) {
+            unlock_stripes(stripes[0], stripes[1]);
+            return resized;
+        }
+
+        if (size() >= state->max_number_elements) {
+            unlock_stripes(stripes[0], stripes[1]);
+            resize(state);
+            resized = true;
+            continue;
+        }
+
+        for (int table = 0; table < 2; ++table) {
+            if (!slots[table]->contains_item.load(std::memory_order_relaxed)) {
+                slots[table]->item.store(item, std::memory_order_relaxed);
+                slots[table]->contains_item.store(true, std::memory_order_relaxed);
+                num_elements.fetch_add(1, std::memory_order_relaxed);
+                unlock_stripes(stripes[0], stripes[1]);
+                return resized;
+            }
+        }
+        unlock_stripes(stripes[0], stripes[1]);
+
+        // Both slots are full. Once the items along the path are moved the first
+        // slot of the path will be empty, unless another thread fills it first,
+        // in which case this will try again.
+        if (!find_path(state, item_hashes, &path)) {
+            resize(state);
+            resized = true;
+            continue;
+        }
+        move_along_path(path);
+    }
+}
+
+template <class T, class Hash>
+bool concurrent_cuckoo_hashing<T, Hash>::find_path(
+        const State* state, const int item_hashes[2], std::vector<PathEntry>* path) const {
+    const Tables* tables = state->tables;
+
+    // Each slot only has one other slot its item can move to, so the search from
+    // each of the item's slots is a single chain. Extending both chains one step
+    // at a time finds the shorter path.
+    std::vector<PathEntry> chains[2];
+    bool chain_ended[2] = {false, false};
+    for (int chain = 0; chain < 2; ++chain) {
+        chains[chain].push_back(PathEntry{chain, item_hashes[chain], T()});
+    }
+
+    while (!chain_ended[0] || !chain_ended[1]) {
+        for (int chain = 0; chain < 2; ++chain) {
+            if (chain_ended[chain]) {
+                continue;
+            }
+
+            PathEntry& last = chains[chain].back();
+            const Slot& slot = tables->slots[last.table][tables->index(last.hash)];
+            if (!slot.contains_item.load(std::memory_order_relaxed)) {
+                // Reached an empty slot. The last entry is where an item is moved to,
+                // so its item is never used.
+                *path = chains[chain];
+                return true;
+            }
+            last.item = slot.item.load(std::memory_order_relaxed);
+
+            int next_table = 1 - last.table;
+            PathEntry next{next_table, hashes[next_table].get_hash(last.item), T()};
+
+            // Would move the items in a cycle, which can't make space.
+            bool is_cycle = false;
+            for (const PathEntry& previous : chains[chain]) {
+                is_cycle |= previous.table == next.table && previous.hash == next.hash;
+            }
+
+            if (is_cycle || static_cast<int>(chains[chain].size()) >= max_path_length) {
+                chain_ended[chain] = true;
+            } else {
+                chains[chain].push_back(next);
+            }
+        }
+    }
+    return false;
+}
+
+template <class T, class Hash>
+bool concurrent_cuckoo_hashing<T, Hash>::move_along_path(const std::vector<PathEntry>& path) {
+    for (size_t i = path.size() - 1; i > 0; --i) {
+        const PathEntry& from = path[i - 1];
+        const PathEntry& to = path[i];
+        size_t from_stripe = stripe_of(from.hash);
+        size_t to_stripe = stripe_of(to.hash);
+
+        Tables* tables = lock_stripes(from_stripe, to_stripe)->tables;
+        Slot& from_slot = tables->slots[from.table][tables->index(from.hash)];
+        Slot& to_slot = tables->slots[to.table][tables->index(to.hash)];
+
+        // Some other thread changed the slots (or resized) since the path was found.
+        // The moves that were already done are still valid, so are left.
+        bool is_valid = from_slot.contains_item.load(std::memory_order_relaxed) &&
+            from_slot.item.load(std::memory_order_relaxed) == from.item &&
+            !to_slot.contains_item.load(std::memory_order_relaxed);
+
+        if (is_valid) {
+            to_slot.item.store(from.item, std::memory_order_relaxed);
+            to_slot.contains_item.store(true, std::memory_order_relaxed);
+            from_slot.contains_item.store(false, std::memory_order_relaxed);
+        }
+
+        unlock_stripes(from_stripe, to_stripe);
+        if (!is_valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class T, class Hash>
+void concurrent_cuckoo_hashing<T, Hash>::remove(const T& item) {
+    epoch_guard guard(this);
+
+    int item_hashes[2] = {hashes[0].get_hash(item), hashes[1].get_hash(item)};
+    size_t stripes[2] = {stripe_of(item_hashes[0]), stripe_of(item_hashes[1])};
+
+    Tables* tables = lock_stripes(stripes[0], stripes[1])->tables;
+    for (int table = 0; table < 2; ++table) {
+        Slot& slot = tables->slots[table][tables->index(item_hashes[table])];
+        if (slot.contains_item.load(std::memory_order_relaxed) &&
+                slot.item.load(std::memory_order_relaxed) == item) {
+            slot.contains_item.store(false, std::memory_order_relaxed);
+            num_elements.fetch_sub(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    unlock_stripes(stripes[0], stripes[1]);
+}
+
+template <class T, class Hash>
+void concurrent_cuckoo_hashing<T, Hash>::resize(State* expected_state) {
+    std::lock_guard<std::mutex> lock(resize_mutex);
+    State* old_state = current.load(std::memory_order_acquire);
+    if (old_state != expected_state) {
+        return;
+    }
+    ++num_resize;
+
+    // The previous resize finished migrating before publishing old_state.
+    Tables* old_tables = old_state->tables;
+    size_t table_size = 2 * old_tables->table_size;
+    State* state = new State(old_tables, new Tables(table_size), table_size / (1 + eps));
+    current.store(state, std::memory_order_release);
+
+    // Writers will migrate any stripe they use first, so this doesn't stop them.
+    for (size_t stripe = 0; stripe < num_stripes; ++stripe) {
+        lock_stripe(stripe);
+        migrate_stripe(state, stripe);
+        unlock_stripe(stripe);
+    }
+
+    // Readers no longer need to check which stripes were migrated.
+    current.store(new State(nullptr, state->tables, state->max_number_elements),
+        std::memory_order_release);
+
+    // Operations which started before the new state was published may still
+    // use these, and announced this epoch or an older one.
+    RetiredResize retired_resize;
+    retired_resize.epoch = epoch.load(std::memory_order_seq_cst);
+    retired_resize.old_state.reset(old_state);
+    retired_resize.migrating_state.reset(state);
+    retired_resize.old_tables.reset(old_tables);
+    retired.push_back(std::move(retired_resize));
+}
+
+#endif  // HASH_CONCURRENT_CUCKOO_H
@@ -0,0 +1,475 @@
+#include "concurrent_cuckoo.h"
+
+#include <atomic>
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using milliseconds = std::chrono::milliseconds;
+using Time = std::chrono::system_clock;
+using std::to_string;
+
+const int NumElementsInserted =        1000000;
+const int EveryIndexRemovedAfterInsert =    10;
+// Every reader does this many lookups in the benchmark, half of them misses.
+const int NumLookupsPerReader =        1000000;
+
+using multiply_shift = multiply_shift_hashing_function<int>;
+
+// Done differently than other Data Structures since want to get access to the data in the class
+class concurrent_cuckoo_tests : public concurrent_cuckoo_hashing<int, multiply_shift> {
+public:
+    using base = concurrent_cuckoo_hashing<int, multiply_shift>;
+    using base::epoch_guard;
+
+    // The rngs aren't randomly seeded, so the tests are repeatable.
+    concurrent_cuckoo_tests()
+        : base(multiply_shift{std::mt19937_64{}, false},
+            multiply_shift{std::mt19937_64{1}, false}) {
+    }
+
+    size_t get_num_resize() const {
+        return num_resize;
+    }
+
+    // Only valid while no other thread is resizing.
+    size_t get_num_retired() const {
+        return retired.size();
+    }
+
+    int get_number_inserts_required_to_increase_tablesize() const {
+        return current.load()->max_number_elements - size() + 1;
+    }
+
+    void assert_is_valid() const {
+        const State& state = *current.load();
+        const Tables& tables = *state.tables;
+        size_t number_elements = 0;
+        for (int table_num = 0; table_num < 2; ++table_num) {
+            for (size_t i = 0; i < tables.table_size; ++i) {
+                const Slot& slot = tables.slots[table_num][i];
+                if (!slot.contains_item) {
+                    continue;
+                }
+
+                ++number_elements;
+
+                int item_stored = slot.item;
+                size_t hash_using_tables_hash = tables.index(hashes[table_num].get_hash(item_stored));
+                if (i != hash_using_tables_hash)
+                    throw "Invalid index to store value " + to_string(item_stored) + ": " +
+                       " at index " + to_string(i) + " but hashes to " +
+                       to_string(hash_using_tables_hash) + " in table " + to_string(table_num);
+            }
+        }
+
+        for (size_t stripe = 0; stripe < num_stripes; ++stripe) {
+            if (versions[stripe] % 2 != 0)
+                throw "Stripe " + to_string(stripe) + " was left locked";
+            if (!state.migrated[stripe])
+                throw "Stripe " + to_string(stripe) + " was never migrated";
+        }
+
+        if (size() != number_elements)
+            throw "The size wasn't updated properly: is " +
+                to_string(number_elements) + " while reports " + to_string(size());
+
+        if (number_elements > state.max_number_elements)
+            throw "Table should have been resized, number elements is " + to_string(number_elements) +
+                " vs max of " + to_string(state.max_number_elements);
+    }
+};
+
+void CheckContainsElement(const concurrent_cuckoo_tests& cuckoo, int val) {
+    if (!cuckoo.contains(val))
+        throw "Expected cuckoo to contain " + to_string(val);
+}
+
+void CheckDoesntContainElement(const concurrent_cuckoo_tests& cuckoo, int val) {
+    if (cuckoo.contains(val))
+        throw "Expected cuckoo to not contain " + to_string(val);
+}
+
+void CheckNumberElements(const concurrent_cuckoo_tests& cuckoo, size_t expected_size) {
+    if (cuckoo.size() != expected_size)
+        throw "Cuckoo size is wrong: expected " + to_string(expected_size) + " got " + to_string(cuckoo.size());
+}
+
+void CheckNumberResize(const concurrent_cuckoo_tests& cuckoo, size_t expected_count) {
+    if (cuckoo.get_num_resize() != expected_count)
+        throw "Unexpected number of resize, expected " + to_string(expected_count) +
+            " got " + to_string(cuckoo.get_num_resize());
+}
+
+void SimpleInsertion() {
+    concurrent_cuckoo_tests cuckoo;
+
+    cuckoo.insert(5);
+    cuckoo.insert(6);
+    cuckoo.insert(7);
+    cuckoo.insert(7);
+
+    try {
+        CheckContainsElement(cuckoo, 5);
+        CheckContainsElement(cuckoo, 6);
+        CheckContainsElement(cuckoo, 7);
+
+        CheckDoesntContainElement(cuckoo, 4);
+        CheckDoesntContainElement(cuckoo, 9);
+
+        CheckNumberElements(cuckoo, 3);
+
+        // The initial tables were large enough.
+        CheckNumberResize(cuckoo, 0);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in SimpleInsertion: " << s << '\n';
+        throw s;
+    }
+}
+
+// The tables only grow, so removing items never resizes.
+void RemoveItemsWhenHadManyBefore() {
+    concurrent_cuckoo_tests cuckoo;
+
+    int to_insert = cuckoo.get_number_inserts_required_to_increase_tablesize();
+
+    // Insert enough items to force it to resize.
+    for (int i = 0; i < to_insert; ++i) {
+        cuckoo.insert(i);
+    }
+
+    int to_remove = to_insert / 2;
+    for (int i = 0; i < to_remove; ++i) {
+        cuckoo.remove(i);
+    }
+
+    try {
+        for (int i = 0; i < to_remove; ++i) {
+            CheckDoesntContainElement(cuckoo, i);
+        }
+        for (int i = to_remove; i < to_insert; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+
+        CheckNumberElements(cuckoo, to_insert - to_remove);
+
+        // Only the one increase.
+        CheckNumberResize(cuckoo, 1);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in RemoveItemsWhenHadManyBefore: " << s << '\n';
+        throw s;
+    }
+}
+
+void CheckNumberRetired(const concurrent_cuckoo_tests& cuckoo, size_t expected_count) {
+    if (cuckoo.get_num_retired() != expected_count)
+        throw "Unexpected number of retired resizes, expected " + to_string(expected_count) +
+            " got " + to_string(cuckoo.get_num_retired());
+}
+
+// Replaced tables are freed once no operation that started before the resize
+// is still running.
+void FreesRetiredTables() {
+    concurrent_cuckoo_tests cuckoo;
+
+    try {
+        // Nothing else is running, so the insert that resizes frees the old tables.
+        int to_insert = cuckoo.get_number_inserts_required_to_increase_tablesize();
+        for (int i = 0; i < to_insert; ++i) {
+            cuckoo.insert(i);
+        }
+        CheckNumberResize(cuckoo, 1);
+        CheckNumberRetired(cuckoo, 0);
+
+        {
+            // Stands in for another thread's lookup, which started before the resize.
+            concurrent_cuckoo_tests::epoch_guard guard(&cuckoo);
+
+            int next = static_cast<int>(cuckoo.size());
+            to_insert = cuckoo.get_number_inserts_required_to_increase_tablesize();
+            for (int i = next; i < next + to_insert; ++i) {
+                cuckoo.insert(i);
+            }
+            CheckNumberResize(cuckoo, 2);
+            CheckNumberRetired(cuckoo, 1);
+
+            // Still can't be freed.
+            cuckoo.reclaim_retired_tables();
+            CheckNumberRetired(cuckoo, 1);
+        }
+
+        cuckoo.reclaim_retired_tables();
+        CheckNumberRetired(cuckoo, 0);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in FreesRetiredTables: " << s << '\n';
+        throw s;
+    }
+}
+
+void LargeTest() {
+    concurrent_cuckoo_tests cuckoo;
+
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        cuckoo.insert(i);
+        if (i % EveryIndexRemovedAfterInsert == 0)
+            cuckoo.remove(i);
+    }
+
+    try {
+        for (int i = 0; i < NumElementsInserted; ++i) {
+            if (i % EveryIndexRemovedAfterInsert == 0)
+                CheckDoesntContainElement(cuckoo, i);
+            else
+                CheckContainsElement(cuckoo, i);
+        }
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in LargeTest: " << s << '\n';
+        throw s;
+    }
+}
+
+// While one thread inserts items in order, the readers check that every item
+// the writer has finished inserting can always be found, even while it is being
+// displaced or the tables are being resized.
+void ReadersNeverMissInsertedItems() {
+    concurrent_cuckoo_tests cuckoo;
+    std::atomic<int> num_inserted(0);
+    std::atomic<bool> missed_item(false);
+    std::atomic<int> missing_item(0);
+
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 4; ++reader) {
+        readers.emplace_back([&cuckoo, &num_inserted, &missed_item, &missing_item, reader]() {
+            std::mt19937 rng(reader);
+            int inserted = 0;
+            while (inserted < NumElementsInserted / 10 && !missed_item) {
+                inserted = num_inserted.load(std::memory_order_acquire);
+                if (inserted == 0) {
+                    continue;
+                }
+                int item = rng() % inserted;
+                if (!cuckoo.contains(item)) {
+                    missing_item = item;
+                    missed_item = true;
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < NumElementsInserted / 10; ++i) {
+        cuckoo.insert(i);
+        num_inserted.store(i + 1, std::memory_order_release);
+    }
+
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    try {
+        if (missed_item)
+            throw "A reader couldn't find " + to_string(missing_item) + " while items were inserted";
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in ReadersNeverMissInsertedItems: " << s << '\n';
+        throw s;
+    }
+}
+
+// Each writer inserts its own range of items, removing some, while the others
+// are doing the same. Displacement paths will cross between the ranges, and
+// the tables will be resized while every writer is using them.
+void ConcurrentWriters() {
+    const int num_writers = 4;
+    const int items_per_writer = NumElementsInserted / 10;
+    concurrent_cuckoo_tests cuckoo;
+
+    std::vector<std::thread> writers;
+    for (int writer = 0; writer < num_writers; ++writer) {
+        writers.emplace_back([&cuckoo, writer, items_per_writer]() {
+            for (int i = writer * items_per_writer; i < (writer + 1) * items_per_writer; ++i) {
+                cuckoo.insert(i);
+                if (i % EveryIndexRemovedAfterInsert == 0)
+                    cuckoo.remove(i);
+            }
+        });
+    }
+
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+
+    try {
+        for (int i = 0; i < num_writers * items_per_writer; ++i) {
+            if (i % EveryIndexRemovedAfterInsert == 0)
+                CheckDoesntContainElement(cuckoo, i);
+            else
+                CheckContainsElement(cuckoo, i);
+        }
+
+        CheckNumberElements(cuckoo, num_writers * items_per_writer -
+            num_writers * items_per_writer / EveryIndexRemovedAfterInsert);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in ConcurrentWriters: " << s << '\n';
+        throw s;
+    }
+}
+
+
+milliseconds GetCurrentTime() {
+    return std::chrono::duration_cast<milliseconds >(
+            Time::now().time_since_epoch());
+}
+
+// Protects every operation of cuckoo_hashing with a single mutex, which is the
+// simplest way to share it between threads.
+class locked_cuckoo_hashing {
+public:
+    locked_cuckoo_hashing()
+        : cuckoo(multiply_shift{std::mt19937_64{}, false},
+            multiply_shift{std::mt19937_64{1}, false}) {
+    }
+
+    bool contains(int item) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return cuckoo.contains(item);
+    }
+
+    void insert(int item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cuckoo.insert(item);
+    }
+
+private:
+    cuckoo_hashing<int, multiply_shift> cuckoo;
+    mutable std::mutex mutex;
+};
+
+// Starts with NumElementsInserted items, then num_readers threads each do
+// NumLookupsPerReader lookups while one writer inserts more items.
+template <class Set>
+milliseconds RunReaderBenchmark(int num_readers) {
+    Set set;
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        set.insert(i);
+    }
+
+    std::atomic<size_t> num_found(0);
+    std::atomic<bool> readers_done(false);
+
+    milliseconds start_time = GetCurrentTime();
+
+    std::thread writer([&set, &readers_done]() {
+        for (int i = NumElementsInserted;
+                i < 2 * NumElementsInserted && !readers_done; ++i) {
+            set.insert(i);
+        }
+    });
+
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < num_readers; ++reader) {
+        readers.emplace_back([&set, &num_found, reader]() {
+            size_t found = 0;
+            // Readers start at different items, so they don't share cache lines.
+            int first = reader * (NumElementsInserted / 16);
+            for (int i = 0; i < NumLookupsPerReader; ++i) {
+                int item = (first + i) % NumElementsInserted;
+                found += set.contains(item);
+                found += set.contains(-item - 1);
+            }
+            num_found += found;
+        });
+    }
+
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    milliseconds lookup_time = GetCurrentTime() - start_time;
+
+    readers_done = true;
+    writer.join();
+
+    if (num_found != static_cast<size_t>(NumLookupsPerReader) * num_readers)
+        throw "Found " + to_string(num_found) + " items during lookups, expected " +
+            to_string(static_cast<size_t>(NumLookupsPerReader) * num_readers);
+
+    return lookup_time;
+}
+
+void RunReaderBenchmarks() {
+    std::cout << "Time for " << 2 * NumLookupsPerReader <<
+        " lookups per reader, with one concurrent writer:\n";
+    for (int num_readers : {1, 2, 4, 8, 16}) {
+        milliseconds concurrent_time =
+            RunReaderBenchmark<concurrent_cuckoo_tests>(num_readers);
+        milliseconds locked_time =
+            RunReaderBenchmark<locked_cuckoo_hashing>(num_readers);
+
+        std::cout << "  " << num_readers << " readers: concurrent cuckoo " <<
+            concurrent_time.count() << " ms, locked cuckoo " <<
+            locked_time.count() << " ms\n";
+    }
+}
+
+// num_writers threads together insert NumElementsInserted items into an empty
+// set, so the time includes every resize.
+template <class Set>
+milliseconds RunWriterBenchmark(int num_writers) {
+    Set set;
+    milliseconds start_time = GetCurrentTime();
+
+    std::vector<std::thread> writers;
+    for (int writer = 0; writer < num_writers; ++writer) {
+        writers.emplace_back([&set, writer, num_writers]() {
+            for (int i = writer; i < NumElementsInserted; i += num_writers) {
+                set.insert(i);
+            }
+        });
+    }
+
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+    return GetCurrentTime() - start_time;
+}
+
+void RunWriterBenchmarks() {
+    std::cout << "Time to insert " << NumElementsInserted << " items from multiple writers:\n";
+    for (int num_writers : {1, 2, 4, 8}) {
+        milliseconds concurrent_time =
+            RunWriterBenchmark<concurrent_cuckoo_tests>(num_writers);
+        milliseconds locked_time =
+            RunWriterBenchmark<locked_cuckoo_hashing>(num_writers);
+
+        std::cout << "  " << num_writers << " writers: concurrent cuckoo " <<
+            concurrent_time.count() << " ms, locked cuckoo " <<
+            locked_time.count() << " ms\n";
+    }
+}
+
+
+int main() {
+    SimpleInsertion();
+    RemoveItemsWhenHadManyBefore();
+    FreesRetiredTables();
+    LargeTest();
+    ReadersNeverMissInsertedItems();
+    ConcurrentWriters();
+
+    RunReaderBenchmarks();
+    RunWriterBenchmarks();
+}
@@ -6,9 +6,21 @@
 #include <chrono>
 #include <thread>
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 template <class T>
 class hashing_function {
@@ -26,6 +38,13 @@ public:
 template <class T>
 class basic_hashing_function : public hashing_function<T> {
 public:
+    // Everything get_hash uses, so a saved hash can be restored.
+    struct parameters {
+        long long a;
+        long long b;
+        int p;
+    };
+
     basic_hashing_function(std::mt19937 _rng, bool should_seed_rng)
         : rng(_rng) {
         if (should_seed_rng) {
@@ -34,14 +53,30 @@ public:
         }
     }
 
-    void reset_hash(int _p) override {
+    explicit basic_hashing_function(const parameters& params)
+        : a(params.a),
+        b(params.b),
+        p(params.p) {
+    }
+
+    // The padding is zeroed, so saved files only depend on the hash.
+    parameters get_parameters() const {
+        parameters params;
+        std::memset(&params, 0, sizeof(params));
+        params.a = a;
+        params.b = b;
+        params.p = p;
+        return params;
+    }
+
+    void reset_hash(int _p) final {
         std::uniform_int_distribution<int> dist{0, _p};
         p = _p;
         a = dist(rng);
         b = dist(rng);
     }
 
-    int get_hash(const T& t) const override {
+    int get_hash(const T& t) const final {
         return (a * t + b) % p;
     }
 
@@ -51,9 +86,493 @@ public:
     int p;
 };
 
-// Using eps of 0.4 seems to work quite well.
+namespace cuckoo_internal {
+
+// Polynomial hash of the bytes, evaluated at base modulo the Mersenne prime
+// 2^61 - 1. Two different sequences collide with probability ~length / 2^61 over
+// the choice of base.
+inline uint64_t hash_bytes(const void* data, size_t length, uint64_t base) {
+    const uint64_t prime = (1ULL << 61) - 1;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    // Modulo a Mersenne prime only needs shifts and adds.
+    auto multiply_mod = [prime](uint64_t lhs, uint64_t rhs) {
+        unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+        uint64_t result = (static_cast<uint64_t>(product) & prime) +
+            static_cast<uint64_t>(product >> 61);
+        result = (result & prime) + (result >> 61);
+        return result >= prime ? result - prime : result;
+    };
+
+    // Including the length ensures trailing zeros can't be dropped.
+    uint64_t hash = length;
+    size_t index = 0;
+    for (; index + 4 <= length; index += 4) {
+        uint32_t word = bytes[index] | (bytes[index + 1] << 8) |
+            (bytes[index + 2] << 16) | (static_cast<uint32_t>(bytes[index + 3]) << 24);
+        hash = multiply_mod(hash, base) + word;
+    }
+    for (; index < length; ++index) {
+        hash = multiply_mod(hash, base) + bytes[index];
+    }
+    return multiply_mod(hash, base);
+}
+
+// Reduces an item to a 64 bit key, which the stronger hashing functions then hash.
+// Integers are used as is, while strings and vectors of integers are reduced
+// with hash_bytes.
+template <class T, class Enable = void>
+struct hash_key;
+
+template <class T>
+struct hash_key<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+    // Number of bytes in the reduced key that can be non-zero.
+    static const int num_bytes = sizeof(T);
+
+    static uint64_t reduce(const T& t, uint64_t base) {
+        return static_cast<uint64_t>(t);
+    }
+};
+
+template <>
+struct hash_key<std::string> {
+    static const int num_bytes = 8;
+
+    static uint64_t reduce(const std::string& s, uint64_t base) {
+        return hash_bytes(s.data(), s.size(), base);
+    }
+};
+
+template <class U>
+struct hash_key<std::vector<U>,
+        typename std::enable_if<std::is_integral<U>::value>::type> {
+    static const int num_bytes = 8;
+
+    static uint64_t reduce(const std::vector<U>& v, uint64_t base) {
+        return hash_bytes(v.data(), v.size() * sizeof(U), base);
+    }
+};
+
+// Maps a 32 bit hash into [0, p) with a multiply and shift instead of a modulo.
+inline int reduce_range(uint32_t hash, int p) {
+    return (static_cast<uint64_t>(hash) * p) >> 32;
+}
+
+}  // namespace cuckoo_internal
+
+// Vector multiply-shift hashing: the 64 bit key is split into two 32 bit halves,
+// and the hash is the top 32 bits of a1 * lo + a2 * hi + b (mod 2^64), which is
+// strongly universal. Doesn't need any modulo, so is far cheaper than
+// basic_hashing_function, and handles keys with common factors properly.
+// Supports integers, std::string, and std::vector of integers.
+template <class T>
+class multiply_shift_hashing_function : public hashing_function<T> {
+public:
+    struct parameters {
+        uint64_t low_multiplier;
+        uint64_t high_multiplier;
+        uint64_t addend;
+        uint64_t base;
+        int p;
+    };
+
+    multiply_shift_hashing_function(std::mt19937_64 _rng, bool should_seed_rng)
+        : rng(_rng),
+        low_multiplier(0),
+        high_multiplier(0),
+        addend(0),
+        base(1),
+        p(1) {
+        if (should_seed_rng) {
+            rng.seed(std::random_device{}());
+        }
+    }
+
+    explicit multiply_shift_hashing_function(const parameters& params)
+        : low_multiplier(params.low_multiplier),
+        high_multiplier(params.high_multiplier),
+        addend(params.addend),
+        base(params.base),
+        p(params.p) {
+    }
+
+    parameters get_parameters() const {
+        parameters params;
+        std::memset(&params, 0, sizeof(params));
+        params.low_multiplier = low_multiplier;
+        params.high_multiplier = high_multiplier;
+        params.addend = addend;
+        params.base = base;
+        params.p = p;
+        return params;
+    }
+
+    void reset_hash(int _p) final {
+        p = _p;
+        low_multiplier = rng();
+        high_multiplier = rng();
+        addend = rng();
+        // Must be in [1, 2^61 - 1) to be a valid base for hash_bytes.
+        base = 1 + rng() % ((1ULL << 61) - 2);
+    }
+
+    int get_hash(const T& t) const final {
+        uint64_t key = cuckoo_internal::hash_key<T>::reduce(t, base);
+        uint32_t hash = (low_multiplier * (key & 0xFFFFFFFF) +
+            high_multiplier * (key >> 32) + addend) >> 32;
+        return cuckoo_internal::reduce_range(hash, p);
+    }
+
+    std::mt19937_64 rng;
+    uint64_t low_multiplier;
+    uint64_t high_multiplier;
+    uint64_t addend;
+    uint64_t base;
+    int p;
+};
+
+// Simple tabulation hashing: each byte of the 64 bit key indexes into its own
+// table of random values, and the hash is all of those values xor'd together.
+// Is 3-independent, and known to work well with cuckoo hashing, but uses
+// 1 KB per byte of the key, so is best for small keys.
+// Supports the same types as multiply_shift_hashing_function.
+template <class T>
+class tabulation_hashing_function : public hashing_function<T> {
+public:
+    static const int num_bytes = cuckoo_internal::hash_key<T>::num_bytes;
+
+    struct parameters {
+        uint32_t tables[num_bytes][256];
+        uint64_t base;
+        int p;
+    };
+
+    tabulation_hashing_function(std::mt19937_64 _rng, bool should_seed_rng)
+        : rng(_rng),
+        tables(),
+        base(1),
+        p(1) {
+        if (should_seed_rng) {
+            rng.seed(std::random_device{}());
+        }
+    }
+
+    explicit tabulation_hashing_function(const parameters& params)
+        : base(params.base),
+        p(params.p) {
+        std::copy(&params.tables[0][0], &params.tables[0][0] + num_bytes * 256, &tables[0][0]);
+    }
+
+    parameters get_parameters() const {
+        parameters params;
+        std::memset(&params, 0, sizeof(params));
+        std::copy(&tables[0][0], &tables[0][0] + num_bytes * 256, &params.tables[0][0]);
+        params.base = base;
+        params.p = p;
+        return params;
+    }
+
+    void reset_hash(int _p) final {
+        p = _p;
+        for (int byte = 0; byte < num_bytes; ++byte) {
+            for (int value = 0; value < 256; ++value) {
+                tables[byte][value] = rng();
+            }
+        }
+        base = 1 + rng() % ((1ULL << 61) - 2);
+    }
+
+    int get_hash(const T& t) const final {
+        uint64_t key = cuckoo_internal::hash_key<T>::reduce(t, base);
+        uint32_t hash = 0;
+        for (int byte = 0; byte < num_bytes; ++byte) {
+            hash ^= tables[byte][(key >> (8 * byte)) & 0xFF];
+        }
+        return cuckoo_internal::reduce_range(hash, p);
+    }
+
+    std::mt19937_64 rng;
+    uint32_t tables[num_bytes][256];
+    uint64_t base;
+    int p;
+};
+
+// Allows any hashing_function to be used as the Hash of cuckoo_hashing, at the cost
+// of every hash being a virtual call.
+// A hashing_function subclass can be used directly as Hash instead, which
+// will let the compiler inline get_hash.
+template <class T>
+class virtual_hashing_function {
+public:
+    virtual_hashing_function(std::unique_ptr<hashing_function<T>> hash)
+        : hash(std::move(hash)) {
+    }
+
+    void reset_hash(int p) {
+        hash->reset_hash(p);
+    }
+
+    int get_hash(const T& t) const {
+        return hash->get_hash(t);
+    }
+
+private:
+    std::unique_ptr<hashing_function<T>> hash;
+};
+
+// Lets cuckoo_hashing mark empty slots with a value of T, instead of storing a bool
+// next to every item, which for small T can double the size of each slot.
+// Specializations need:
+//   static const bool exists = true;
+//   static T value();
+// Integers use their maximum value. The value can still be inserted, since it is
+// stored outside of the tables.
+template <class T, class Enable = void>
+struct cuckoo_empty_item {
+    static const bool exists = false;
+};
+
+template <class T>
+struct cuckoo_empty_item<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+    static const bool exists = true;
+
+    static T value() { return std::numeric_limits<T>::max(); }
+};
+
+namespace cuckoo_internal {
+
+// Selects the item_or constructor which constructs its item in place.
+struct in_place_t {};
+
+// A slot of the tables, which either contains an item or is empty.
+template <class T, bool HasEmptyItem = cuckoo_empty_item<T>::exists>
+struct item_or {
+    item_or()
+        : contains(false)
+    {}
+
+    item_or(T item, bool contains_item)
+        : item(std::move(item)),
+        contains(contains_item)
+    {}
+
+    // Constructs the item from args, instead of moving it in.
+    template <class... Args>
+    item_or(in_place_t, Args&&... args)
+        : item(std::forward<Args>(args)...),
+        contains(true)
+    {}
+
+    bool contains_item() const { return contains; }
+
+    void remove_item() { contains = false; }
+
+    T item;
+    bool contains;
+};
+
+// Is exactly sizeof(T), since empty slots store cuckoo_empty_item<T>::value().
+template <class T>
+struct item_or<T, true> {
+    item_or()
+        : item(cuckoo_empty_item<T>::value())
+    {}
+
+    item_or(T item, bool contains_item)
+        : item(contains_item ? std::move(item) : cuckoo_empty_item<T>::value())
+    {}
+
+    template <class... Args>
+    item_or(in_place_t, Args&&... args)
+        : item(std::forward<Args>(args)...)
+    {}
+
+    bool contains_item() const { return item != cuckoo_empty_item<T>::value(); }
+
+    void remove_item() { item = cuckoo_empty_item<T>::value(); }
+
+    T item;
+};
+
+template <class T, class Key>
+bool is_empty_item(const Key& key, std::false_type) { return false; }
+
+template <class T, class Key>
+bool is_empty_item(const Key& key, std::true_type) {
+    return key == cuckoo_empty_item<T>::value();
+}
+
+// Whether key is cuckoo_empty_item<T>::value(), which item_or<T> uses for empty slots.
+template <class T, class Key>
+bool is_empty_item(const Key& key) {
+    return is_empty_item<T>(key, std::integral_constant<bool, cuckoo_empty_item<T>::exists>());
+}
+
+// Start of a file written by cuckoo_hashing::save, which mapped_cuckoo_hashing
+// can serve lookups from without reading it in. The rest of the file is, at the
+// given offsets:
+//   hashes  num_tables Hash::parameters, one for each table.
+//   tables  num_tables * table_size slots, table after table.
+//   stash   stash_size slots.
+// The slots are item_or<T>, stored as they are in memory, so the file can only
+// be read by a build with the same T, Hash, NumTables and architecture. The
+// sizes stored here catch most mismatches.
+struct snapshot_header {
+    static const uint32_t current_version = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t num_tables;
+    uint32_t slot_size;
+    uint32_t hash_parameters_size;
+    uint64_t table_size;
+    uint64_t num_elements;
+    uint64_t stash_size;
+    uint64_t contains_empty_item;
+
+    uint64_t hashes_offset;
+    uint64_t tables_offset;
+    uint64_t stash_offset;
+    uint64_t file_size;
+};
+
+const char snapshot_magic[8] = {'C', 'U', 'C', 'K', 'O', 'O', 'H', 'S'};
+
+// The tables start on a cache line, like they would in memory.
+inline uint64_t align_to_cache_line(uint64_t offset) {
+    return (offset + 63) / 64 * 64;
+}
+
+}  // namespace cuckoo_internal
+
+// Stats policies for cuckoo_hashing, which calls them on every insert, lookup,
+// rehash and resize. Both have the same functions, but cuckoo_no_stats does
+// nothing in any of them, so with it (the default) the calls compile away.
+class cuckoo_no_stats {
+public:
+    struct timer {};
+
+    timer start_timer() const { return {}; }
+
+    void record_insert(int num_displacements) {}
+    void record_failed_insert() {}
+    void record_lookup(int num_probes) {}
+    void record_rehash(timer start) {}
+    void record_resize(timer start) {}
+};
+
+// Records how the tables behave, to help choose eps for a set of keys:
+// - a histogram of the number of items each insert displaced,
+// - how many inserts didn't find a slot within max_loop displacements,
+// - the number of slots compared by each lookup, including the lookups done
+//   by insert and remove,
+// - the number of rehashes and resizes, and the time spent in them.
+// Lookups update the counters, so a set with cuckoo_stats can't be read from
+// several threads at once.
+class cuckoo_stats {
+public:
+    using clock = std::chrono::steady_clock;
+    using timer = clock::time_point;
+
+    // Bucket 0 counts inserts that displaced nothing, and bucket b > 0 inserts
+    // which displaced [2^(b-1), 2^b) items. The last bucket also counts longer chains.
+    static const int num_histogram_buckets = 16;
+
+    cuckoo_stats() { reset(); }
+
+    timer start_timer() const { return clock::now(); }
+
+    void record_insert(int num_displacements) {
+        int bucket = 0;
+        while (num_displacements > 0 && bucket < num_histogram_buckets - 1) {
+            num_displacements >>= 1;
+            ++bucket;
+        }
+        ++displacement_histogram[bucket];
+        ++num_inserts;
+    }
+
+    void record_failed_insert() { ++num_failed_inserts; }
+
+    void record_lookup(int num_probes) {
+        ++num_lookups;
+        num_probes_total += num_probes;
+    }
+
+    // A rehash that had to choose new hashing functions again is recorded once.
+    void record_rehash(timer start) {
+        ++num_rehash;
+        rehash_time += clock::now() - start;
+    }
+
+    // Includes the rehash that every resize does.
+    void record_resize(timer start) {
+        ++num_resize;
+        resize_time += clock::now() - start;
+    }
+
+    void reset();
+
+    double average_probes_per_lookup() const {
+        return num_lookups == 0 ? 0 : static_cast<double>(num_probes_total) / num_lookups;
+    }
+
+    void print_out() const;
+
+    size_t displacement_histogram[num_histogram_buckets];
+    size_t num_inserts;
+    size_t num_failed_inserts;
+
+    size_t num_lookups;
+    size_t num_probes_total;
+
+    size_t num_rehash;
+    clock::duration rehash_time;
+    size_t num_resize;
+    clock::duration resize_time;
+};
+
+inline void cuckoo_stats::reset() {
+    std::fill(displacement_histogram, displacement_histogram + num_histogram_buckets, 0);
+    num_inserts = 0;
+    num_failed_inserts = 0;
+    num_lookups = 0;
+    num_probes_total = 0;
+    num_rehash = 0;
+    rehash_time = clock::duration::zero();
+    num_resize = 0;
+    resize_time = clock::duration::zero();
+}
+
+inline void cuckoo_stats::print_out() const {
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+
+    std::cout << num_inserts << " inserts, " << num_failed_inserts << " failed to find a slot\n";
+    std::cout << "Displacements per insert:\n";
+    for (int bucket = 0; bucket < num_histogram_buckets; ++bucket) {
+        if (displacement_histogram[bucket] == 0) {
+            continue;
+        }
+        if (bucket <= 1) {
+            std::cout << "  " << bucket << ": ";
+        } else {
+            std::cout << "  " << (1 << (bucket - 1)) << '-' << (1 << bucket) - 1 << ": ";
+        }
+        std::cout << displacement_histogram[bucket] << '\n';
+    }
+    std::cout << num_lookups << " lookups, " << average_probes_per_lookup() <<
+        " probes per lookup\n";
+    std::cout << num_rehash << " rehashes taking " <<
+        duration_cast<milliseconds>(rehash_time).count() << " ms, " << num_resize <<
+        " resizes taking " << duration_cast<milliseconds>(resize_time).count() << " ms\n";
+}
+
+// Using eps of 0.4 seems to work quite well. set_eps_bounds lets it adapt instead,
+// from how many items the inserts displace and how often they need a rehash.
 // Note that the variance on time taken is quite large, probably due to the hash function
-// not being optimal.
+// not being optimal. multiply_shift_hashing_function or tabulation_hashing_function
+// should be preferred over basic_hashing_function.
 
 // What is interesting is that, when the hash functions were the exact same (not seeded properly),
 // the time for the large test was ~343 milliseconds.
@@ -65,60 +584,246 @@ public:
 //  76           7            50           33
 //  164          17           109          39
 
+// Items that couldn't be placed within max_loop moves are kept in a stash of at
+// most stash_size items, which every lookup also checks. A rehash is only needed
+// once the stash is full, and each rehash will try to move the stashed items
+// back into the tables. A stash of 0 gives plain cuckoo hashing.
+
+// With NumTables = d > 2, every item has d possible slots, one per table, and an
+// insert whose slots are all full will evict the item in a random one of them,
+// which then tries its own other slots (random walk). Each extra table costs a
+// probe per lookup, but allows far fuller tables: 2 tables must stay under 50% of
+// their slots used, 3 tables under ~91%, and 4 tables under ~97%. The tables are
+// sized so they are at most max_load_factor() / (1 + eps) full, with
+// max_load_factor() of 0.5, 0.9 and 0.95.
+// With 2 tables, items ping-pong between the tables as in the paper.
+
+// Items are only ever moved once they are in the set: displacements swap slots,
+// and rehashes and the stash move items out of their slots, so T only needs to be
+// copyable for insert(const T&). insert(T&&) and emplace never copy the item, so
+// e.g. a std::string key is allocated once, and never reallocated by a resize.
+
+// Stats is cuckoo_no_stats or cuckoo_stats, and get_stats() returns it.
+
+// Hash must provide the same reset_hash and get_hash functions as hashing_function,
+// but they don't need to be virtual. Using basic_hashing_function<T> as Hash
+// instead of the default virtual_hashing_function<T> removes the virtual call
+// from every probe.
+
 // Note: Assumes that T can be converted to an numeric.
 // Could be improved with a better hashing scheme, currently 
-template <class T>
+template <class T, class Hash = virtual_hashing_function<T>, size_t NumTables = 2,
+    class Stats = cuckoo_no_stats>
 class cuckoo_hashing {
 public:
-    cuckoo_hashing(std::unique_ptr<hashing_function<T>> first_table,
-        std::unique_ptr<hashing_function<T>> second_table,
-        double eps=0.4);
+    // Only for NumTables = 2.
+    cuckoo_hashing(Hash first_table, Hash second_table, double eps=0.4,
+        size_t stash_size=4);
+
+    // Hash table_hashes[t] is used for table t.
+    cuckoo_hashing(std::array<Hash, NumTables> table_hashes, double eps=0.4,
+        size_t stash_size=4);
 
     ~cuckoo_hashing();
 
     void insert(const T& item);
+    void insert(T&& item);
+
+    // Constructs the item from args, and inserts it if it isn't already in the set.
+    template <class... Args>
+    void emplace(Args&&... args);
+
+    // Inserts every item in [first, last), which must be forward iterators.
+    // Sizes the tables for all of them once, and computes the hashes of each
+    // batch of items before inserting any of them, so their slots can be
+    // prefetched.
+    template <class Iterator>
+    void insert_bulk(Iterator first, Iterator last);
+
+    // Sizes the tables so num_items items can be stored without a resize.
+    // Does nothing if they are already large enough.
+    void reserve(size_t num_items);
+
+    // Lets eps move within [min_eps, max_eps], instead of staying at the value it
+    // was constructed with:
+    // - An insert that needs a rehash increases eps by 1.5 times, which lowers
+    //   max_number_elements, so the tables grow if they are now too full.
+    // - A resize decreases eps by 0.8 times if no insert needed a rehash since
+    //   the last one, and they displaced at most max_displacements items on
+    //   average, and otherwise increases it by 1.25 times.
+    // So the tables are kept as full as the items and hashing functions allow,
+    // within the bounds. Passing min_eps == max_eps fixes eps again.
+    // Requires 0 < min_eps <= max_eps.
+    void set_eps_bounds(double min_eps, double max_eps, double max_displacements=1.0);
+
+    double get_eps() const { return eps; }
 
     bool contains(const T& item) const;
 
+    // Sets bit i of out_bits (bit i % 64 of word i / 64) to whether keys[i] is
+    // in the set, and clears the other bits of the last word. Like insert_bulk,
+    // the slots of a batch of keys are prefetched before any are compared.
+    void contains_batch(const T* keys, size_t n, uint64_t* out_bits) const;
+
     void remove(const T& item);
 
     size_t size() const { return num_elements; }
 
+    // Fraction of the slots, in all tables, that contain an item.
+    double load_factor() const {
+        return static_cast<double>(size()) / (NumTables * table_size);
+    }
+
+    const Stats& get_stats() const { return stats; }
+
+    // Writes the tables, stash and hashing functions to path, in the format of
+    // cuckoo_internal::snapshot_header, replacing any file there. Returns false
+    // if it couldn't be written.
+    // T must be trivially copyable, and Hash must have a parameters struct, like
+    // basic_hashing_function, whose padding get_parameters() zeroes so the same
+    // set always gives the same file.
+    bool save(const std::string& path) const;
+
+    class const_iterator;
+
+    // Iterate over every item, table after table, then the stash, then the empty
+    // item. The items are read in the order they are in memory, but any insert or
+    // remove invalidates the iterators.
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    // Splits the slots into chunks of chunk_size (> 0) consecutive slots of one
+    // table, with the stash and the empty item as the last chunk, and calls
+    // callback(first, last) with the const_iterators over the items of each chunk
+    // in turn. Iterating only reads the set, so the ranges can be handed to other
+    // threads and iterated at the same time without any locks, as long as nothing
+    // modifies the set until they are done.
+    template <class Callback>
+    void for_each_chunk(Callback callback, size_t chunk_size) const;
+
     void print_out() const;
 
 protected:
+    static_assert(NumTables >= 2 && NumTables <= 4, "Only 2, 3 or 4 tables are supported");
+
+    // Largest fraction of all slots that can be used before inserts start to fail,
+    // with some room to spare.
+    static constexpr double max_load_factor() {
+        return NumTables == 2 ? 0.5 : (NumTables == 3 ? 0.9 : 0.95);
+    }
+
     // A further efficiency could be, for large classes,
     // to have this struct store a pointer to them instead.
-    struct ItemOr {
-        ItemOr()
-            : contains_item(false)
-        {}
-
-        ItemOr(T item, bool contains_item)
-            : item(item),
-            contains_item(contains_item)
-        {}
-
-        T item;
-        bool contains_item;
-    };
+    using ItemOr = cuckoo_internal::item_or<T>;
+
+    // Whether key is cuckoo_empty_item<T>::value(), which is never stored in the
+    // tables or the stash.
+    template <class Key>
+    bool is_empty_item(const Key& key) const {
+        return cuckoo_internal::is_empty_item<T>(key);
+    }
+
+    // Returns the slot storing an item equal to key, or nullptr if there isn't one.
+    // Key can be T, or any other type that both Hash and T's operator== accept.
+    template <class Key>
+    const ItemOr* find_slot(const Key& key) const;
+
+    template <class Key>
+    ItemOr* find_slot(const Key& key) {
+        return const_cast<ItemOr*>(
+            static_cast<const cuckoo_hashing*>(this)->find_slot(key));
+    }
+
+    // const_iterator walks the slots in segments: each table, then the stash,
+    // then empty_item_slot if the set contains the empty item.
+    static const size_t stash_segment = NumTables;
+    static const size_t empty_item_segment = NumTables + 1;
+    static const size_t end_segment = NumTables + 2;
+
+    // Sets [*first, *last) to the slots of segment, which are both nullptr for
+    // end_segment.
+    void get_segment(size_t segment, const ItemOr** first, const ItemOr** last) const;
+
+    // Removes the item stored in slot, and resizes if necessary.
+    // Slot may be in the tables or the stash, or be empty_item_slot.
+    void remove_slot(ItemOr* slot);
+
+    // Removes the item stored in slot, without updating any counter variables.
+    void clear_slot(ItemOr* slot);
+
+    // Inserts an item that isn't already in the set, first into the tables,
+    // then the stash, and otherwise rehashes until it fits.
+    // Returns the slot the item ended up in, or nullptr if a rehash moved it.
+    ItemOr* place_item(ItemOr* item);
+
+    // Updates the counters for a new item, resizing or rehashing if needed,
+    // then places it. Returns the same as place_item.
+    ItemOr* insert_new_item(ItemOr* item);
 
-    // Will ping-pong items between the two tables until either:
-    //   1) item.contains_item = false, which means successfully inserted.
+    // Moves as many stashed items as possible back into the tables.
+    void empty_stash();
+
+    // Will ping-pong items between the two tables (or random walk between more
+    // tables) until either:
+    //   1) !item.contains_item(), which means successfully inserted.
     //   2) reached max_loop iterations, in which case a rehash is required.
-    void attempt_to_insert_item(ItemOr *item);
+    // Returns the number of items that were displaced.
+    // If tracked isn't nullptr, it is kept pointing at the item it points to.
+    int attempt_to_insert_item(ItemOr *item, ItemOr** tracked = nullptr);
+
+    // Swaps slot with *current, updating tracked as attempt_to_insert_item does.
+    static void swap_tracked(ItemOr& slot, ItemOr* current, ItemOr** tracked) {
+        std::swap(slot, *current);
+        if (tracked == nullptr) {
+            return;
+        }
+        if (*tracked == current) {
+            *tracked = &slot;
+        } else if (*tracked == &slot) {
+            *tracked = current;
+        }
+    }
 
-    void resize();
+    // Resizes the tables to fit num_items items, which defaults to the current size.
+    void resize(size_t num_items);
+    void resize() { resize(size()); }
     size_t num_resize;
+    // Updates max_number_elements and max_loop for num_items elements, and
+    // min_number_elements for the current number of elements. Returns the
+    // table size they are for.
+    size_t update_size_limits(size_t num_items);
+    // Updates them for tables of size new_table_size.
+    void update_thresholds(size_t new_table_size);
+
+    // Changes eps within its bounds, before a resize chooses the new table size.
+    void adapt_eps_on_resize();
+    // Increases eps after an insert couldn't find a slot and the stash was full,
+    // and updates the thresholds for the current tables. Returns whether eps changed.
+    bool adapt_eps_on_failed_insert();
+
+    // Number of items whose hashes insert_bulk and contains_batch compute
+    // before using any of them.
+    static const int bulk_batch_size = 16;
     // Will go over maximum of the current table_size and size_for_rehash.
     // Uses size_for_rehash for updating the two hashing functions.
     void rehash(size_t size_for_rehash);
+    // Does the rehash, which it retries with new hashing functions if an item
+    // can't be placed.
+    void rehash_tables(size_t size_for_rehash);
     size_t num_rehash;
 
     // Leads to value for max_number_elements being based off of the table size.
-    // Formula is table_size >= (1 + eps) * number_elements
-    // If wanting 1/3 fullness, 0.5 is the desired level.
+    // Formula is NumTables * table_size * max_load_factor() >= (1 + eps) * number_elements
+    // If wanting 1/3 fullness with 2 tables, 0.5 is the desired level.
     double eps;
+    double min_eps;
+    double max_eps;
+    double max_displacements;
+
+    // What adapt_eps_on_resize bases its decision on.
+    size_t num_inserts_since_resize;
+    size_t num_displacements_since_resize;
+    size_t num_failed_inserts_since_resize;
 
     // Maximum number of times can attempt to insert a key before a rehash.
     int max_loop;
@@ -130,101 +835,270 @@ protected:
     size_t num_insertions_without_rehash;
 
     size_t table_size;
-    std::vector<ItemOr> tables[2];
-    std::unique_ptr<hashing_function<T>> hashes[2];
+    std::vector<ItemOr> tables[NumTables];
+    std::array<Hash, NumTables> hashes;
+
+    // Used to choose which item is evicted when there are more than 2 tables.
+    std::mt19937 rng;
+
+    // Never grows past max_stash_size, so pointers into it are stable.
+    std::vector<ItemOr> stash;
+    size_t max_stash_size;
+
+    // Whether cuckoo_empty_item<T>::value() is in the set. find_slot returns
+    // empty_item_slot for it, which is never changed.
+    bool contains_empty_item;
+    ItemOr empty_item_slot;
+
+    // Lookups are const, but still record their probes.
+    mutable Stats stats;
 };
 
-template <class T>
-cuckoo_hashing<T>::cuckoo_hashing(
-        std::unique_ptr<hashing_function<T>> first_table,
-        std::unique_ptr<hashing_function<T>> second_table,
-        double eps)
+// Forward iterator over the items of a cuckoo_hashing, which only ever points at
+// a slot containing an item, or is end().
+template <class T, class Hash, size_t NumTables, class Stats>
+class cuckoo_hashing<T, Hash, NumTables, Stats>::const_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator()
+        : set(nullptr), segment(end_segment), slot(nullptr), segment_end(nullptr) {
+    }
+
+    reference operator*() const { return slot->item; }
+    pointer operator->() const { return &slot->item; }
+
+    const_iterator& operator++() {
+        ++slot;
+        skip_empty_slots();
+        return *this;
+    }
+
+    const_iterator operator++(int) {
+        const_iterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    // Every slot is in a different place, so comparing them is enough.
+    bool operator==(const const_iterator& other) const { return slot == other.slot; }
+    bool operator!=(const const_iterator& other) const { return slot != other.slot; }
+
+private:
+    friend class cuckoo_hashing;
+
+    // Points at the first item at or after index in segment.
+    const_iterator(const cuckoo_hashing* set, size_t segment, size_t index)
+            : set(set), segment(segment) {
+        set->get_segment(segment, &slot, &segment_end);
+        slot += index;
+        skip_empty_slots();
+    }
+
+    void skip_empty_slots() {
+        while (segment != end_segment) {
+            // empty_item_slot holds the empty item, so contains_item() is false for it.
+            if (segment == empty_item_segment) {
+                if (slot != segment_end) {
+                    return;
+                }
+            } else {
+                while (slot != segment_end && !slot->contains_item()) {
+                    ++slot;
+                }
+                if (slot != segment_end) {
+                    return;
+                }
+            }
+
+            ++segment;
+            set->get_segment(segment, &slot, &segment_end);
+        }
+    }
+
+    const cuckoo_hashing* set;
+    size_t segment;
+    const ItemOr* slot;
+    const ItemOr* segment_end;
+};
+
+template <class T, class Hash, size_t NumTables, class Stats>
+cuckoo_hashing<T, Hash, NumTables, Stats>::cuckoo_hashing(Hash first_table, Hash second_table, double eps,
+        size_t stash_size)
+        : cuckoo_hashing(std::array<Hash, NumTables>{{std::move(first_table), std::move(second_table)}},
+            eps, stash_size) {
+    static_assert(NumTables == 2, "Needs a Hash for every table");
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+cuckoo_hashing<T, Hash, NumTables, Stats>::cuckoo_hashing(std::array<Hash, NumTables> table_hashes,
+        double eps, size_t stash_size)
         : num_resize(0),
         num_rehash(0),
         eps(eps),
+        min_eps(eps),
+        max_eps(eps),
+        max_displacements(1.0),
+        num_inserts_since_resize(0),
+        num_displacements_since_resize(0),
+        num_failed_inserts_since_resize(0),
         num_elements(0),
         max_number_elements(0),
         min_number_elements(0),
         num_insertions_without_rehash(0),
-        table_size(0) {
-    hashes[0] = std::move(first_table);
-    hashes[1] = std::move(second_table);
-
+        table_size(0),
+        hashes(std::move(table_hashes)),
+        max_stash_size(stash_size),
+        contains_empty_item(false) {
+    stash.reserve(max_stash_size);
     resize();
 }
 
-template <class T>
-cuckoo_hashing<T>::~cuckoo_hashing() {}
+template <class T, class Hash, size_t NumTables, class Stats>
+cuckoo_hashing<T, Hash, NumTables, Stats>::~cuckoo_hashing() {}
 
-template <class T>
-void cuckoo_hashing<T>::resize() {
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::resize(size_t num_items) {
     ++num_resize;
+    const typename Stats::timer start = stats.start_timer();
+
+    adapt_eps_on_resize();
+    const size_t new_table_size = update_size_limits(num_items);
+
+    // Add the size to the tables now.
+    if (new_table_size > table_size) {
+        for (std::vector<ItemOr>& table : tables) {
+            table.resize(new_table_size);
+        }
+    }
+
+    // Do a rehash
+    rehash(new_table_size);
+
+    // Resize the tables if necessary.
+    if (new_table_size < table_size) {
+        for (std::vector<ItemOr>& table : tables) {
+            table.resize(new_table_size);
+            table.shrink_to_fit();
+        }
+    }
+
+    table_size = new_table_size;
+    stats.record_resize(start);
+}
 
+template <class T, class Hash, size_t NumTables, class Stats>
+size_t cuckoo_hashing<T, Hash, NumTables, Stats>::update_size_limits(size_t num_items) {
     // Update table size. Factor of number of elements inserted and
     // a constant factor to ensure weird stuff doesn't happen when there is a
     // small # of elements.
     const size_t new_table_size =
-        2 * std::ceil(size() * (1 + eps)) + 10;
+        std::ceil(2 * std::ceil(num_items * (1 + eps)) / (NumTables * max_load_factor())) + 10;
+    update_thresholds(new_table_size);
+    return new_table_size;
+}
 
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::update_thresholds(size_t new_table_size) {
     // NOTE: If these three functions are changed, will need to update the notes
     // before the declaration of cuckoo_hashing.
-    // Ensure table_size >= (1 + eps) * number_elements
-    max_number_elements = new_table_size / (1 + eps);
+    // Ensure NumTables * table_size * max_load_factor() >= (1 + eps) * number_elements
+    max_number_elements = new_table_size * NumTables * max_load_factor() / (1 + eps);
     // Don't let the table size get too empty.
     // At this point, could revert to what the table size used to be.
     min_number_elements = std::ceil(size() / (1 + eps)) / 2;
 
-    // max_loop = 3 log1+ε(table_size)
-    max_loop = 3 * std::ceil(log(new_table_size) / log(1 + eps));
+    // max_loop = 3 log1+ε(total number of slots / 2), which is 3 log1+ε(table_size)
+    // with 2 tables. The random walk with more tables is expected to only need a
+    // few evictions, but the fuller tables make its long walks longer.
+    max_loop = 3 * std::ceil(log(new_table_size * NumTables / 2.0) / log(1 + eps));
 
     //std::cout << "Resize: " << new_table_size << ' ' << min_number_elements << ' '
     //    << max_number_elements << ' ' << max_loop << ' ' << size() << '\n';
+}
 
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::set_eps_bounds(
+        double new_min_eps, double new_max_eps, double new_max_displacements) {
+    assert(new_min_eps > 0 && new_min_eps <= new_max_eps);
 
-    // Add the size to the tables now.
-    if (new_table_size > table_size) {
-        tables[0].resize(new_table_size);
-        tables[1].resize(new_table_size);
+    min_eps = new_min_eps;
+    max_eps = new_max_eps;
+    max_displacements = new_max_displacements;
+
+    eps = std::min(max_eps, std::max(min_eps, eps));
+    // If the tables are now too full, the next insert will resize them.
+    update_thresholds(table_size);
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::adapt_eps_on_resize() {
+    // Nothing to go on if there were no inserts, e.g. when shrinking.
+    if (min_eps != max_eps && num_inserts_since_resize > 0) {
+        const double displacements_per_insert =
+            static_cast<double>(num_displacements_since_resize) / num_inserts_since_resize;
+        if (displacements_per_insert > max_displacements) {
+            eps = std::min(max_eps, eps * 1.25);
+        } else if (num_failed_inserts_since_resize == 0) {
+            eps = std::max(min_eps, eps * 0.8);
+        }
     }
 
-    // Do a rehash
-    rehash(new_table_size);
+    num_inserts_since_resize = 0;
+    num_displacements_since_resize = 0;
+    num_failed_inserts_since_resize = 0;
+}
 
-    // Resize the tables if necessary.
-    if (new_table_size < table_size) {
-        tables[0].resize(new_table_size);
-        tables[0].shrink_to_fit();
-        tables[1].resize(new_table_size);
-        tables[1].shrink_to_fit();
+template <class T, class Hash, size_t NumTables, class Stats>
+bool cuckoo_hashing<T, Hash, NumTables, Stats>::adapt_eps_on_failed_insert() {
+    // Even with plenty of room, the hashing functions can be unlucky, so only
+    // repeated failures count.
+    ++num_failed_inserts_since_resize;
+    if (num_failed_inserts_since_resize < 2 || eps >= max_eps) {
+        return false;
     }
 
-    table_size = new_table_size;
+    eps = std::min(max_eps, eps * 1.5);
+    update_thresholds(table_size);
+    return true;
 }
 
-template <class T>
-void cuckoo_hashing<T>::rehash(size_t size_for_rehash) {
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::rehash(size_t size_for_rehash) {
+    const typename Stats::timer start = stats.start_timer();
+    rehash_tables(size_for_rehash);
+    stats.record_rehash(start);
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::rehash_tables(size_t size_for_rehash) {
     ++num_rehash;
 
     // Reset the hashes for tables
-    hashes[0]->reset_hash(size_for_rehash);
-    hashes[1]->reset_hash(size_for_rehash);
+    for (Hash& hash : hashes) {
+        hash.reset_hash(size_for_rehash);
+    }
 
     // Now, for each item that isn't in its correct table entry, attempt to re-insert it.
     // Only need to look at the initial table_size
 
-    for (int table = 0; table < 2; ++table) {
+    for (size_t table = 0; table < NumTables; ++table) {
         // Go through all elements in the current tables size.
         // May need to all elements in the tables, not just the stored size of the table.
         size_t larger_table_size = std::max(size_for_rehash, table_size);
 
         for (size_t index = 0; index < larger_table_size; ++index) {
             // Don't do any calculations if it doesn't have an entry.
-            if (!tables[table][index].contains_item) {
+            if (!tables[table][index].contains_item()) {
                 continue;
             }
 
             size_t hashed_index_in_table =
-                hashes[table]->get_hash(tables[table][index].item);
+                hashes[table].get_hash(tables[table][index].item);
 
             // Already in a valid index.
             if (hashed_index_in_table == index) {
@@ -232,19 +1106,25 @@ void cuckoo_hashing<T>::rehash(size_t size_for_rehash) {
             }
 
             // Should be in a different spot!
-            ItemOr item = tables[table][index];
+            ItemOr item = std::move(tables[table][index]);
             // Mark this current spot as not containing an element.
-            tables[table][index].contains_item = false;
+            tables[table][index].remove_item();
 
             // Now rehash this current item.
             attempt_to_insert_item(&item);
 
+            // The stash has room, so can carry on with the rest of the items.
+            if (item.contains_item() && stash.size() < max_stash_size) {
+                stash.push_back(std::move(item));
+                continue;
+            }
+
             // Didn't manage to place the item back in, so will quite this rehash.
-            if (item.contains_item) {
+            if (item.contains_item()) {
 
                 // If it wasn't successful, need to rehash everything.
-                while (item.contains_item) {
-                    rehash(size_for_rehash);
+                while (item.contains_item()) {
+                    rehash_tables(size_for_rehash);
                     attempt_to_insert_item(&item);
                 }
 
@@ -253,14 +1133,97 @@ void cuckoo_hashing<T>::rehash(size_t size_for_rehash) {
             }
         }
     }
+
+    // The new hashing functions may have places for the stashed items.
+    empty_stash();
 }
 
-template <class T>
-void cuckoo_hashing<T>::insert(const T& item) {
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::empty_stash() {
+    for (ItemOr& stashed : stash) {
+        // If this fails, stashed will be left with whichever item was evicted last.
+        attempt_to_insert_item(&stashed);
+    }
+
+    stash.erase(std::remove_if(stash.begin(), stash.end(),
+        [](const ItemOr& stashed) { return !stashed.contains_item(); }), stash.end());
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+typename cuckoo_hashing<T, Hash, NumTables, Stats>::ItemOr*
+        cuckoo_hashing<T, Hash, NumTables, Stats>::place_item(ItemOr* item) {
+    if (is_empty_item(item->item)) {
+        contains_empty_item = true;
+        return &empty_item_slot;
+    }
+
+    // Follows the item through the displacements.
+    ItemOr* placed = item;
+    const int num_displacements = attempt_to_insert_item(item, &placed);
+    stats.record_insert(num_displacements);
+    ++num_inserts_since_resize;
+    num_displacements_since_resize += num_displacements;
+    if (item->contains_item()) {
+        stats.record_failed_insert();
+    }
+
+    // We exceeded max_loop, since otherwise it would have been changed to not contain a key.
+    while (item->contains_item()) {
+        if (stash.size() < max_stash_size) {
+            stash.push_back(std::move(*item));
+            item->remove_item();
+            if (placed == item) {
+                placed = &stash.back();
+            }
+            break;
+        }
+
+        // A larger eps can mean the tables need to grow, instead of just new
+        // hashing functions.
+        if (adapt_eps_on_failed_insert() && num_elements > max_number_elements) {
+            resize();
+        } else {
+            rehash(table_size);
+        }
+        // The rehash moves every item in the tables, but not *item.
+        if (placed != item) {
+            placed = nullptr;
+        }
+        attempt_to_insert_item(item, placed != nullptr ? &placed : nullptr);
+        num_insertions_without_rehash = 0;
+    }
+    return placed;
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::insert(const T& item) {
     if (contains(item)) {
         return;
     }
 
+    ItemOr current{item, true};
+    insert_new_item(&current);
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::insert(T&& item) {
+    if (contains(item)) {
+        return;
+    }
+
+    ItemOr current{std::move(item), true};
+    insert_new_item(&current);
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+template <class... Args>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::emplace(Args&&... args) {
+    insert(T(std::forward<Args>(args)...));
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+typename cuckoo_hashing<T, Hash, NumTables, Stats>::ItemOr*
+        cuckoo_hashing<T, Hash, NumTables, Stats>::insert_new_item(ItemOr* item) {
     ++num_elements;
 
     if (num_elements > max_number_elements) {
@@ -274,56 +1237,140 @@ void cuckoo_hashing<T>::insert(const T& item) {
         num_insertions_without_rehash = 1;
     }
 
-    ItemOr current{item, true};
+    return place_item(item);
+}
 
-    attempt_to_insert_item(&current);
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::reserve(size_t num_items) {
+    if (num_items <= max_number_elements) {
+        return;
+    }
 
-    // We exceeded max_loop, since otherwise it would have been changed to not contain a key.
-    while (current.contains_item) {
-        rehash(table_size);
-        attempt_to_insert_item(&current);
-        num_insertions_without_rehash = 0;
+    resize(num_items);
+    num_insertions_without_rehash = 0;
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+template <class Iterator>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::insert_bulk(Iterator first, Iterator last) {
+    // Duplicates will make this larger than needed.
+    reserve(size() + std::distance(first, last));
+
+    int indices[bulk_batch_size][NumTables];
+    while (first != last) {
+        // Computing every hash first lets the loads of the slots overlap,
+        // instead of each insert waiting for its own.
+        Iterator batch_first = first;
+        int batch_size = 0;
+        for (; batch_size < bulk_batch_size && first != last; ++batch_size, ++first) {
+            for (size_t table = 0; table < NumTables; ++table) {
+                indices[batch_size][table] = hashes[table].get_hash(*first);
+                __builtin_prefetch(&tables[table][indices[batch_size][table]]);
+            }
+        }
+
+        const size_t num_rehash_before_batch = num_rehash;
+        for (int i = 0; i < batch_size; ++i, ++batch_first) {
+            const T& item = *batch_first;
+
+            // After a rehash the indices are out of date.
+            bool already_contains = false;
+            if (num_rehash == num_rehash_before_batch && !is_empty_item(item)) {
+                for (size_t table = 0; table < NumTables; ++table) {
+                    const ItemOr& slot = tables[table][indices[i][table]];
+                    already_contains |= slot.contains_item() && slot.item == item;
+                }
+                for (const ItemOr& stashed : stash) {
+                    already_contains |= stashed.item == item;
+                }
+            } else {
+                already_contains = contains(item);
+            }
+            if (already_contains) {
+                continue;
+            }
+
+            // The tables were reserved for every item, so this can't need a resize.
+            ++num_elements;
+            ++num_insertions_without_rehash;
+
+            ItemOr current{item, true};
+            place_item(&current);
+        }
     }
 }
 
 // Will not update any counter variables. Those should be updated outside this function.
-template <class T>
-void cuckoo_hashing<T>::attempt_to_insert_item(ItemOr* current) {
-    // Ensure that it considers itself to have an item.
-    current->contains_item = true;
+template <class T, class Hash, size_t NumTables, class Stats>
+int cuckoo_hashing<T, Hash, NumTables, Stats>::attempt_to_insert_item(ItemOr* current,
+        ItemOr** tracked) {
+    if (NumTables == 2) {
+        // Always starts with the first table.
+        int current_table = 0;
+
+        int num_loops = 0;
+        for (; num_loops < max_loop && current->contains_item();
+                ++num_loops, current_table = 1 - current_table) {
+            // Try to put the item into the table.
+            int index = hashes[current_table].get_hash(current->item);
+
+            // Put this itemor into the table. Will swap the entries, so will try to rehash
+            // if necessary.
+            swap_tracked(tables[current_table][index], current, tracked);
+        }
+        // Every swap displaced an item, except for one into an empty slot.
+        return current->contains_item() ? num_loops : std::max(num_loops - 1, 0);
+    }
 
-    // Always starts with the first table.
-    int current_table = 0;
+    // The table the current item was evicted from, which it shouldn't go back to.
+    size_t evicted_from = NumTables;
+    // Any table can be chosen for the first eviction, and then any but evicted_from.
+    std::uniform_int_distribution<size_t> first_table_dist(0, NumTables - 1);
+    std::uniform_int_distribution<size_t> other_table_dist(0, NumTables - 2);
 
-    for (int num_loops = 0; num_loops < max_loop && current->contains_item;
-            ++num_loops, current_table = 1 - current_table) {
-        // Try to put the item into the table.
-        int index = hashes[current_table]->get_hash(current->item);
+    for (int num_loops = 0; num_loops < max_loop; ++num_loops) {
+        // Use an empty slot if the item has one.
+        for (size_t table = 0; table < NumTables; ++table) {
+            if (table == evicted_from) {
+                continue;
+            }
+            ItemOr& slot = tables[table][hashes[table].get_hash(current->item)];
+            if (!slot.contains_item()) {
+                swap_tracked(slot, current, tracked);
+                return num_loops;
+            }
+        }
 
-        // Put this itemor into the table. Will swap the entries, so will try to rehash
-        // if necessary.
-        std::swap(tables[current_table][index], *current);
+        // Otherwise evict the item from a random one of its other slots.
+        size_t table;
+        if (evicted_from == NumTables) {
+            table = first_table_dist(rng);
+        } else {
+            table = other_table_dist(rng);
+            if (table >= evicted_from) {
+                ++table;
+            }
+        }
+        swap_tracked(tables[table][hashes[table].get_hash(current->item)], current, tracked);
+        evicted_from = table;
     }
+    return max_loop;
 }
 
 
-template <class T>
-void cuckoo_hashing<T>::remove(const T& item) {
-    if (!contains(item)) {
-        return;
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::remove(const T& item) {
+    ItemOr* slot = find_slot(item);
+    if (slot != nullptr) {
+        remove_slot(slot);
     }
+}
 
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::remove_slot(ItemOr* slot) {
     --num_elements;
 
-    // Remove from the table.
-    int first_index = hashes[0]->get_hash(item);
-    if (tables[0][first_index].contains_item &&
-            tables[0][first_index].item == item) {
-        tables[0][first_index].contains_item = false;
-    } else {
-        int second_index = hashes[1]->get_hash(item);
-        tables[1][second_index].contains_item = false;
-    }
+    clear_slot(slot);
 
     // Resize table if necessary.
     if (num_elements < min_number_elements) {
@@ -332,32 +1379,215 @@ void cuckoo_hashing<T>::remove(const T& item) {
     }
 }
 
-template <class T>
-bool cuckoo_hashing<T>::contains(const T& item) const {
-    int first_index = hashes[0]->get_hash(item);
-    if (tables[0][first_index].contains_item &&
-            tables[0][first_index].item == item)
-        return true;
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::clear_slot(ItemOr* slot) {
+    if (slot == &empty_item_slot) {
+        contains_empty_item = false;
+        return;
+    }
+
+    // Remove from the table.
+    slot->remove_item();
 
-    int second_index = hashes[1]->get_hash(item);
-    return tables[1][second_index].contains_item &&
-        tables[1][second_index].item == item;
+    // Stashed items must be kept together at the start of the stash.
+    if (slot >= stash.data() && slot < stash.data() + stash.size()) {
+        *slot = std::move(stash.back());
+        stash.pop_back();
+    } else {
+        // The freed slot can take a stashed item which hashes to it.
+        for (ItemOr& stashed : stash) {
+            bool hashes_to_slot = false;
+            for (size_t table = 0; table < NumTables; ++table) {
+                hashes_to_slot |= slot == &tables[table][hashes[table].get_hash(stashed.item)];
+            }
+            if (hashes_to_slot) {
+                *slot = std::move(stashed);
+                stashed = std::move(stash.back());
+                stash.pop_back();
+                break;
+            }
+        }
+    }
 }
 
-template <class T>
-void cuckoo_hashing<T>::print_out() const {
-    for (int i = 0; i < table_size; ++i) {
-        std::cout << i << ": ";
-        if (tables[0][i].contains_item) {
-            std::cout << tables[0][i].item << " (alt: " << hashes[1]->get_hash(tables[0][i].item) << ")   ";
-        } else {
-            std::cout << "        ";
+template <class T, class Hash, size_t NumTables, class Stats>
+bool cuckoo_hashing<T, Hash, NumTables, Stats>::contains(const T& item) const {
+    return find_slot(item) != nullptr;
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::contains_batch(
+        const T* keys, size_t n, uint64_t* out_bits) const {
+    std::fill(out_bits, out_bits + (n + 63) / 64, 0);
+
+    // The slots for key i + bulk_batch_size are prefetched while key i is
+    // compared, so the prefetches have time to finish.
+    int indices[bulk_batch_size][NumTables];
+    auto prefetch_key = [this, keys, &indices](size_t i) {
+        for (size_t table = 0; table < NumTables; ++table) {
+            indices[i % bulk_batch_size][table] = hashes[table].get_hash(keys[i]);
+            __builtin_prefetch(&tables[table][indices[i % bulk_batch_size][table]]);
         }
+    };
 
-        if (tables[1][i].contains_item) {
-            std::cout << tables[1][i].item << " (alt: " << hashes[0]->get_hash(tables[1][i].item) << ")   ";
-        } else {
-            std::cout << "     ";
+    for (size_t i = 0; i < std::min<size_t>(n, bulk_batch_size); ++i) {
+        prefetch_key(i);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        bool found = contains_empty_item && is_empty_item(keys[i]);
+        for (size_t table = 0; table < NumTables; ++table) {
+            const ItemOr& slot = tables[table][indices[i % bulk_batch_size][table]];
+            found |= slot.contains_item() && slot.item == keys[i];
+        }
+        for (const ItemOr& stashed : stash) {
+            found |= stashed.item == keys[i];
+        }
+        out_bits[i / 64] |= static_cast<uint64_t>(found) << (i % 64);
+        stats.record_lookup(NumTables + stash.size());
+
+        if (i + bulk_batch_size < n) {
+            prefetch_key(i + bulk_batch_size);
+        }
+    }
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+template <class Key>
+const typename cuckoo_hashing<T, Hash, NumTables, Stats>::ItemOr*
+cuckoo_hashing<T, Hash, NumTables, Stats>::find_slot(const Key& key) const {
+    if (is_empty_item(key)) {
+        stats.record_lookup(0);
+        return contains_empty_item ? &empty_item_slot : nullptr;
+    }
+
+    for (size_t table = 0; table < NumTables; ++table) {
+        int index = hashes[table].get_hash(key);
+        if (tables[table][index].contains_item() &&
+                tables[table][index].item == key) {
+            stats.record_lookup(table + 1);
+            return &tables[table][index];
+        }
+    }
+
+    int num_probes = NumTables;
+    for (const ItemOr& stashed : stash) {
+        ++num_probes;
+        if (stashed.item == key) {
+            stats.record_lookup(num_probes);
+            return &stashed;
+        }
+    }
+
+    stats.record_lookup(num_probes);
+    return nullptr;
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+bool cuckoo_hashing<T, Hash, NumTables, Stats>::save(const std::string& path) const {
+    static_assert(std::is_trivially_copyable<ItemOr>::value,
+        "Slots are written as they are in memory, so T must be trivially copyable");
+    using parameters = typename Hash::parameters;
+
+    cuckoo_internal::snapshot_header header;
+    std::copy(cuckoo_internal::snapshot_magic, cuckoo_internal::snapshot_magic + 8, header.magic);
+    header.version = cuckoo_internal::snapshot_header::current_version;
+    header.num_tables = NumTables;
+    header.slot_size = sizeof(ItemOr);
+    header.hash_parameters_size = sizeof(parameters);
+    header.table_size = table_size;
+    header.num_elements = num_elements;
+    header.stash_size = stash.size();
+    header.contains_empty_item = contains_empty_item;
+
+    header.hashes_offset = cuckoo_internal::align_to_cache_line(sizeof(header));
+    header.tables_offset = cuckoo_internal::align_to_cache_line(
+        header.hashes_offset + NumTables * sizeof(parameters));
+    header.stash_offset = header.tables_offset + NumTables * table_size * sizeof(ItemOr);
+    header.file_size = header.stash_offset + stash.size() * sizeof(ItemOr);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    auto write = [&out](const void* data, size_t length) {
+        out.write(static_cast<const char*>(data), length);
+    };
+    auto pad_to = [&out](uint64_t offset) {
+        while (static_cast<uint64_t>(out.tellp()) < offset) {
+            out.put(0);
+        }
+    };
+
+    write(&header, sizeof(header));
+    pad_to(header.hashes_offset);
+    for (const Hash& hash : hashes) {
+        const parameters params = hash.get_parameters();
+        write(&params, sizeof(params));
+    }
+    pad_to(header.tables_offset);
+    for (const std::vector<ItemOr>& table : tables) {
+        write(table.data(), table_size * sizeof(ItemOr));
+    }
+    write(stash.data(), stash.size() * sizeof(ItemOr));
+
+    out.close();
+    return !out.fail();
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::get_segment(
+        size_t segment, const ItemOr** first, const ItemOr** last) const {
+    if (segment < NumTables) {
+        *first = tables[segment].data();
+        *last = *first + table_size;
+    } else if (segment == stash_segment) {
+        *first = stash.data();
+        *last = *first + stash.size();
+    } else if (segment == empty_item_segment) {
+        *first = &empty_item_slot;
+        *last = *first + (contains_empty_item ? 1 : 0);
+    } else {
+        *first = nullptr;
+        *last = nullptr;
+    }
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+typename cuckoo_hashing<T, Hash, NumTables, Stats>::const_iterator
+cuckoo_hashing<T, Hash, NumTables, Stats>::begin() const {
+    return const_iterator(this, 0, 0);
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+typename cuckoo_hashing<T, Hash, NumTables, Stats>::const_iterator
+cuckoo_hashing<T, Hash, NumTables, Stats>::end() const {
+    return const_iterator(this, end_segment, 0);
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+template <class Callback>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::for_each_chunk(
+        Callback callback, size_t chunk_size) const {
+    for (size_t table = 0; table < NumTables; ++table) {
+        for (size_t first = 0; first < table_size; first += chunk_size) {
+            // Both iterators skip forward to the next item, possibly in a later
+            // table, so each chunk ends exactly where the next one starts.
+            const size_t last = std::min(first + chunk_size, table_size);
+            callback(const_iterator(this, table, first), const_iterator(this, table, last));
+        }
+    }
+    callback(const_iterator(this, stash_segment, 0), end());
+}
+
+template <class T, class Hash, size_t NumTables, class Stats>
+void cuckoo_hashing<T, Hash, NumTables, Stats>::print_out() const {
+    for (int i = 0; i < table_size; ++i) {
+        std::cout << i << ": ";
+        for (size_t table = 0; table < NumTables; ++table) {
+            if (tables[table][i].contains_item()) {
+                std::cout << tables[table][i].item << " (alt: " <<
+                    hashes[(table + 1) % NumTables].get_hash(tables[table][i].item) << ")   ";
+            } else {
+                std::cout << "        ";
+            }
         }
 
         std::cout << '\n';
@@ -0,0 +1,313 @@
+#ifndef HASH_CUCKOO_FILTER_H
+#define HASH_CUCKOO_FILTER_H
+
+#include "cuckoo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Approximate membership version of cuckoo hashing, from the paper
+// "Cuckoo Filter: Practically Better Than Bloom" by Fan et al.
+//
+// Instead of the items, only a FingerprintBits sized fingerprint of each item is
+// stored, in a single table of buckets with 4 slots each. Since the item isn't
+// available when it is displaced, its two buckets are found with partial-key
+// cuckoo hashing:
+//   first = hash(item)
+//   second = (hash(fingerprint) - first) mod num_buckets
+// so either bucket can be computed from the other and the fingerprint. The paper
+// uses first xor hash(fingerprint) instead, which needs the number of buckets to
+// be a power of two, so can leave the filter half empty.
+//
+// contains() can return true for an item that was never inserted, with a
+// probability of about 8 / 2^FingerprintBits, but never returns false for one
+// that was. remove() must only be called with items that were inserted, otherwise
+// it could remove the fingerprint of a different item.
+//
+// As with bucketized_cuckoo_hashing, a full bucket evicts a random slot into its
+// alternate bucket. The filter can't be resized or rehashed, since the items
+// aren't stored, so it is sized for a fixed capacity, and once an insert runs out
+// of evictions the last fingerprint is kept aside and further inserts fail.
+//
+// Inserting the same item twice stores its fingerprint twice, and it must then be
+// removed twice.
+
+// Some intuition on sizes with max_load_factor=0.95, once filled to capacity
+//  capacity     num buckets  bits per key (12 bit fingerprints)
+//  1000         264          12.7
+//  1000000      263158       12.6
+
+// Hash needs reset_hash and get_hash like for cuckoo_hashing, and is used for both
+// the bucket index and the fingerprint.
+template <class T, int FingerprintBits = 12, class Hash = multiply_shift_hashing_function<T>>
+class cuckoo_filter {
+public:
+    cuckoo_filter(Hash index_hash, Hash fingerprint_hash, size_t capacity,
+        double max_load_factor=0.95);
+
+    // Returns false if there wasn't room for item, in which case nothing changed.
+    bool insert(const T& item);
+
+    bool contains(const T& item) const;
+
+    // Returns false if item's fingerprint wasn't found.
+    bool remove(const T& item);
+
+    size_t size() const { return num_elements; }
+
+    // Fraction of all slots that contain a fingerprint.
+    double load_factor() const;
+
+    // Bits used by the table for every item currently stored, or 0 if it is empty.
+    double bits_per_item() const;
+
+protected:
+    static_assert(FingerprintBits >= 2 && FingerprintBits <= 30,
+        "Hash::reset_hash takes an int, so the fingerprints must have at most 30 bits");
+
+    static const size_t bucket_size = 4;
+
+    // Fingerprint of 0 means the slot is empty.
+    uint32_t fingerprint(const T& item) const;
+
+    size_t first_index(const T& item) const {
+        return index_hash.get_hash(item);
+    }
+
+    // The alternate bucket of a fingerprint stored in bucket index.
+    size_t alternate_index(size_t index, uint32_t fingerprint) const {
+        // Multiplicative hashing, so similar fingerprints go to different buckets.
+        uint32_t hash = fingerprint * 0x5bd1e995U;
+        size_t offset = cuckoo_internal::reduce_range(hash, num_buckets);
+        return offset >= index ? offset - index : offset + num_buckets - index;
+    }
+
+    // Fingerprints are packed next to each other, so slot s of bucket b uses bits
+    // [(b * bucket_size + s) * FingerprintBits, ... + FingerprintBits).
+    uint32_t get_fingerprint(size_t index, size_t slot) const;
+    void set_fingerprint(size_t index, size_t slot, uint32_t fingerprint);
+
+    // Returns the slot of bucket index holding fingerprint, or -1.
+    int find_in_bucket(size_t index, uint32_t fingerprint) const;
+
+    // Puts fingerprint into an empty slot of bucket index, returning false if it's full.
+    bool insert_into_bucket(size_t index, uint32_t fingerprint);
+
+    size_t num_elements;
+    size_t num_buckets;
+
+    // Maximum number of evictions before the filter is considered full.
+    int max_loop;
+
+    // Number of times a fingerprint was evicted from its slot.
+    size_t num_displacements;
+
+    std::vector<uint64_t> bits;
+
+    // Fingerprint that couldn't be placed after max_loop evictions, and one of its
+    // buckets. Once it's set, every insert fails.
+    bool has_victim;
+    size_t victim_index;
+    uint32_t victim_fingerprint;
+
+    Hash index_hash;
+    Hash fingerprint_hash;
+
+    // Used to choose which slot is evicted.
+    std::mt19937 rng;
+};
+
+template <class T, int FingerprintBits, class Hash>
+cuckoo_filter<T, FingerprintBits, Hash>::cuckoo_filter(
+        Hash index_hash, Hash fingerprint_hash, size_t capacity, double max_load_factor)
+        : num_elements(0),
+        num_buckets(std::max<size_t>(1,
+            std::ceil(capacity / (bucket_size * max_load_factor)))),
+        max_loop(500),
+        num_displacements(0),
+        has_victim(false),
+        victim_index(0),
+        victim_fingerprint(0),
+        index_hash(std::move(index_hash)),
+        fingerprint_hash(std::move(fingerprint_hash)) {
+    this->index_hash.reset_hash(num_buckets);
+    // Hashes to [0, 2^FingerprintBits - 1), to which 1 is added to skip over 0.
+    this->fingerprint_hash.reset_hash((1LL << FingerprintBits) - 1);
+
+    // One extra word, so reading a fingerprint never goes out of bounds.
+    const size_t total_bits = num_buckets * bucket_size * FingerprintBits;
+    bits.assign(total_bits / 64 + 2, 0);
+}
+
+template <class T, int FingerprintBits, class Hash>
+uint32_t cuckoo_filter<T, FingerprintBits, Hash>::fingerprint(const T& item) const {
+    return static_cast<uint32_t>(fingerprint_hash.get_hash(item)) + 1;
+}
+
+template <class T, int FingerprintBits, class Hash>
+uint32_t cuckoo_filter<T, FingerprintBits, Hash>::get_fingerprint(
+        size_t index, size_t slot) const {
+    const size_t position = (index * bucket_size + slot) * FingerprintBits;
+    const size_t word = position / 64;
+    const int offset = position % 64;
+
+    // The fingerprint can span two words.
+    uint64_t value = bits[word] >> offset;
+    if (offset + FingerprintBits > 64) {
+        value |= bits[word + 1] << (64 - offset);
+    }
+    return static_cast<uint32_t>(value & ((1ULL << FingerprintBits) - 1));
+}
+
+template <class T, int FingerprintBits, class Hash>
+void cuckoo_filter<T, FingerprintBits, Hash>::set_fingerprint(
+        size_t index, size_t slot, uint32_t fingerprint) {
+    const size_t position = (index * bucket_size + slot) * FingerprintBits;
+    const size_t word = position / 64;
+    const int offset = position % 64;
+    const uint64_t mask = (1ULL << FingerprintBits) - 1;
+
+    bits[word] = (bits[word] & ~(mask << offset)) |
+        (static_cast<uint64_t>(fingerprint) << offset);
+    if (offset + FingerprintBits > 64) {
+        const int spilled = 64 - offset;
+        bits[word + 1] = (bits[word + 1] & ~(mask >> spilled)) |
+            (static_cast<uint64_t>(fingerprint) >> spilled);
+    }
+}
+
+template <class T, int FingerprintBits, class Hash>
+int cuckoo_filter<T, FingerprintBits, Hash>::find_in_bucket(
+        size_t index, uint32_t fingerprint) const {
+    for (size_t slot = 0; slot < bucket_size; ++slot) {
+        if (get_fingerprint(index, slot) == fingerprint) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+template <class T, int FingerprintBits, class Hash>
+bool cuckoo_filter<T, FingerprintBits, Hash>::insert_into_bucket(
+        size_t index, uint32_t fingerprint) {
+    int slot = find_in_bucket(index, 0);
+    if (slot == -1) {
+        return false;
+    }
+    set_fingerprint(index, slot, fingerprint);
+    return true;
+}
+
+template <class T, int FingerprintBits, class Hash>
+bool cuckoo_filter<T, FingerprintBits, Hash>::insert(const T& item) {
+    if (has_victim) {
+        return false;
+    }
+
+    uint32_t current = fingerprint(item);
+    size_t indices[2];
+    indices[0] = first_index(item);
+    indices[1] = alternate_index(indices[0], current);
+
+    ++num_elements;
+    if (insert_into_bucket(indices[0], current) ||
+            insert_into_bucket(indices[1], current)) {
+        return true;
+    }
+
+    // Both buckets are full, so evict a random fingerprint and place it into its
+    // alternate bucket.
+    std::uniform_int_distribution<int> slot_dist(0, bucket_size - 1);
+    size_t index = indices[rng() & 1];
+    for (int num_loops = 0; num_loops < max_loop; ++num_loops) {
+        ++num_displacements;
+        int evicted_slot = slot_dist(rng);
+        uint32_t evicted = get_fingerprint(index, evicted_slot);
+        set_fingerprint(index, evicted_slot, current);
+        current = evicted;
+
+        index = alternate_index(index, current);
+        if (insert_into_bucket(index, current)) {
+            return true;
+        }
+    }
+
+    // Every fingerprint, including the new one, is still stored, but the walk
+    // would need to be undone to reject this item. Keep the one left over aside.
+    has_victim = true;
+    victim_index = index;
+    victim_fingerprint = current;
+    return true;
+}
+
+template <class T, int FingerprintBits, class Hash>
+bool cuckoo_filter<T, FingerprintBits, Hash>::contains(const T& item) const {
+    const uint32_t item_fingerprint = fingerprint(item);
+    const size_t first = first_index(item);
+    const size_t second = alternate_index(first, item_fingerprint);
+
+    if (has_victim && victim_fingerprint == item_fingerprint &&
+            (victim_index == first || victim_index == second)) {
+        return true;
+    }
+
+    return find_in_bucket(first, item_fingerprint) != -1 ||
+        find_in_bucket(second, item_fingerprint) != -1;
+}
+
+template <class T, int FingerprintBits, class Hash>
+bool cuckoo_filter<T, FingerprintBits, Hash>::remove(const T& item) {
+    const uint32_t item_fingerprint = fingerprint(item);
+    const size_t first = first_index(item);
+    const size_t second = alternate_index(first, item_fingerprint);
+
+    bool removed = false;
+    if (has_victim && victim_fingerprint == item_fingerprint &&
+            (victim_index == first || victim_index == second)) {
+        has_victim = false;
+        removed = true;
+    } else {
+        for (size_t index : {first, second}) {
+            int slot = find_in_bucket(index, item_fingerprint);
+            if (slot != -1) {
+                set_fingerprint(index, slot, 0);
+                removed = true;
+                break;
+            }
+        }
+    }
+
+    if (!removed) {
+        return false;
+    }
+    --num_elements;
+
+    // The freed slot may let the victim back into the table.
+    if (has_victim) {
+        const size_t alternate = alternate_index(victim_index, victim_fingerprint);
+        if (insert_into_bucket(victim_index, victim_fingerprint) ||
+                insert_into_bucket(alternate, victim_fingerprint)) {
+            has_victim = false;
+        }
+    }
+    return true;
+}
+
+template <class T, int FingerprintBits, class Hash>
+double cuckoo_filter<T, FingerprintBits, Hash>::load_factor() const {
+    return static_cast<double>(size()) / (num_buckets * bucket_size);
+}
+
+template <class T, int FingerprintBits, class Hash>
+double cuckoo_filter<T, FingerprintBits, Hash>::bits_per_item() const {
+    if (size() == 0) {
+        return 0;
+    }
+    return static_cast<double>(num_buckets * bucket_size * FingerprintBits) / size();
+}
+
+#endif  // HASH_CUCKOO_FILTER_H
@@ -0,0 +1,311 @@
+#include "cuckoo_filter.h"
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+using milliseconds = std::chrono::milliseconds;
+using Time = std::chrono::system_clock;
+using std::to_string;
+
+const int NumElementsInserted =        1000000;
+// Lookups for false positives are done for [NumElementsInserted, NumElementsInserted * (1 + NumLookupRounds)).
+const int NumLookupRounds =                 10;
+
+using multiply_shift = multiply_shift_hashing_function<int>;
+
+// Done differently than other Data Structures since want to get access to the data in the class
+template <int FingerprintBits>
+class cuckoo_filter_tests : public cuckoo_filter<int, FingerprintBits, multiply_shift> {
+public:
+    using base = cuckoo_filter<int, FingerprintBits, multiply_shift>;
+
+    // The rngs aren't randomly seeded, so the tests are repeatable.
+    cuckoo_filter_tests(size_t capacity, double max_load_factor=0.95)
+        : base(multiply_shift{std::mt19937_64{}, false},
+            multiply_shift{std::mt19937_64{1}, false},
+            capacity, max_load_factor) {
+    }
+
+    size_t get_num_buckets() const {
+        return this->num_buckets;
+    }
+
+    bool get_has_victim() const {
+        return this->has_victim;
+    }
+
+    size_t get_num_displacements() const {
+        return this->num_displacements;
+    }
+
+    void assert_is_valid() const {
+        size_t number_elements = this->has_victim ? 1 : 0;
+        for (size_t index = 0; index < this->num_buckets; ++index) {
+            for (size_t slot = 0; slot < this->bucket_size; ++slot) {
+                if (this->get_fingerprint(index, slot) != 0) {
+                    ++number_elements;
+                }
+            }
+        }
+
+        if (this->size() != number_elements)
+            throw "The size wasn't updated properly: is " +
+                to_string(number_elements) + " while reports " + to_string(this->size());
+
+        // Every stored fingerprint's alternate bucket must lead back to its bucket.
+        for (size_t index = 0; index < this->num_buckets; ++index) {
+            for (size_t slot = 0; slot < this->bucket_size; ++slot) {
+                uint32_t fingerprint = this->get_fingerprint(index, slot);
+                if (fingerprint == 0)
+                    continue;
+                size_t alternate = this->alternate_index(index, fingerprint);
+                if (alternate >= this->num_buckets ||
+                        this->alternate_index(alternate, fingerprint) != index)
+                    throw "Alternate bucket of " + to_string(fingerprint) + " in bucket " +
+                        to_string(index) + " is " + to_string(alternate);
+            }
+        }
+    }
+
+    // Writes a different fingerprint into every slot, then checks none of the
+    // writes changed the neighbouring slots.
+    void assert_packing_is_valid() {
+        const uint32_t mask = (1ULL << FingerprintBits) - 1;
+        auto value_for = [this, mask](size_t index, size_t slot) {
+            return static_cast<uint32_t>((index * this->bucket_size + slot) * 2654435761U) & mask;
+        };
+
+        for (size_t index = 0; index < this->num_buckets; ++index) {
+            for (size_t slot = 0; slot < this->bucket_size; ++slot) {
+                this->set_fingerprint(index, slot, value_for(index, slot));
+            }
+        }
+
+        for (size_t index = 0; index < this->num_buckets; ++index) {
+            for (size_t slot = 0; slot < this->bucket_size; ++slot) {
+                if (this->get_fingerprint(index, slot) != value_for(index, slot))
+                    throw "Slot " + to_string(slot) + " of bucket " + to_string(index) +
+                        " has " + to_string(this->get_fingerprint(index, slot)) +
+                        " instead of " + to_string(value_for(index, slot));
+                this->set_fingerprint(index, slot, 0);
+            }
+        }
+    }
+};
+
+template <int FingerprintBits>
+void CheckContainsElement(const cuckoo_filter_tests<FingerprintBits>& filter, int val) {
+    if (!filter.contains(val))
+        throw "Expected filter to contain " + to_string(val);
+}
+
+template <int FingerprintBits>
+void CheckNumberElements(const cuckoo_filter_tests<FingerprintBits>& filter, size_t expected_size) {
+    if (filter.size() != expected_size)
+        throw "Filter size is wrong: expected " + to_string(expected_size) + " got " + to_string(filter.size());
+}
+
+void SimpleInsertion() {
+    cuckoo_filter_tests<12> filter(100);
+
+    try {
+        if (filter.bits_per_item() != 0)
+            throw "An empty filter reports " + to_string(filter.bits_per_item()) + " bits per item";
+
+        for (int i = 5; i <= 7; ++i) {
+            if (!filter.insert(i))
+                throw "Failed to insert " + to_string(i) + " into an empty filter";
+        }
+
+        CheckContainsElement(filter, 5);
+        CheckContainsElement(filter, 6);
+        CheckContainsElement(filter, 7);
+
+        CheckNumberElements(filter, 3);
+
+        filter.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in SimpleInsertion: " << s << '\n';
+        throw s;
+    }
+}
+
+// 12 and 13 bits don't divide 64, so some fingerprints span two words.
+template <int FingerprintBits>
+void FingerprintsArePacked() {
+    cuckoo_filter_tests<FingerprintBits> filter(1000);
+
+    try {
+        filter.assert_packing_is_valid();
+        filter.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in FingerprintsArePacked<" << FingerprintBits << ">: " << s << '\n';
+        throw s;
+    }
+}
+
+void RemoveItems() {
+    cuckoo_filter_tests<16> filter(1000);
+
+    for (int i = 0; i < 500; ++i) {
+        filter.insert(i);
+    }
+    // Inserting twice stores the fingerprint twice.
+    filter.insert(0);
+
+    try {
+        for (int i = 1; i < 500; i += 2) {
+            if (!filter.remove(i))
+                throw "Failed to remove " + to_string(i);
+        }
+
+        CheckNumberElements(filter, 251);
+        for (int i = 0; i < 500; i += 2) {
+            CheckContainsElement(filter, i);
+        }
+
+        if (!filter.remove(0))
+            throw std::string("Failed to remove the first copy of 0");
+        CheckContainsElement(filter, 0);
+        if (!filter.remove(0))
+            throw std::string("Failed to remove the second copy of 0");
+
+        CheckNumberElements(filter, 249);
+        filter.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in RemoveItems: " << s << '\n';
+        throw s;
+    }
+}
+
+// Filling a filter up should reach close to the full load factor, and never lose
+// any of the items that were inserted.
+void FillUntilFull() {
+    cuckoo_filter_tests<12> filter(100000, /*max_load_factor=*/1.0);
+
+    int num_inserted = 0;
+    while (filter.insert(num_inserted)) {
+        ++num_inserted;
+    }
+
+    try {
+        if (!filter.get_has_victim())
+            throw std::string("Filter stopped accepting items without being full");
+
+        if (filter.load_factor() < 0.9)
+            throw "Filter was only filled to a load factor of " + to_string(filter.load_factor());
+
+        // The insert which left a victim still succeeded.
+        for (int i = 0; i < num_inserted; ++i) {
+            CheckContainsElement(filter, i);
+        }
+        CheckNumberElements(filter, num_inserted);
+        filter.assert_is_valid();
+
+        // Once there is room in one of its buckets, the victim is moved back into the table.
+        for (int i = 0; i < num_inserted; i += 2) {
+            filter.remove(i);
+        }
+        if (filter.get_has_victim())
+            throw std::string("The victim should have been moved into a freed slot");
+        for (int i = 1; i < num_inserted; i += 2) {
+            CheckContainsElement(filter, i);
+        }
+        if (!filter.insert(-1))
+            throw std::string("Expected room for an item after removing half of them");
+        filter.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in FillUntilFull: " << s << '\n';
+        throw s;
+    }
+}
+
+void LargeTest() {
+    cuckoo_filter_tests<12> filter(NumElementsInserted);
+
+    try {
+        for (int i = 0; i < NumElementsInserted; ++i) {
+            if (!filter.insert(i))
+                throw "Filter was full after " + to_string(i) + " items";
+        }
+
+        // No false negatives, whatever was removed.
+        for (int i = 0; i < NumElementsInserted; i += 10) {
+            if (!filter.remove(i))
+                throw "Failed to remove " + to_string(i);
+        }
+        for (int i = 0; i < NumElementsInserted; ++i) {
+            if (i % 10 != 0)
+                CheckContainsElement(filter, i);
+        }
+
+        filter.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in LargeTest: " << s << '\n';
+        throw s;
+    }
+}
+
+
+// Exposes how many slots the cuckoo_hashing tables have.
+class cuckoo_hashing_size : public cuckoo_hashing<int, multiply_shift> {
+public:
+    cuckoo_hashing_size()
+        : cuckoo_hashing(multiply_shift{std::mt19937_64{}, false},
+            multiply_shift{std::mt19937_64{1}, false}) {
+    }
+
+    double bits_per_item() const {
+        return 2.0 * table_size * sizeof(ItemOr) * 8 / size();
+    }
+};
+
+// Fills a filter sized for NumElementsInserted, then measures the fraction of
+// keys that were never inserted which it reports as contained.
+template <int FingerprintBits>
+void RunFalsePositiveBenchmark() {
+    cuckoo_filter_tests<FingerprintBits> filter(NumElementsInserted);
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        filter.insert(i);
+    }
+
+    const int num_lookups = NumElementsInserted * NumLookupRounds;
+    size_t false_positives = 0;
+    Time::time_point before = Time::now();
+    for (int i = NumElementsInserted; i < NumElementsInserted + num_lookups; ++i) {
+        false_positives += filter.contains(i);
+    }
+    milliseconds time = std::chrono::duration_cast<milliseconds>(Time::now() - before);
+
+    std::cout << "  " << FingerprintBits << " bit fingerprints: " <<
+        100.0 * false_positives / num_lookups << "% false positives (at most ~" <<
+        100.0 * 8 / (1 << FingerprintBits) << "%), " <<
+        filter.bits_per_item() << " bits per item, load factor " << filter.load_factor() <<
+        ", " << time.count() << " ms for " << num_lookups << " lookups.\n";
+}
+
+
+int main() {
+    SimpleInsertion();
+    FingerprintsArePacked<8>();
+    FingerprintsArePacked<12>();
+    FingerprintsArePacked<13>();
+    FingerprintsArePacked<16>();
+    RemoveItems();
+    FillUntilFull();
+    LargeTest();
+
+    std::cout << "Inserting " << NumElementsInserted << " elements:\n";
+    RunFalsePositiveBenchmark<8>();
+    RunFalsePositiveBenchmark<12>();
+    RunFalsePositiveBenchmark<16>();
+
+    cuckoo_hashing_size cuckoo;
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        cuckoo.insert(i);
+    }
+    std::cout << "  cuckoo_hashing: " << cuckoo.bits_per_item() << " bits per item.\n";
+}
@@ -0,0 +1,143 @@
+#ifndef HASH_CUCKOO_MAP_H
+#define HASH_CUCKOO_MAP_H
+
+#include "cuckoo.h"
+
+#include <tuple>
+#include <utility>
+
+// Key-value version of cuckoo_hashing. The key and value are stored together in
+// the same slot, so a lookup of a small key and value will only read one cache
+// line per table.
+//
+// Is implemented as a cuckoo_hashing of entries, where entries are hashed and
+// compared only by their key.
+
+template <class K, class V>
+struct cuckoo_map_entry {
+    cuckoo_map_entry() {}
+
+    template <class... Args>
+    cuckoo_map_entry(const K& key, Args&&... args)
+        : key(key),
+        value(std::forward<Args>(args)...) {
+    }
+
+    bool operator==(const cuckoo_map_entry& other) const {
+        return key == other.key;
+    }
+
+    bool operator==(const K& other) const {
+        return key == other;
+    }
+
+    K key;
+    V value;
+};
+
+// Allows Hash, which hashes K, to hash an entry by its key.
+template <class K, class V, class Hash>
+class cuckoo_map_key_hash {
+public:
+    cuckoo_map_key_hash(Hash hash)
+        : hash(std::move(hash)) {
+    }
+
+    void reset_hash(int p) {
+        hash.reset_hash(p);
+    }
+
+    int get_hash(const K& key) const {
+        return hash.get_hash(key);
+    }
+
+    int get_hash(const cuckoo_map_entry<K, V>& entry) const {
+        return hash.get_hash(entry.key);
+    }
+
+private:
+    Hash hash;
+};
+
+// Hash has the same requirements as for cuckoo_hashing, but only needs to hash K.
+// V must be default constructible.
+template <class K, class V, class Hash = virtual_hashing_function<K>>
+class cuckoo_map : protected cuckoo_hashing<cuckoo_map_entry<K, V>,
+        cuckoo_map_key_hash<K, V, Hash>> {
+public:
+    cuckoo_map(Hash first_table, Hash second_table, double eps=0.4);
+
+    // Returns nullptr if key isn't in the map.
+    // The pointer is only valid until the next insertion or removal.
+    V* find(const K& key);
+    const V* find(const K& key) const;
+
+    bool contains(const K& key) const { return find(key) != nullptr; }
+
+    // Constructs the value from args, only if key isn't in the map already.
+    // Returns the value for key, and true if it was inserted.
+    template <class... Args>
+    std::pair<V*, bool> emplace(const K& key, Args&&... args);
+
+    // Will insert a default constructed value if key isn't in the map.
+    V& operator[](const K& key);
+
+    // Does nothing if key isn't in the map.
+    void erase(const K& key);
+
+    size_t size() const { return base::size(); }
+
+protected:
+    using entry = cuckoo_map_entry<K, V>;
+    using base = cuckoo_hashing<entry, cuckoo_map_key_hash<K, V, Hash>>;
+};
+
+template <class K, class V, class Hash>
+cuckoo_map<K, V, Hash>::cuckoo_map(Hash first_table, Hash second_table, double eps)
+        : base(std::move(first_table), std::move(second_table), eps) {
+}
+
+template <class K, class V, class Hash>
+V* cuckoo_map<K, V, Hash>::find(const K& key) {
+    typename base::ItemOr* slot = this->find_slot(key);
+    return slot != nullptr ? &slot->item.value : nullptr;
+}
+
+template <class K, class V, class Hash>
+const V* cuckoo_map<K, V, Hash>::find(const K& key) const {
+    const typename base::ItemOr* slot = this->find_slot(key);
+    return slot != nullptr ? &slot->item.value : nullptr;
+}
+
+template <class K, class V, class Hash>
+template <class... Args>
+std::pair<V*, bool> cuckoo_map<K, V, Hash>::emplace(const K& key, Args&&... args) {
+    typename base::ItemOr* slot = this->find_slot(key);
+    if (slot != nullptr) {
+        return std::make_pair(&slot->item.value, false);
+    }
+
+    typename base::ItemOr current(cuckoo_internal::in_place_t{}, key, std::forward<Args>(args)...);
+    slot = this->insert_new_item(&current);
+
+    // Only a rehash while placing the entry loses track of where it went.
+    if (slot == nullptr) {
+        slot = this->find_slot(key);
+    }
+    return std::make_pair(&slot->item.value, true);
+}
+
+template <class K, class V, class Hash>
+V& cuckoo_map<K, V, Hash>::operator[](const K& key) {
+    return *emplace(key).first;
+}
+
+template <class K, class V, class Hash>
+void cuckoo_map<K, V, Hash>::erase(const K& key) {
+    typename base::ItemOr* slot = this->find_slot(key);
+    if (slot != nullptr) {
+        this->remove_slot(slot);
+    }
+}
+
+#endif  // HASH_CUCKOO_MAP_H
@@ -0,0 +1,227 @@
+#include "cuckoo_map.h"
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+using milliseconds = std::chrono::milliseconds;
+using Time = std::chrono::system_clock;
+using std::to_string;
+
+const int NumElementsInserted =        1000000;
+const int EveryIndexRemovedAfterInsert =    10;
+
+using multiply_shift = multiply_shift_hashing_function<int>;
+
+// The rngs aren't randomly seeded, so the tests are repeatable.
+template <class V>
+using test_map = cuckoo_map<int, V, multiply_shift>;
+
+template <class V>
+test_map<V> CreateMap() {
+    return test_map<V>{multiply_shift{std::mt19937_64{}, false},
+        multiply_shift{std::mt19937_64{1}, false}};
+}
+
+void CheckValue(const test_map<std::string>& map, int key, const std::string& expected) {
+    const std::string* value = map.find(key);
+    if (value == nullptr)
+        throw "Expected map to contain " + to_string(key);
+    if (*value != expected)
+        throw "Value for " + to_string(key) + " is " + *value + " but expected " + expected;
+}
+
+void CheckDoesntContain(const test_map<std::string>& map, int key) {
+    if (map.find(key) != nullptr)
+        throw "Expected map to not contain " + to_string(key);
+}
+
+void CheckNumberElements(const test_map<std::string>& map, size_t expected_size) {
+    if (map.size() != expected_size)
+        throw "Map size is wrong: expected " + to_string(expected_size) + " got " + to_string(map.size());
+}
+
+void EmplaceAndFind() {
+    test_map<std::string> map = CreateMap<std::string>();
+
+    std::pair<std::string*, bool> first = map.emplace(1, "one");
+    std::pair<std::string*, bool> second = map.emplace(2, 3, 'b');
+    // Is already in the map, so shouldn't be changed.
+    std::pair<std::string*, bool> duplicate = map.emplace(1, "uno");
+
+    try {
+        if (!first.second || *first.first != "one")
+            throw std::string("First emplace should have inserted one");
+        if (!second.second || *second.first != "bbb")
+            throw std::string("Second emplace should have inserted bbb");
+        if (duplicate.second || *duplicate.first != "one")
+            throw std::string("Duplicate emplace should have returned the existing value");
+
+        CheckValue(map, 1, "one");
+        CheckValue(map, 2, "bbb");
+        CheckDoesntContain(map, 3);
+        CheckNumberElements(map, 2);
+    } catch (std::string& s) {
+        std::cout << "Error in EmplaceAndFind: " << s << '\n';
+        throw s;
+    }
+}
+
+void IndexOperator() {
+    test_map<std::string> map = CreateMap<std::string>();
+
+    map[5] = "five";
+    map[6];
+    map[5] += "!";
+
+    try {
+        CheckValue(map, 5, "five!");
+        // Was default constructed.
+        CheckValue(map, 6, "");
+        CheckNumberElements(map, 2);
+    } catch (std::string& s) {
+        std::cout << "Error in IndexOperator: " << s << '\n';
+        throw s;
+    }
+}
+
+void FindCanModifyValue() {
+    test_map<std::string> map = CreateMap<std::string>();
+
+    map.emplace(7, "seven");
+    *map.find(7) = "SEVEN";
+
+    try {
+        CheckValue(map, 7, "SEVEN");
+    } catch (std::string& s) {
+        std::cout << "Error in FindCanModifyValue: " << s << '\n';
+        throw s;
+    }
+}
+
+void EraseKeys() {
+    test_map<std::string> map = CreateMap<std::string>();
+
+    for (int i = 0; i < 100; ++i) {
+        map[i] = to_string(i);
+    }
+
+    for (int i = 0; i < 100; i += 2) {
+        map.erase(i);
+    }
+    // Wasn't in the map.
+    map.erase(1000);
+
+    try {
+        for (int i = 0; i < 100; ++i) {
+            if (i % 2 == 0)
+                CheckDoesntContain(map, i);
+            else
+                CheckValue(map, i, to_string(i));
+        }
+        CheckNumberElements(map, 50);
+    } catch (std::string& s) {
+        std::cout << "Error in EraseKeys: " << s << '\n';
+        throw s;
+    }
+}
+
+// Keeps values correct through many resizes and rehashes.
+void LargeTest() {
+    test_map<std::string> map = CreateMap<std::string>();
+
+    try {
+        for (int i = 0; i < NumElementsInserted; ++i) {
+            // The returned value must be where the entry ended up after any displacements.
+            std::pair<std::string*, bool> inserted = map.emplace(i, to_string(i));
+            if (!inserted.second || inserted.first != map.find(i))
+                throw "Emplace returned the wrong value for " + to_string(i);
+            if (i % EveryIndexRemovedAfterInsert == 0)
+                map.erase(i);
+        }
+
+        for (int i = 0; i < NumElementsInserted; ++i) {
+            if (i % EveryIndexRemovedAfterInsert == 0)
+                CheckDoesntContain(map, i);
+            else
+                CheckValue(map, i, to_string(i));
+        }
+    } catch (std::string& s) {
+        std::cout << "Error in LargeTest: " << s << '\n';
+        throw s;
+    }
+}
+
+
+milliseconds GetCurrentTime() {
+    return std::chrono::duration_cast<milliseconds >(
+            Time::now().time_since_epoch());
+}
+
+// Looks up the payload for every key, like a join. Only the first half of keys
+// were inserted, with a payload equal to their index.
+template <class Lookup>
+milliseconds TimeLookups(const std::vector<int>& keys, Lookup lookup) {
+    milliseconds start_time = GetCurrentTime();
+    long long sum = 0;
+    for (int round = 0; round < 5; ++round) {
+        for (int key : keys) {
+            sum += lookup(key);
+        }
+    }
+    milliseconds lookup_time = GetCurrentTime() - start_time;
+
+    if (sum != 5LL * NumElementsInserted * (NumElementsInserted - 1) / 2)
+        throw "Lookups found the wrong payloads, sum is " + to_string(sum);
+    return lookup_time;
+}
+
+// Compares cuckoo_map to keeping a cuckoo_hashing set with the payloads in a
+// separate std::unordered_map.
+void RunPayloadBenchmark() {
+    // Scattered (but distinct) keys, so neither has an advantage from consecutive
+    // keys being stored next to each other.
+    std::vector<int> keys;
+    for (unsigned i = 0; i < 2 * NumElementsInserted; ++i) {
+        keys.push_back(i * 2654435761u);
+    }
+
+    test_map<long long> map = CreateMap<long long>();
+
+    cuckoo_hashing<int, multiply_shift> set{multiply_shift{std::mt19937_64{}, false},
+        multiply_shift{std::mt19937_64{1}, false}};
+    std::unordered_map<int, long long> payloads;
+
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        map.emplace(keys[i], i);
+        set.insert(keys[i]);
+        payloads[keys[i]] = i;
+    }
+
+    milliseconds map_time = TimeLookups(keys, [&map](int key) {
+        const long long* value = map.find(key);
+        return value != nullptr ? *value : 0;
+    });
+
+    milliseconds set_time = TimeLookups(keys, [&set, &payloads](int key) {
+        return set.contains(key) ? payloads.find(key)->second : 0;
+    });
+
+    std::cout << "Time for " << NumElementsInserted * 10 << " payload lookups:\n" <<
+        "  cuckoo_map: " << map_time.count() << " ms\n" <<
+        "  cuckoo_hashing + unordered_map: " << set_time.count() << " ms\n";
+}
+
+
+int main() {
+    EmplaceAndFind();
+    IndexOperator();
+    FindCanModifyValue();
+    EraseKeys();
+    LargeTest();
+
+    RunPayloadBenchmark();
+}
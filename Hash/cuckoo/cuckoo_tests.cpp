@@ -3,18 +3,25 @@
 #include <exception>
 
 #include <algorithm>
+#include <array>
+#include <cstdlib>
 #include <iostream>
 #include <limits>
 #include <chrono>
 #include <map>
+#include <new>
 #include <string>
+#include <thread>
 #include <unordered_set>
+#include <utility>
 #include <sstream>
 #include <vector>
 
 
 using milliseconds = std::chrono::milliseconds;
+using nanoseconds = std::chrono::nanoseconds;
 using Time = std::chrono::system_clock;
+using LatencyTime = std::chrono::steady_clock;
 using std::to_string;
 
 const int NumElementsInserted =        1000000;
@@ -22,6 +29,24 @@ const int EveryIndexRemovedAfterInsert =    10;
 const int EveryIndexRemoved =                4;
 
 
+// Counts every allocation, so the benchmarks can check how often items are copied.
+size_t num_allocations = 0;
+
+// Neither is inlined, since GCC would then warn that memory from malloc is given
+// to operator delete, or from operator new to free.
+__attribute__((noinline)) void* operator new(size_t size) {
+    ++num_allocations;
+    if (void* memory = std::malloc(size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+
 // Will stick with mapping every item to the provided index.
 // Can then switch to a different hashing upon the second rehashing.
 class specialized_hashing_function : public hashing_function<int> {
@@ -63,21 +88,31 @@ using wrapped_specialized_hashing_function = std::unique_ptr<specialized_hashing
 // Done differently than other Data Structures since want to get access to the data in the class
 class cuckoo_hashing_tests : public cuckoo_hashing<int> {
 public:
-    cuckoo_hashing_tests(double eps=0.5)
+    cuckoo_hashing_tests(double eps=0.5, size_t stash_size=4)
         : cuckoo_hashing(
             std::unique_ptr<hashing_function<int>>(
                 new basic_hashing_function<int>{std::mt19937{}, true}),
             std::unique_ptr<hashing_function<int>>(
                 new basic_hashing_function<int>{std::mt19937{}, true}),
-            eps) {
+            eps, stash_size) {
     }
 
+    // The specialized hashing function tests count exact rehashes, so don't
+    // use a stash by default.
     cuckoo_hashing_tests(std::unique_ptr<hashing_function<int>> first_table,
         std::unique_ptr<hashing_function<int>> second_table,
-        double eps=0.5)
+        double eps=0.5, size_t stash_size=0)
         : cuckoo_hashing(std::move(first_table),
                 std::move(second_table),
-                eps) {
+                eps, stash_size) {
+    }
+
+    size_t get_stash_size() const {
+        return stash.size();
+    }
+
+    size_t get_slot_size() const {
+        return sizeof(ItemOr);
     }
 
     size_t get_num_resize() const {
@@ -98,7 +133,8 @@ public:
 
     void assert_is_valid() const {
         size_t number_elements =
-            assert_table_is_valid(0) + assert_table_is_valid(1);
+            assert_table_is_valid(0) + assert_table_is_valid(1) + assert_stash_is_valid() +
+            contains_empty_item;
         
         if (size() != number_elements)
             throw "The size wasn't updated properly: is " +
@@ -134,7 +170,7 @@ private:
 
         size_t number_elements = 0;
         for (size_t i = 0; i < table_size; ++i) {
-            if (!tables[table_num][i].contains_item) {
+            if (!tables[table_num][i].contains_item()) {
                 continue;
             }
 
@@ -142,7 +178,7 @@ private:
 
             int item_stored = tables[table_num][i].item;
 
-            size_t hash_using_tables_hash = hashes[table_num]->get_hash(item_stored);
+            size_t hash_using_tables_hash = hashes[table_num].get_hash(item_stored);
             std::flush(std::cout);
             if (i != hash_using_tables_hash)
                 throw "Invalid index to store value " + to_string(item_stored) + ": " +
@@ -153,6 +189,26 @@ private:
         return number_elements;
     }
 
+    size_t assert_stash_is_valid() const {
+        if (stash.size() > max_stash_size)
+            throw "The stash has " + to_string(stash.size()) + " items, but the max is " +
+                to_string(max_stash_size);
+
+        for (const ItemOr& stashed : stash) {
+            if (!stashed.contains_item())
+                throw std::string("The stash has an empty entry");
+
+            for (int table_num = 0; table_num < 2; ++table_num) {
+                const ItemOr& slot = tables[table_num][hashes[table_num].get_hash(stashed.item)];
+                if (slot.contains_item() && slot.item == stashed.item)
+                    throw "Value " + to_string(stashed.item) + " is in both the stash and table " +
+                        to_string(table_num);
+            }
+        }
+
+        return stash.size();
+    }
+
 };
 
 void CheckNumberResize(const cuckoo_hashing_tests& cuckoo, size_t expected_count) {
@@ -350,6 +406,98 @@ void InsertionForcedMultipleRehash() {
     }
 }
 
+void InsertionUsesStash() {
+    // All three items use index 0 in both tables, so one of them can't fit.
+    std::map<int, int> element_to_index{{0, 0}, {1, 0}, {2, 0}, {3, 1}};
+    specialized_hashing_function* first_hash = new specialized_hashing_function(element_to_index);
+    specialized_hashing_function* second_hash = new specialized_hashing_function(element_to_index);
+
+    cuckoo_hashing_tests cuckoo{
+        std::unique_ptr<hashing_function<int>>(first_hash),
+        std::unique_ptr<hashing_function<int>>(second_hash),
+        /*eps=*/0.5,
+        /*stash_size=*/1
+    };
+
+    cuckoo.insert(0);
+    cuckoo.insert(1);
+    cuckoo.insert(2);
+
+    try {
+        for (int i = 0; i < 3; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+        CheckDoesntContainElement(cuckoo, 3);
+
+        CheckNumberElements(cuckoo, 3);
+
+        // Only the initial setup when creating the object, since the stash had room.
+        CheckNumberRehash(cuckoo, 1);
+        if (cuckoo.get_stash_size() != 1)
+            throw "Expected one stashed item, got " + to_string(cuckoo.get_stash_size());
+
+        cuckoo.assert_is_valid();
+
+        // Whichever item was stashed, removing all of them must also empty the stash.
+        for (int i = 0; i < 3; ++i) {
+            cuckoo.remove(i);
+            CheckDoesntContainElement(cuckoo, i);
+        }
+
+        CheckNumberElements(cuckoo, 0);
+        if (cuckoo.get_stash_size() != 0)
+            throw "Expected the stash to be empty, has " + to_string(cuckoo.get_stash_size());
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in InsertionUsesStash: " << s << '\n';
+        throw s;
+    }
+}
+
+// The value used to mark empty slots is stored outside of the tables.
+void InsertionOfEmptyItem() {
+    cuckoo_hashing_tests cuckoo;
+    const int empty_item = std::numeric_limits<int>::max();
+
+    try {
+        if (cuckoo.get_slot_size() != sizeof(int))
+            throw "Slots for int should be " + to_string(sizeof(int)) + " bytes, are " +
+                to_string(cuckoo.get_slot_size());
+
+        CheckDoesntContainElement(cuckoo, empty_item);
+
+        cuckoo.insert(empty_item);
+        cuckoo.insert(empty_item);
+        cuckoo.insert(5);
+        std::vector<int> items{empty_item, 6};
+        cuckoo.insert_bulk(items.begin(), items.end());
+
+        CheckContainsElement(cuckoo, empty_item);
+        CheckContainsElement(cuckoo, 5);
+        CheckContainsElement(cuckoo, 6);
+        CheckNumberElements(cuckoo, 3);
+
+        int keys[] = {empty_item, 5, 7};
+        uint64_t bits = 0;
+        cuckoo.contains_batch(keys, 3, &bits);
+        if (bits != 3)
+            throw "contains_batch found " + to_string(bits) + " rather than 3";
+
+        cuckoo.assert_is_valid();
+
+        cuckoo.remove(empty_item);
+        CheckDoesntContainElement(cuckoo, empty_item);
+        CheckContainsElement(cuckoo, 5);
+        CheckNumberElements(cuckoo, 2);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in InsertionOfEmptyItem: " << s << '\n';
+        throw s;
+    }
+}
+
 void InsertionAlreadyContainsItem() {
     // Will only be inserting 0, and want to make sure it only contains it once.
     cuckoo_hashing_tests cuckoo{
@@ -417,6 +565,608 @@ void InsertionForceTableResize() {
 
 }
 
+void BulkInsertion() {
+    cuckoo_hashing_tests cuckoo;
+    cuckoo.insert(3);
+
+    // Includes duplicates, both within the items and with what was already inserted.
+    std::vector<int> items;
+    for (int i = 0; i < 1000; ++i) {
+        items.push_back(i % 500);
+    }
+    cuckoo.insert_bulk(items.begin(), items.end());
+
+    try {
+        for (int i = 0; i < 500; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+
+        CheckDoesntContainElement(cuckoo, 500);
+
+        CheckNumberElements(cuckoo, 500);
+
+        // Initial setup when creating the object, and a single resize for the batch.
+        CheckNumberResize(cuckoo, 2);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in BulkInsertion: " << s << '\n';
+        throw s;
+    }
+}
+
+// Items which are already in the stash mustn't be inserted a second time.
+void BulkInsertionOfStashedItem() {
+    // All three items use index 0 in both tables, so one of them is stashed.
+    std::map<int, int> element_to_index{{1, 0}, {2, 0}, {3, 0}};
+    cuckoo_hashing_tests cuckoo{
+        std::unique_ptr<hashing_function<int>>(
+            new specialized_hashing_function(element_to_index)),
+        std::unique_ptr<hashing_function<int>>(
+            new specialized_hashing_function(element_to_index)),
+        /*eps=*/0.5,
+        /*stash_size=*/4
+    };
+
+    cuckoo.insert(1);
+    cuckoo.insert(2);
+    cuckoo.insert(3);
+
+    try {
+        if (cuckoo.get_stash_size() != 1)
+            throw "Expected one stashed item, got " + to_string(cuckoo.get_stash_size());
+
+        std::vector<int> items{1, 2, 3};
+        cuckoo.insert_bulk(items.begin(), items.end());
+        CheckNumberElements(cuckoo, 3);
+        cuckoo.assert_is_valid();
+
+        for (int i = 1; i <= 3; ++i) {
+            cuckoo.remove(i);
+            CheckDoesntContainElement(cuckoo, i);
+        }
+        CheckNumberElements(cuckoo, 0);
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in BulkInsertionOfStashedItem: " << s << '\n';
+        throw s;
+    }
+}
+
+void ContainsBatch() {
+    cuckoo_hashing_tests cuckoo;
+
+    // Every third key is in the set. Uses more than one word of bits, and a
+    // partial last word.
+    std::vector<int> keys;
+    for (int i = 0; i < 150; ++i) {
+        keys.push_back(i);
+        if (i % 3 == 0)
+            cuckoo.insert(i);
+    }
+
+    // The bits past the last key should be cleared.
+    std::vector<uint64_t> bits(3, ~0ULL);
+    cuckoo.contains_batch(keys.data(), keys.size(), bits.data());
+
+    try {
+        for (int i = 0; i < 192; ++i) {
+            bool is_set = (bits[i / 64] >> (i % 64)) & 1;
+            bool expected = i < 150 && i % 3 == 0;
+            if (is_set != expected)
+                throw "Bit " + to_string(i) + " is " + to_string(is_set) +
+                    " but expected " + to_string(expected);
+        }
+    } catch (std::string& s) {
+        std::cout << "Error in ContainsBatch: " << s << '\n';
+        throw s;
+    }
+}
+
+void ReserveAvoidsResizes() {
+    cuckoo_hashing_tests cuckoo;
+
+    cuckoo.reserve(1000);
+    // Already large enough.
+    cuckoo.reserve(10);
+
+    for (int i = 0; i < 1000; ++i) {
+        cuckoo.insert(i);
+    }
+
+    try {
+        for (int i = 0; i < 1000; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+
+        CheckNumberElements(cuckoo, 1000);
+
+        // Initial setup when creating the object, and the reserve.
+        CheckNumberResize(cuckoo, 2);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in ReserveAvoidsResizes: " << s << '\n';
+        throw s;
+    }
+}
+
+using multiply_shift = multiply_shift_hashing_function<int>;
+
+// The rngs aren't randomly seeded, so the tests are repeatable.
+multiply_shift CreateMultiplyShift(unsigned seed) {
+    return multiply_shift{std::mt19937_64{seed}, false};
+}
+
+// multiply_shift has no default constructor, so the arrays are listed out.
+template <size_t NumTables>
+std::array<multiply_shift, NumTables> CreateTableHashes();
+
+template <>
+std::array<multiply_shift, 2> CreateTableHashes<2>() {
+    return {{CreateMultiplyShift(0), CreateMultiplyShift(1)}};
+}
+
+template <>
+std::array<multiply_shift, 3> CreateTableHashes<3>() {
+    return {{CreateMultiplyShift(0), CreateMultiplyShift(1), CreateMultiplyShift(2)}};
+}
+
+template <>
+std::array<multiply_shift, 4> CreateTableHashes<4>() {
+    return {{CreateMultiplyShift(0), CreateMultiplyShift(1), CreateMultiplyShift(2),
+        CreateMultiplyShift(3)}};
+}
+
+// Checks the tables of a cuckoo_hashing with any number of tables.
+template <size_t NumTables>
+class cuckoo_tables_tests : public cuckoo_hashing<int, multiply_shift, NumTables> {
+public:
+    using base = cuckoo_hashing<int, multiply_shift, NumTables>;
+
+    using base::max_load_factor;
+
+    cuckoo_tables_tests(double eps=0.4)
+        : base(CreateTableHashes<NumTables>(), eps) {
+    }
+
+    cuckoo_tables_tests(std::array<multiply_shift, NumTables> table_hashes, double eps)
+        : base(std::move(table_hashes), eps) {
+    }
+
+    size_t get_num_resize() const {
+        return this->num_resize;
+    }
+
+    size_t get_num_rehash() const {
+        return this->num_rehash;
+    }
+
+    int get_number_inserts_required_to_increase_tablesize() const {
+        return this->max_number_elements - this->num_elements + 1;
+    }
+
+    size_t memory_used() const {
+        return NumTables * this->table_size * sizeof(typename base::ItemOr);
+    }
+
+    // Fills every slot of item, then counts which table each of num_tries inserts
+    // of it evicts from first. The tables are restored afterwards.
+    std::array<int, NumTables> count_first_evictions(int item, int num_tries) {
+        using ItemOr = typename base::ItemOr;
+
+        std::array<ItemOr, NumTables> previous;
+        for (size_t table = 0; table < NumTables; ++table) {
+            ItemOr& slot = this->tables[table][this->hashes[table].get_hash(item)];
+            previous[table] = slot;
+            slot = ItemOr{item + 1 + static_cast<int>(table), true};
+        }
+
+        const int max_loop = this->max_loop;
+        this->max_loop = 1;
+        std::array<int, NumTables> counts{};
+        for (int i = 0; i < num_tries; ++i) {
+            ItemOr current{item, true};
+            this->attempt_to_insert_item(&current);
+            for (size_t table = 0; table < NumTables; ++table) {
+                ItemOr& slot = this->tables[table][this->hashes[table].get_hash(item)];
+                if (slot.contains_item() && slot.item == item) {
+                    ++counts[table];
+                    slot = current;
+                }
+            }
+        }
+        this->max_loop = max_loop;
+
+        for (size_t table = 0; table < NumTables; ++table) {
+            this->tables[table][this->hashes[table].get_hash(item)] = previous[table];
+        }
+        return counts;
+    }
+
+    void assert_is_valid() const {
+        size_t number_elements = this->stash.size() + this->contains_empty_item;
+        for (size_t table = 0; table < NumTables; ++table) {
+            for (size_t i = 0; i < this->table_size; ++i) {
+                if (!this->tables[table][i].contains_item()) {
+                    continue;
+                }
+
+                ++number_elements;
+                size_t hash_using_tables_hash = this->hashes[table].get_hash(this->tables[table][i].item);
+                if (i != hash_using_tables_hash)
+                    throw "Invalid index to store value " + to_string(this->tables[table][i].item) +
+                        " in table " + to_string(table) + ": at index " + to_string(i) +
+                        " but hashes to " + to_string(hash_using_tables_hash);
+            }
+        }
+
+        if (this->size() != number_elements)
+            throw "The size wasn't updated properly: is " +
+                to_string(number_elements) + " while reports " + to_string(this->size());
+
+        if (number_elements > this->max_number_elements)
+            throw "Table should have been resized, number elements is " + to_string(number_elements) +
+                " vs max of " + to_string(this->max_number_elements);
+
+        // At most max_load_factor() / (1 + eps) of the slots can be used.
+        if (this->max_number_elements * (1 + this->eps) >
+                NumTables * this->table_size * base::max_load_factor() + 1)
+            throw "The maximum of " + to_string(this->max_number_elements) +
+                " elements is too many for tables of size " + to_string(this->table_size);
+    }
+};
+
+// Every table is used, and the tables can be filled up to their maximum load
+// factor without failing inserts.
+template <size_t NumTables>
+void InsertionWithMoreTables() {
+    cuckoo_tables_tests<NumTables> cuckoo(/*eps=*/0.1);
+
+    // Fill the tables right up to the point of resizing.
+    int to_insert = 0;
+    while (cuckoo.get_num_resize() < 8) {
+        cuckoo.insert(to_insert++);
+    }
+    int remaining = cuckoo.get_number_inserts_required_to_increase_tablesize() - 1;
+    for (int i = 0; i < remaining; ++i) {
+        cuckoo.insert(to_insert++);
+    }
+
+    try {
+        for (int i = 0; i < to_insert; ++i) {
+            if (!cuckoo.contains(i))
+                throw "Expected cuckoo to contain " + to_string(i);
+        }
+        if (cuckoo.contains(to_insert))
+            throw "Expected cuckoo to not contain " + to_string(to_insert);
+
+        double expected_load_factor = 0.9 * cuckoo_tables_tests<NumTables>::max_load_factor() / 1.1;
+        if (cuckoo.load_factor() < expected_load_factor)
+            throw "Tables were only filled to a load factor of " + to_string(cuckoo.load_factor()) +
+                ", expected at least " + to_string(expected_load_factor);
+
+        cuckoo.assert_is_valid();
+
+        for (int i = 0; i < to_insert; i += 3) {
+            cuckoo.remove(i);
+        }
+        for (int i = 0; i < to_insert; ++i) {
+            if (cuckoo.contains(i) != (i % 3 != 0))
+                throw "Wrong result for contains(" + to_string(i) + ") after removing";
+        }
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in InsertionWithMoreTables<" << NumTables << ">: " << s << '\n';
+        throw s;
+    }
+}
+
+// When all of an item's slots are full, the item it evicts is chosen from every
+// table, including the last one.
+template <size_t NumTables>
+void EvictionsUseEveryTable() {
+    cuckoo_tables_tests<NumTables> cuckoo;
+
+    try {
+        const std::array<int, NumTables> counts = cuckoo.count_first_evictions(5, 1000);
+        for (size_t table = 0; table < NumTables; ++table) {
+            // Each table is expected 1000 / NumTables times.
+            if (counts[table] < static_cast<int>(1000 / NumTables / 2))
+                throw "Evicted from table " + to_string(table) + " only " +
+                    to_string(counts[table]) + " times out of 1000";
+        }
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in EvictionsUseEveryTable<" << NumTables << ">: " << s << '\n';
+        throw s;
+    }
+}
+
+// With bounds on eps, it should shrink while the inserts go well, so the tables
+// use less memory than with a fixed eps.
+void AdaptiveEps() {
+    cuckoo_tables_tests<2> fixed_cuckoo(/*eps=*/0.4);
+    cuckoo_tables_tests<2> adaptive_cuckoo(/*eps=*/0.4);
+    adaptive_cuckoo.set_eps_bounds(0.05, 0.4);
+
+    const int num_inserted = 100000;
+    for (int i = 0; i < num_inserted; ++i) {
+        fixed_cuckoo.insert(i);
+        adaptive_cuckoo.insert(i);
+    }
+
+    try {
+        for (int i = 0; i < num_inserted; ++i) {
+            if (!adaptive_cuckoo.contains(i))
+                throw "Expected cuckoo to contain " + to_string(i);
+        }
+        fixed_cuckoo.assert_is_valid();
+        adaptive_cuckoo.assert_is_valid();
+
+        if (fixed_cuckoo.get_eps() != 0.4)
+            throw "Fixed eps changed to " + to_string(fixed_cuckoo.get_eps());
+        if (adaptive_cuckoo.get_eps() >= 0.4 || adaptive_cuckoo.get_eps() < 0.05)
+            throw "Adaptive eps should have shrunk within its bounds, is " +
+                to_string(adaptive_cuckoo.get_eps());
+        if (adaptive_cuckoo.memory_used() >= fixed_cuckoo.memory_used())
+            throw "Adaptive eps uses " + to_string(adaptive_cuckoo.memory_used()) +
+                " bytes, vs " + to_string(fixed_cuckoo.memory_used()) + " with a fixed eps";
+
+        // Raising the bounds moves eps into them, and the tables grow on the next insert.
+        const size_t num_resize = adaptive_cuckoo.get_num_resize();
+        adaptive_cuckoo.set_eps_bounds(1.0, 2.0);
+        if (adaptive_cuckoo.get_eps() != 1.0)
+            throw "Eps should have been raised to 1, is " + to_string(adaptive_cuckoo.get_eps());
+        adaptive_cuckoo.insert(num_inserted);
+        if (adaptive_cuckoo.get_num_resize() != num_resize + 1)
+            throw std::string("Expected the tables to grow for the larger eps");
+        adaptive_cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in AdaptiveEps: " << s << '\n';
+        throw s;
+    }
+}
+
+void InsertionRecordsStats() {
+    static_assert(std::is_empty<cuckoo_no_stats>::value, "The default stats shouldn't store anything");
+
+    cuckoo_hashing<int, multiply_shift, 2, cuckoo_stats> cuckoo{
+        CreateMultiplyShift(0), CreateMultiplyShift(1)};
+
+    const int num_inserted = 10000;
+    for (int i = 0; i < num_inserted; ++i) {
+        cuckoo.insert(i);
+    }
+    // Half of the lookups are misses.
+    for (int i = 0; i < 2 * num_inserted; ++i) {
+        cuckoo.contains(i);
+    }
+
+    try {
+        const cuckoo_stats& stats = cuckoo.get_stats();
+        if (stats.num_inserts != num_inserted)
+            throw "Expected " + to_string(num_inserted) + " inserts, got " + to_string(stats.num_inserts);
+
+        size_t histogram_total = 0;
+        for (size_t count : stats.displacement_histogram) {
+            histogram_total += count;
+        }
+        if (histogram_total != stats.num_inserts)
+            throw "The histogram has " + to_string(histogram_total) + " inserts";
+        if (stats.displacement_histogram[0] == 0 || stats.displacement_histogram[0] == histogram_total)
+            throw "Expected some inserts to displace items, and some to not";
+
+        // Every insert also looked the item up.
+        if (stats.num_lookups != 3 * num_inserted)
+            throw "Expected " + to_string(3 * num_inserted) + " lookups, got " + to_string(stats.num_lookups);
+        // Hits take 1 or 2 probes, and misses at least 2.
+        if (stats.average_probes_per_lookup() < 1.5 || stats.average_probes_per_lookup() > 2 + 4)
+            throw "Average of " + to_string(stats.average_probes_per_lookup()) + " probes per lookup";
+
+        // Every resize also rehashes.
+        if (stats.num_resize < 2 || stats.num_rehash < stats.num_resize)
+            throw "Recorded " + to_string(stats.num_resize) + " resizes and " +
+                to_string(stats.num_rehash) + " rehashes";
+        if (stats.resize_time < stats.rehash_time / 2)
+            throw std::string("Resizes should take at least as long as the rehashes they do");
+
+        if (cuckoo.load_factor() <= 0 || cuckoo.load_factor() > 0.5)
+            throw "Load factor of " + to_string(cuckoo.load_factor());
+    } catch (std::string& s) {
+        std::cout << "Error in InsertionRecordsStats: " << s << '\n';
+        throw s;
+    }
+}
+
+// Can only be moved, so cuckoo_hashing fails to compile if it ever copies an item
+// that was inserted with insert(T&&) or emplace.
+struct move_only_key {
+    // Only used for empty slots.
+    move_only_key() = default;
+
+    explicit move_only_key(int value)
+        : value(new int(value)) {
+    }
+
+    bool operator==(const move_only_key& other) const {
+        return *value == *other.value;
+    }
+
+    std::unique_ptr<int> value;
+};
+
+class move_only_key_hash {
+public:
+    move_only_key_hash(multiply_shift hash)
+        : hash(std::move(hash)) {
+    }
+
+    void reset_hash(int p) {
+        hash.reset_hash(p);
+    }
+
+    int get_hash(const move_only_key& key) const {
+        return hash.get_hash(*key.value);
+    }
+
+private:
+    multiply_shift hash;
+};
+
+// Enough items for resizes, rehashes and the stash to all move items around.
+void InsertionOfMoveOnlyItems() {
+    cuckoo_hashing<move_only_key, move_only_key_hash> cuckoo{
+        move_only_key_hash{CreateMultiplyShift(0)}, move_only_key_hash{CreateMultiplyShift(1)},
+        /*eps=*/0.1};
+
+    const int num_inserted = 10000;
+    for (int i = 0; i < num_inserted; ++i) {
+        if (i % 2 == 0)
+            cuckoo.insert(move_only_key{i});
+        else
+            cuckoo.emplace(i);
+    }
+    cuckoo.emplace(0);
+
+    try {
+        for (int i = 0; i < num_inserted; ++i) {
+            if (!cuckoo.contains(move_only_key{i}))
+                throw "Expected cuckoo to contain " + to_string(i);
+        }
+        if (cuckoo.size() != num_inserted)
+            throw "Cuckoo size is wrong: expected " + to_string(num_inserted) + " got " +
+                to_string(cuckoo.size());
+
+        for (int i = 0; i < num_inserted; i += 2) {
+            cuckoo.remove(move_only_key{i});
+        }
+        for (int i = 0; i < num_inserted; ++i) {
+            if (cuckoo.contains(move_only_key{i}) != (i % 2 == 1))
+                throw "Wrong result for contains(" + to_string(i) + ") after removing";
+        }
+    } catch (std::string& s) {
+        std::cout << "Error in InsertionOfMoveOnlyItems: " << s << '\n';
+        throw s;
+    }
+}
+
+// Every item is visited exactly once, including stashed items and the empty item.
+void IterateOverItems() {
+    // All three items use index 0 in both tables, so one of them is stashed.
+    std::map<int, int> element_to_index{{0, 0}, {1, 0}, {2, 0}, {3, 1}};
+    cuckoo_hashing_tests cuckoo{
+        std::unique_ptr<hashing_function<int>>(new specialized_hashing_function(element_to_index)),
+        std::unique_ptr<hashing_function<int>>(new specialized_hashing_function(element_to_index)),
+        /*eps=*/0.5,
+        /*stash_size=*/1
+    };
+
+    try {
+        if (cuckoo.begin() != cuckoo.end())
+            throw std::string("Iterating over an empty set visited an item");
+
+        for (int i = 0; i < 4; ++i) {
+            cuckoo.insert(i);
+        }
+        cuckoo.insert(std::numeric_limits<int>::max());
+        if (cuckoo.get_stash_size() != 1)
+            throw "Expected one stashed item, got " + to_string(cuckoo.get_stash_size());
+
+        std::vector<int> items(cuckoo.begin(), cuckoo.end());
+        std::sort(items.begin(), items.end());
+        std::vector<int> expected_items{0, 1, 2, 3, std::numeric_limits<int>::max()};
+        if (items != expected_items)
+            throw "Iterated over " + to_string(items.size()) + " items instead of 0, 1, 2, 3 "
+                "and the empty item";
+
+        cuckoo.remove(std::numeric_limits<int>::max());
+        size_t num_items = 0;
+        for (int item : cuckoo) {
+            if (item == std::numeric_limits<int>::max())
+                throw std::string("Visited the empty item after removing it");
+            ++num_items;
+        }
+        if (num_items != 4)
+            throw "Expected to visit 4 items, visited " + to_string(num_items);
+    } catch (std::string& s) {
+        std::cout << "Error in IterateOverItems: " << s << '\n';
+        throw s;
+    }
+}
+
+// The chunks cover every item exactly once, whatever their size, and can be
+// iterated by several threads at once.
+void IterateInChunks() {
+    cuckoo_hashing_tests cuckoo;
+    std::vector<int> expected_items;
+    for (int i = 0; i < 10000; ++i) {
+        if (i % EveryIndexRemoved != 0) {
+            cuckoo.insert(i);
+            expected_items.push_back(i);
+        }
+    }
+    cuckoo.insert(std::numeric_limits<int>::max());
+    expected_items.push_back(std::numeric_limits<int>::max());
+
+    try {
+        for (size_t chunk_size : {1, 7, 64, 1 << 20}) {
+            std::vector<int> items;
+            cuckoo.for_each_chunk([&items](cuckoo_hashing_tests::const_iterator first,
+                    cuckoo_hashing_tests::const_iterator last) {
+                items.insert(items.end(), first, last);
+            }, chunk_size);
+
+            std::sort(items.begin(), items.end());
+            if (items != expected_items)
+                throw "Chunks of " + to_string(chunk_size) + " slots visited " +
+                    to_string(items.size()) + " items, expected " + to_string(expected_items.size());
+        }
+
+        using chunk = std::pair<cuckoo_hashing_tests::const_iterator,
+            cuckoo_hashing_tests::const_iterator>;
+        std::vector<chunk> chunks;
+        cuckoo.for_each_chunk([&chunks](cuckoo_hashing_tests::const_iterator first,
+                cuckoo_hashing_tests::const_iterator last) {
+            chunks.emplace_back(first, last);
+        }, 256);
+
+        // Thread t sums every num_threads-th chunk.
+        const size_t num_threads = 4;
+        std::vector<int64_t> sums(num_threads, 0);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&chunks, &sums, t, num_threads]() {
+                for (size_t c = t; c < chunks.size(); c += num_threads) {
+                    for (auto it = chunks[c].first; it != chunks[c].second; ++it) {
+                        sums[t] += *it;
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        int64_t sum = 0;
+        for (int64_t thread_sum : sums) {
+            sum += thread_sum;
+        }
+        int64_t expected_sum = 0;
+        for (int item : expected_items) {
+            expected_sum += item;
+        }
+        if (sum != expected_sum)
+            throw "Summing the chunks in threads gave " + to_string(sum) + ", expected " +
+                to_string(expected_sum);
+    } catch (std::string& s) {
+        std::cout << "Error in IterateInChunks: " << s << '\n';
+        throw s;
+    }
+}
+
 void RemoveItemSimple() {
     cuckoo_hashing_tests cuckoo;
 
@@ -641,6 +1391,10 @@ public:
     cuckoo_wrapper()
     {}
 
+    cuckoo_wrapper(size_t stash_size)
+        : cuckoo(/*eps=*/0.5, stash_size) {
+    }
+
     cuckoo_wrapper(std::unique_ptr<hashing_function<int>> first_hash,
             std::unique_ptr<hashing_function<int>> second_hash)
         : cuckoo(std::move(first_hash),
@@ -655,6 +1409,12 @@ public:
     
     void check_valid() const override { cuckoo.assert_is_valid(); }
 
+    // Every resize also does a rehash, so these are only the rehashes for
+    // inserts that couldn't be placed.
+    size_t get_num_failed_insert_rehash() const {
+        return cuckoo.get_num_rehash() - cuckoo.get_num_resize();
+    }
+
 private:
     cuckoo_hashing_tests cuckoo;
 };
@@ -727,16 +1487,544 @@ milliseconds RunLargeTest(hash_wrapper* hash) {
     return operations_time;
 }
 
+// Does the same insertions, lookups and removals as RunLargeTest, but calls cuckoo
+// directly rather than through hash_wrapper so that the only virtual calls are
+// from Hash.
+template <class Hash>
+milliseconds RunHashDispatchBenchmark(cuckoo_hashing<int, Hash>* cuckoo) {
+    milliseconds start_time = GetCurrentTime();
+
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        cuckoo->insert(i);
+        if (!cuckoo->contains(i))
+            throw "Something funky happened, lost element " + to_string(i) + " during insertion";
+        if (i % EveryIndexRemovedAfterInsert == 0)
+            cuckoo->remove(i);
+    }
+
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        if (i % EveryIndexRemovedAfterInsert != 0 && !cuckoo->contains(i))
+            throw "Hash didn't include " + to_string(i);
+    }
 
+    return GetCurrentTime() - start_time;
+}
+
+// Loads NumElementsInserted scattered keys into an empty set, either one at a time
+// or with a single insert_bulk.
+template <class Hash>
+milliseconds RunBulkInsertBenchmark(Hash first_hash, Hash second_hash, bool use_bulk) {
+    std::vector<int> keys;
+    for (unsigned i = 0; i < NumElementsInserted; ++i) {
+        keys.push_back(i * 2654435761u);
+    }
+
+    cuckoo_hashing<int, Hash> cuckoo{std::move(first_hash), std::move(second_hash)};
+
+    milliseconds start_time = GetCurrentTime();
+    if (use_bulk) {
+        cuckoo.insert_bulk(keys.begin(), keys.end());
+    } else {
+        for (int key : keys) {
+            cuckoo.insert(key);
+        }
+    }
+    milliseconds insert_time = GetCurrentTime() - start_time;
+
+    for (int key : keys) {
+        if (!cuckoo.contains(key))
+            throw "Bulk insert benchmark lost " + to_string(key);
+    }
+    return insert_time;
+}
+
+// Looks up NumElementsInserted scattered keys, half of which are misses, either
+// one at a time or with contains_batch.
+template <class Hash>
+milliseconds RunBatchLookupBenchmark(Hash first_hash, Hash second_hash, bool use_batch) {
+    std::vector<int> keys;
+    for (unsigned i = 0; i < 2 * NumElementsInserted; ++i) {
+        keys.push_back(i * 2654435761u);
+    }
+
+    cuckoo_hashing<int, Hash> cuckoo{std::move(first_hash), std::move(second_hash)};
+    cuckoo.insert_bulk(keys.begin(), keys.begin() + NumElementsInserted);
+
+    std::vector<uint64_t> bits((keys.size() + 63) / 64);
+    size_t num_found = 0;
+
+    milliseconds start_time = GetCurrentTime();
+    for (int round = 0; round < 5; ++round) {
+        if (use_batch) {
+            cuckoo.contains_batch(keys.data(), keys.size(), bits.data());
+            for (uint64_t word : bits) {
+                num_found += __builtin_popcountll(word);
+            }
+        } else {
+            for (int key : keys) {
+                num_found += cuckoo.contains(key);
+            }
+        }
+    }
+    milliseconds lookup_time = GetCurrentTime() - start_time;
+
+    if (num_found != 5 * static_cast<size_t>(NumElementsInserted))
+        throw "Batch lookup benchmark found " + to_string(num_found) + " keys";
+    return lookup_time;
+}
+
+// Fills tables sized for NumElementsInserted scattered keys up to their maximum
+// load, one key at a time, then looks up 10 times as many keys, half of which are
+// misses.
+template <size_t NumTables>
+void RunNumTablesBenchmark(double eps) {
+    cuckoo_tables_tests<NumTables> cuckoo(eps);
+    // Tables are resized to be half full.
+    cuckoo.reserve(NumElementsInserted / 2);
+    const int num_inserted = std::min(NumElementsInserted,
+        cuckoo.get_number_inserts_required_to_increase_tablesize() - 1);
+
+    std::vector<int> keys;
+    for (int i = 0; i < 2 * num_inserted; ++i) {
+        keys.push_back(i * 2654435761u);
+    }
+
+    milliseconds start_time = GetCurrentTime();
+    for (int i = 0; i < num_inserted; ++i) {
+        cuckoo.insert(keys[i]);
+    }
+    milliseconds insert_time = GetCurrentTime() - start_time;
+
+    size_t num_found = 0;
+    start_time = GetCurrentTime();
+    for (int round = 0; round < 5; ++round) {
+        for (int key : keys) {
+            num_found += cuckoo.contains(key);
+        }
+    }
+    milliseconds lookup_time = GetCurrentTime() - start_time;
+
+    if (num_found != 5 * static_cast<size_t>(num_inserted))
+        throw "Number of tables benchmark found " + to_string(num_found) + " keys";
+
+    std::cout << "  " << NumTables << " tables, eps " << eps << ": " << num_inserted <<
+        " inserts " << insert_time.count() << " ms, lookups " << lookup_time.count() << " ms, " <<
+        static_cast<double>(cuckoo.memory_used()) / num_inserted << " bytes per key, load factor " <<
+        cuckoo.load_factor() << ", " << cuckoo.get_num_rehash() - cuckoo.get_num_resize() <<
+        " rehashes from failed inserts.\n";
+}
+
+// Inserts NumElementsInserted scattered keys with eps starting at max_eps, and
+// adapting down to min_eps. The memory used jumps at every resize, so is averaged
+// over the second half of the inserts. The results depend a lot on the hashing
+// functions, so prints the average and range over NumAdaptiveEpsSeeds seeds.
+const int NumAdaptiveEpsSeeds = 10;
+
+void RunAdaptiveEpsBenchmark(double min_eps, double max_eps) {
+    const int num_samples = 100;
+    milliseconds total_time(0);
+    double total_bytes_per_key = 0;
+    double min_bytes_per_key = std::numeric_limits<double>::max();
+    double max_bytes_per_key = 0;
+    size_t total_rehashes = 0;
+    size_t min_rehashes = std::numeric_limits<size_t>::max();
+    size_t max_rehashes = 0;
+    double total_final_eps = 0;
+
+    for (int seed = 0; seed < NumAdaptiveEpsSeeds; ++seed) {
+        cuckoo_tables_tests<2> cuckoo({{CreateMultiplyShift(2 * seed),
+            CreateMultiplyShift(2 * seed + 1)}}, max_eps);
+        cuckoo.set_eps_bounds(min_eps, max_eps);
+
+        double bytes_per_key = 0;
+        milliseconds start_time = GetCurrentTime();
+        for (int i = 0; i < NumElementsInserted; ++i) {
+            cuckoo.insert(i * 2654435761u);
+            if (i >= NumElementsInserted / 2 && i % (NumElementsInserted / 2 / num_samples) == 0) {
+                bytes_per_key += static_cast<double>(cuckoo.memory_used()) / cuckoo.size() / num_samples;
+            }
+        }
+        total_time += GetCurrentTime() - start_time;
+
+        const size_t rehashes = cuckoo.get_num_rehash() - cuckoo.get_num_resize();
+        total_bytes_per_key += bytes_per_key;
+        min_bytes_per_key = std::min(min_bytes_per_key, bytes_per_key);
+        max_bytes_per_key = std::max(max_bytes_per_key, bytes_per_key);
+        total_rehashes += rehashes;
+        min_rehashes = std::min(min_rehashes, rehashes);
+        max_rehashes = std::max(max_rehashes, rehashes);
+        total_final_eps += cuckoo.get_eps();
+    }
+
+    std::cout << "  eps in [" << min_eps << ", " << max_eps << "]: " <<
+        total_time.count() / NumAdaptiveEpsSeeds << " ms, " <<
+        total_bytes_per_key / NumAdaptiveEpsSeeds << " bytes per key on average (" <<
+        min_bytes_per_key << " - " << max_bytes_per_key << "), " <<
+        static_cast<double>(total_rehashes) / NumAdaptiveEpsSeeds << " rehashes from failed inserts (" <<
+        min_rehashes << " - " << max_rehashes << "), final eps " <<
+        total_final_eps / NumAdaptiveEpsSeeds << ".\n";
+}
+
+// Exposes the rehashes from failed inserts of a cuckoo_hashing with any Hash.
+template <class Hash>
+class cuckoo_stash_tests : public cuckoo_hashing<int, Hash> {
+public:
+    cuckoo_stash_tests(int seed, double eps, size_t stash_size)
+        : cuckoo_hashing<int, Hash>(Hash{std::mt19937_64(2 * seed), false},
+            Hash{std::mt19937_64(2 * seed + 1), false}, eps, stash_size) {
+    }
+
+    size_t get_num_failed_insert_rehash() const {
+        return this->num_rehash - this->num_resize;
+    }
+};
+
+// Inserts NumElementsInserted scattered keys with and without a stash, then looks
+// up as many keys which weren't inserted, over NumAdaptiveEpsSeeds seeds.
+template <class Hash>
+void RunStashBenchmark(const std::string& hash_name, double eps) {
+    for (size_t stash_size : {0, 4}) {
+        milliseconds insert_time(0);
+        milliseconds miss_time(0);
+        size_t total_rehashes = 0;
+        size_t min_rehashes = std::numeric_limits<size_t>::max();
+        size_t max_rehashes = 0;
+        size_t num_found = 0;
+
+        for (int seed = 0; seed < NumAdaptiveEpsSeeds; ++seed) {
+            cuckoo_stash_tests<Hash> cuckoo(seed, eps, stash_size);
+
+            milliseconds start_time = GetCurrentTime();
+            for (int i = 0; i < NumElementsInserted; ++i) {
+                cuckoo.insert(i * 2654435761u);
+            }
+            insert_time += GetCurrentTime() - start_time;
+
+            start_time = GetCurrentTime();
+            for (int i = NumElementsInserted; i < 2 * NumElementsInserted; ++i) {
+                num_found += cuckoo.contains(i * 2654435761u);
+            }
+            miss_time += GetCurrentTime() - start_time;
+
+            const size_t rehashes = cuckoo.get_num_failed_insert_rehash();
+            total_rehashes += rehashes;
+            min_rehashes = std::min(min_rehashes, rehashes);
+            max_rehashes = std::max(max_rehashes, rehashes);
+        }
+
+        if (num_found != 0)
+            throw "Stash benchmark found " + to_string(num_found) + " keys which weren't inserted";
+
+        std::cout << "  " << hash_name << ", eps " << eps << ", stash of " << stash_size << ": " <<
+            static_cast<double>(total_rehashes) / NumAdaptiveEpsSeeds <<
+            " rehashes from failed inserts (" << min_rehashes << " - " << max_rehashes << "), " <<
+            insert_time.count() / NumAdaptiveEpsSeeds << " ms inserting, " <<
+            miss_time.count() / NumAdaptiveEpsSeeds << " ms for misses.\n";
+    }
+}
+
+void PrintStats(const cuckoo_no_stats& stats, double eps, double load_factor) {}
+
+void PrintStats(const cuckoo_stats& stats, double eps, double load_factor) {
+    std::cout << "Stats with eps " << eps << ", load factor " << load_factor << ":\n";
+    stats.print_out();
+}
+
+// Times NumElementsInserted inserts and 10 times as many lookups, half of which
+// are misses, for any Stats.
+template <class Stats>
+milliseconds RunStatsBenchmark(double eps, const std::vector<int>& keys) {
+    cuckoo_hashing<int, multiply_shift, 2, Stats> cuckoo{
+        {{CreateMultiplyShift(0), CreateMultiplyShift(1)}}, eps};
+
+    milliseconds start_time = GetCurrentTime();
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        cuckoo.insert(keys[i]);
+    }
+    size_t num_found = 0;
+    for (int round = 0; round < 5; ++round) {
+        for (int key : keys) {
+            num_found += cuckoo.contains(key);
+        }
+    }
+    milliseconds time = GetCurrentTime() - start_time;
+
+    if (num_found != 5 * static_cast<size_t>(NumElementsInserted))
+        throw "Stats benchmark found " + to_string(num_found) + " keys";
+
+    PrintStats(cuckoo.get_stats(), eps, cuckoo.load_factor());
+    return time;
+}
+
+void RunStatsBenchmarks() {
+    std::vector<int> keys;
+    for (int i = 0; i < 2 * NumElementsInserted; ++i) {
+        keys.push_back(i * 2654435761u);
+    }
+
+    for (double eps : {0.4, 0.1}) {
+        milliseconds time_without_stats = RunStatsBenchmark<cuckoo_no_stats>(eps, keys);
+        milliseconds time_with_stats = RunStatsBenchmark<cuckoo_stats>(eps, keys);
+        std::cout << "Time for " << NumElementsInserted << " inserts and " << 10 * NumElementsInserted <<
+            " lookups: " << time_without_stats.count() << " ms without stats, " <<
+            time_with_stats.count() << " ms with stats.\n";
+    }
+}
+
+// Gives access to the number of rehashes for any type of cuckoo_hashing.
+template <class T, class Hash>
+class cuckoo_rehash_counter : public cuckoo_hashing<T, Hash> {
+public:
+    cuckoo_rehash_counter(Hash first_table, Hash second_table)
+        : cuckoo_hashing<T, Hash>(std::move(first_table), std::move(second_table)) {
+    }
+
+    size_t get_num_rehash() const {
+        return this->num_rehash;
+    }
+};
+
+// Will sort latencies.
+void PrintLatencyPercentiles(std::vector<nanoseconds>* latencies) {
+    std::sort(latencies->begin(), latencies->end());
+
+    auto percentile = [latencies](double fraction) {
+        size_t index = std::min(latencies->size() - 1,
+            static_cast<size_t>(fraction * latencies->size()));
+        return (*latencies)[index].count();
+    };
+
+    std::cout << "p50 " << percentile(0.5) << " ns, p99 " << percentile(0.99) <<
+        " ns, p999 " << percentile(0.999) << " ns, max " << latencies->back().count() << " ns";
+}
+
+// Times every insert individually, since a bad hashing function shows up as rare,
+// but very slow, inserts that needed a rehash.
+template <class T, class Hash>
+void RunHashQualityBenchmark(const std::string& name, Hash first_hash, Hash second_hash,
+        const std::vector<T>& keys) {
+    cuckoo_rehash_counter<T, Hash> cuckoo{std::move(first_hash), std::move(second_hash)};
+
+    std::vector<nanoseconds> latencies;
+    latencies.reserve(keys.size());
+
+    for (const T& key : keys) {
+        LatencyTime::time_point before = LatencyTime::now();
+        cuckoo.insert(key);
+        latencies.push_back(LatencyTime::now() - before);
+    }
+
+    for (const T& key : keys) {
+        if (!cuckoo.contains(key))
+            throw "Hash quality benchmark for " + name + " lost a key";
+    }
+
+    nanoseconds total(0);
+    for (nanoseconds latency : latencies) {
+        total += latency;
+    }
+
+    std::cout << "  " << name << ": " <<
+        std::chrono::duration_cast<milliseconds>(total).count() << " ms, " <<
+        cuckoo.get_num_rehash() << " rehashes, ";
+    PrintLatencyPercentiles(&latencies);
+    std::cout << '\n';
+}
+
+void RunHashQualityBenchmarks() {
+    std::vector<int> sequential_keys;
+    // basic_hashing_function will only use some of the slots if the key and
+    // table size share factors. With multiples of 4 it never finishes inserting,
+    // since it can't find hashing functions that work.
+    std::vector<int> even_keys;
+    std::vector<std::string> string_keys;
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        sequential_keys.push_back(i);
+        even_keys.push_back(i * 2);
+        string_keys.push_back("key" + to_string(i));
+    }
+
+    // The rngs aren't randomly seeded, so the results are repeatable.
+    using basic = basic_hashing_function<int>;
+    using tabulation = tabulation_hashing_function<int>;
+
+    std::cout << "Inserting " << NumElementsInserted << " sequential keys:\n";
+    RunHashQualityBenchmark("basic", basic{std::mt19937{}, false},
+        basic{std::mt19937{1}, false}, sequential_keys);
+    RunHashQualityBenchmark("multiply-shift", multiply_shift{std::mt19937_64{}, false},
+        multiply_shift{std::mt19937_64{1}, false}, sequential_keys);
+    RunHashQualityBenchmark("tabulation", tabulation{std::mt19937_64{}, false},
+        tabulation{std::mt19937_64{1}, false}, sequential_keys);
+
+    std::cout << "Inserting " << NumElementsInserted << " even keys:\n";
+    RunHashQualityBenchmark("basic", basic{std::mt19937{}, false},
+        basic{std::mt19937{1}, false}, even_keys);
+    RunHashQualityBenchmark("multiply-shift", multiply_shift{std::mt19937_64{}, false},
+        multiply_shift{std::mt19937_64{1}, false}, even_keys);
+    RunHashQualityBenchmark("tabulation", tabulation{std::mt19937_64{}, false},
+        tabulation{std::mt19937_64{1}, false}, even_keys);
+
+    using string_multiply_shift = multiply_shift_hashing_function<std::string>;
+    using string_tabulation = tabulation_hashing_function<std::string>;
+
+    std::cout << "Inserting " << NumElementsInserted << " string keys:\n";
+    RunHashQualityBenchmark("multiply-shift", string_multiply_shift{std::mt19937_64{}, false},
+        string_multiply_shift{std::mt19937_64{1}, false}, string_keys);
+    RunHashQualityBenchmark("tabulation", string_tabulation{std::mt19937_64{}, false},
+        string_tabulation{std::mt19937_64{1}, false}, string_keys);
+}
+
+// Inserts NumElementsInserted strings, which are too long for the small string
+// optimization, so every copy of one allocates. Returns the allocations per key.
+enum class string_insert { copy, move, emplace };
+
+double RunStringInsertBenchmark(const std::string& name, string_insert method) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        keys.push_back("a key long enough to be allocated on the heap " + to_string(i));
+    }
+
+    using string_multiply_shift = multiply_shift_hashing_function<std::string>;
+    cuckoo_hashing<std::string, string_multiply_shift> cuckoo{
+        string_multiply_shift{std::mt19937_64{}, false},
+        string_multiply_shift{std::mt19937_64{1}, false}};
+
+    const size_t allocations_before = num_allocations;
+    milliseconds start_time = GetCurrentTime();
+    for (std::string& key : keys) {
+        if (method == string_insert::copy)
+            cuckoo.insert(key);
+        else if (method == string_insert::move)
+            cuckoo.insert(std::move(key));
+        else
+            cuckoo.emplace(key.data(), key.size());
+    }
+    milliseconds insert_time = GetCurrentTime() - start_time;
+    const double allocations_per_key =
+        static_cast<double>(num_allocations - allocations_before) / NumElementsInserted;
+
+    if (cuckoo.size() != static_cast<size_t>(NumElementsInserted))
+        throw "String insert benchmark for " + name + " has " + to_string(cuckoo.size()) + " keys";
+
+    std::cout << "  " << name << ": " << insert_time.count() << " ms, " <<
+        allocations_per_key << " allocations per key.\n";
+    return allocations_per_key;
+}
+
+void RunStringInsertBenchmarks() {
+    std::cout << "Inserting " << NumElementsInserted << " long string keys:\n";
+    RunStringInsertBenchmark("insert(const T&)", string_insert::copy);
+    double moved = RunStringInsertBenchmark("insert(T&&)", string_insert::move);
+    RunStringInsertBenchmark("emplace", string_insert::emplace);
+
+    // Only the tables themselves should be allocated.
+    if (moved > 0.01)
+        throw "Moving strings into the set allocated " + to_string(moved) + " times per key";
+}
+
+
+// Sums NumElementsInserted scattered keys 10 times, iterating over a
+// std::unordered_set, and over a cuckoo_hashing with its iterators, and with
+// chunks split between num_threads threads.
+void RunIterationBenchmark(size_t num_threads) {
+    std::vector<int> keys;
+    for (unsigned i = 0; i < NumElementsInserted; ++i) {
+        keys.push_back(i * 2654435761u);
+    }
+    int64_t expected_sum = 0;
+    for (int key : keys) {
+        expected_sum += key;
+    }
+
+    cuckoo_hashing<int, multiply_shift> cuckoo{
+        multiply_shift{std::mt19937_64{}, false}, multiply_shift{std::mt19937_64{1}, false}};
+    cuckoo.insert_bulk(keys.begin(), keys.end());
+    std::unordered_set<int> unordered_set(keys.begin(), keys.end());
+
+    int64_t unordered_set_sum = 0;
+    milliseconds start_time = GetCurrentTime();
+    for (int round = 0; round < 10; ++round) {
+        for (int key : unordered_set) {
+            unordered_set_sum += key;
+        }
+    }
+    milliseconds unordered_set_time = GetCurrentTime() - start_time;
+
+    int64_t iterator_sum = 0;
+    start_time = GetCurrentTime();
+    for (int round = 0; round < 10; ++round) {
+        for (int key : cuckoo) {
+            iterator_sum += key;
+        }
+    }
+    milliseconds iterator_time = GetCurrentTime() - start_time;
+
+    using const_iterator = cuckoo_hashing<int, multiply_shift>::const_iterator;
+    std::vector<std::pair<const_iterator, const_iterator>> chunks;
+    cuckoo.for_each_chunk([&chunks](const_iterator first, const_iterator last) {
+        chunks.emplace_back(first, last);
+    }, 1 << 14);
+
+    std::vector<int64_t> sums(num_threads, 0);
+    start_time = GetCurrentTime();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&chunks, &sums, t, num_threads]() {
+            int64_t sum = 0;
+            for (int round = 0; round < 10; ++round) {
+                for (size_t c = t; c < chunks.size(); c += num_threads) {
+                    for (auto it = chunks[c].first; it != chunks[c].second; ++it) {
+                        sum += *it;
+                    }
+                }
+            }
+            sums[t] = sum;
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    milliseconds chunk_time = GetCurrentTime() - start_time;
+
+    int64_t chunk_sum = 0;
+    for (int64_t sum : sums) {
+        chunk_sum += sum;
+    }
+    if (unordered_set_sum != 10 * expected_sum || iterator_sum != 10 * expected_sum ||
+            chunk_sum != 10 * expected_sum)
+        throw std::string("Iteration benchmark got the wrong sum");
+
+    std::cout << "Time to iterate over " << NumElementsInserted << " keys 10 times: " <<
+        "unordered_set " << unordered_set_time.count() << " ms, cuckoo iterators " <<
+        iterator_time.count() << " ms, cuckoo chunks in " << num_threads << " threads " <<
+        chunk_time.count() << " ms.\n";
+}
 
 int main() {
     SimpleInsertion();
     InsertionWithCollisions();
     InsertionForcedRehash();
     InsertionForcedMultipleRehash();
+    InsertionUsesStash();
+    InsertionOfEmptyItem();
     InsertionAlreadyContainsItem();
     InsertionForceTableResize();
 
+    BulkInsertion();
+    BulkInsertionOfStashedItem();
+    ContainsBatch();
+    ReserveAvoidsResizes();
+    InsertionWithMoreTables<2>();
+    InsertionWithMoreTables<3>();
+    InsertionWithMoreTables<4>();
+    EvictionsUseEveryTable<3>();
+    EvictionsUseEveryTable<4>();
+    InsertionOfMoveOnlyItems();
+    AdaptiveEps();
+    InsertionRecordsStats();
+    IterateOverItems();
+    IterateInChunks();
+
     RemoveItemSimple();
     RemoveItemsWhenHadManyBefore();
     RemoveAllItemsWhenHadMany();
@@ -752,6 +2040,77 @@ int main() {
 
     std::cout << "Time for cuckoo: " << time_for_default_cuckoo.count() << " ms.\n" <<
         "Time for unordered_set: " << time_for_unordered_set.count() << "ms.\n";
-}
 
+    cuckoo_wrapper cuckoo_without_stash(/*stash_size=*/0);
+    milliseconds time_for_cuckoo_without_stash =
+        RunLargeTest(&cuckoo_without_stash);
+
+    std::cout << "Rehashes from failed inserts for cuckoo: " <<
+        cuckoo.get_num_failed_insert_rehash() << " with a stash of 4, " <<
+        cuckoo_without_stash.get_num_failed_insert_rehash() << " without a stash (" <<
+        time_for_cuckoo_without_stash.count() << " ms).\n";
+
+    std::cout << "Inserting " << NumElementsInserted << " keys with and without a stash, over " <<
+        NumAdaptiveEpsSeeds << " seeds:\n";
+    RunStashBenchmark<multiply_shift>("multiply-shift", 0.05);
+    RunStashBenchmark<tabulation_hashing_function<int>>("tabulation", 0.05);
+
+    // The rngs aren't randomly seeded, so both will choose the same hashing functions.
+    cuckoo_hashing<int> virtual_cuckoo{
+        std::unique_ptr<hashing_function<int>>(
+            new basic_hashing_function<int>{std::mt19937{}, false}),
+        std::unique_ptr<hashing_function<int>>(
+            new basic_hashing_function<int>{std::mt19937{1}, false})};
+    milliseconds time_for_virtual_hash =
+        RunHashDispatchBenchmark(&virtual_cuckoo);
+
+    cuckoo_hashing<int, basic_hashing_function<int>> inlined_cuckoo{
+        basic_hashing_function<int>{std::mt19937{}, false},
+        basic_hashing_function<int>{std::mt19937{1}, false}};
+    milliseconds time_for_inlined_hash =
+        RunHashDispatchBenchmark(&inlined_cuckoo);
+
+    std::cout << "Time for cuckoo with virtual hash: " << time_for_virtual_hash.count() << " ms.\n" <<
+        "Time for cuckoo with inlined hash: " << time_for_inlined_hash.count() << " ms.\n";
+
+    RunHashQualityBenchmarks();
+    RunStringInsertBenchmarks();
+
+    milliseconds time_for_single_inserts = RunBulkInsertBenchmark(
+        multiply_shift{std::mt19937_64{}, false}, multiply_shift{std::mt19937_64{1}, false}, false);
+    milliseconds time_for_bulk_insert = RunBulkInsertBenchmark(
+        multiply_shift{std::mt19937_64{}, false}, multiply_shift{std::mt19937_64{1}, false}, true);
+
+    std::cout << "Time to load " << NumElementsInserted << " keys: insert " <<
+        time_for_single_inserts.count() << " ms, insert_bulk " <<
+        time_for_bulk_insert.count() << " ms.\n";
+
+    milliseconds time_for_single_lookups = RunBatchLookupBenchmark(
+        multiply_shift{std::mt19937_64{}, false}, multiply_shift{std::mt19937_64{1}, false}, false);
+    milliseconds time_for_batch_lookups = RunBatchLookupBenchmark(
+        multiply_shift{std::mt19937_64{}, false}, multiply_shift{std::mt19937_64{1}, false}, true);
+
+    std::cout << "Time for " << 10 * NumElementsInserted << " lookups: contains " <<
+        time_for_single_lookups.count() << " ms, contains_batch " <<
+        time_for_batch_lookups.count() << " ms.\n";
+
+    std::cout << "Filling tables for up to " << NumElementsInserted << " keys, then doing " <<
+        "10 lookups per key:\n";
+    for (double eps : {0.4, 0.1}) {
+        RunNumTablesBenchmark<2>(eps);
+        RunNumTablesBenchmark<3>(eps);
+        RunNumTablesBenchmark<4>(eps);
+    }
 
+    RunStatsBenchmarks();
+
+    std::cout << "Inserting " << NumElementsInserted << " keys with adaptive eps, over " <<
+        NumAdaptiveEpsSeeds << " seeds:\n";
+    RunAdaptiveEpsBenchmark(0.4, 0.4);
+    RunAdaptiveEpsBenchmark(0.1, 0.1);
+    RunAdaptiveEpsBenchmark(0.05, 0.4);
+    RunAdaptiveEpsBenchmark(0.1, 0.4);
+
+    RunIterationBenchmark(1);
+    RunIterationBenchmark(std::max(2u, std::thread::hardware_concurrency()));
+}
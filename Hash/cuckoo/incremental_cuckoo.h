@@ -0,0 +1,191 @@
+#ifndef HASH_INCREMENTAL_CUCKOO_H
+#define HASH_INCREMENTAL_CUCKOO_H
+
+#include "cuckoo.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Version of cuckoo_hashing that resizes incrementally, so no single insert or
+// remove has to rehash every item.
+//
+// When the tables need to be resized, they become the old tables, and new tables
+// of the new size (with new hashing functions) are used for all inserts. Every
+// insert and remove after that also moves a few slots from the old tables into
+// the new ones. The number of slots moved per operation is chosen so that all of
+// the old slots have been moved before the new tables could need another resize.
+// Until then, lookups check both the new and the old tables.
+//
+// Inserts can still need a rehash of the new tables, when no place was found for
+// an item and the stash is full, but these are rare compared to resizes.
+//
+// Hash must be copyable, since the old tables keep the old hashing functions.
+
+template <class T, class Hash>
+class incremental_cuckoo_hashing : protected cuckoo_hashing<T, Hash> {
+public:
+    incremental_cuckoo_hashing(Hash first_table, Hash second_table, double eps=0.4);
+
+    void insert(const T& item);
+
+    bool contains(const T& item) const;
+
+    void remove(const T& item);
+
+    size_t size() const { return base::size(); }
+
+protected:
+    using base = cuckoo_hashing<T, Hash>;
+    using ItemOr = typename base::ItemOr;
+
+    static_assert(std::is_copy_constructible<Hash>::value,
+        "The old tables need a copy of the old hashing functions");
+
+    bool is_migrating() const { return old_table_size != 0; }
+
+    // The old tables become the current ones, and the current tables are replaced
+    // by empty tables of the new size.
+    void start_resize();
+
+    // Moves the items in the next num_slots slots of the old tables.
+    void migrate_slots(size_t num_slots);
+
+    // Returns the slot storing item in the old tables, or nullptr.
+    const ItemOr* find_old_slot(const T& item) const;
+
+    ItemOr* find_old_slot(const T& item) {
+        return const_cast<ItemOr*>(
+            static_cast<const incremental_cuckoo_hashing*>(this)->find_old_slot(item));
+    }
+
+    std::vector<ItemOr> old_tables[2];
+    Hash old_hashes[2];
+    // Is 0 once every slot of the old tables was moved.
+    size_t old_table_size;
+
+    // Index of the next slot to move, counting through table 0 then table 1.
+    size_t migration_position;
+    size_t slots_per_operation;
+};
+
+template <class T, class Hash>
+incremental_cuckoo_hashing<T, Hash>::incremental_cuckoo_hashing(
+        Hash first_table, Hash second_table, double eps)
+        : base(first_table, second_table, eps),
+        old_hashes{first_table, second_table},
+        old_table_size(0),
+        migration_position(0),
+        slots_per_operation(0) {
+}
+
+template <class T, class Hash>
+void incremental_cuckoo_hashing<T, Hash>::start_resize() {
+    // Only happens if more operations were done than the old tables were sized
+    // for, which slots_per_operation should prevent.
+    migrate_slots(2 * old_table_size);
+
+    ++this->num_resize;
+    const size_t new_table_size = this->update_size_limits(this->size());
+
+    for (int table = 0; table < 2; ++table) {
+        old_tables[table] = std::move(this->tables[table]);
+        this->tables[table] = std::vector<ItemOr>(new_table_size);
+
+        old_hashes[table] = this->hashes[table];
+        this->hashes[table].reset_hash(new_table_size);
+    }
+    old_table_size = this->table_size;
+    this->table_size = new_table_size;
+    migration_position = 0;
+
+    // Every operation changes the number of elements by at most one, so the old
+    // slots need to be moved within this many operations.
+    size_t operations_until_resize = std::max<size_t>(1, std::min(
+        this->max_number_elements - this->size(),
+        this->size() - this->min_number_elements));
+    slots_per_operation =
+        (2 * old_table_size + operations_until_resize - 1) / operations_until_resize;
+}
+
+template <class T, class Hash>
+void incremental_cuckoo_hashing<T, Hash>::migrate_slots(size_t num_slots) {
+    for (; num_slots > 0 && is_migrating(); --num_slots, ++migration_position) {
+        if (migration_position == 2 * old_table_size) {
+            for (int table = 0; table < 2; ++table) {
+                old_tables[table].clear();
+                old_tables[table].shrink_to_fit();
+            }
+            old_table_size = 0;
+            return;
+        }
+
+        ItemOr& slot = old_tables[migration_position / old_table_size]
+            [migration_position % old_table_size];
+        if (slot.contains_item()) {
+            ItemOr item = std::move(slot);
+            slot.remove_item();
+            this->place_item(&item);
+        }
+    }
+}
+
+template <class T, class Hash>
+const typename incremental_cuckoo_hashing<T, Hash>::ItemOr*
+incremental_cuckoo_hashing<T, Hash>::find_old_slot(const T& item) const {
+    if (!is_migrating()) {
+        return nullptr;
+    }
+
+    for (int table = 0; table < 2; ++table) {
+        const ItemOr& slot = old_tables[table][old_hashes[table].get_hash(item)];
+        if (slot.contains_item() && slot.item == item) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+template <class T, class Hash>
+bool incremental_cuckoo_hashing<T, Hash>::contains(const T& item) const {
+    return base::contains(item) || find_old_slot(item) != nullptr;
+}
+
+template <class T, class Hash>
+void incremental_cuckoo_hashing<T, Hash>::insert(const T& item) {
+    if (contains(item)) {
+        return;
+    }
+
+    ++this->num_elements;
+    if (this->num_elements > this->max_number_elements) {
+        start_resize();
+    }
+
+    ItemOr current{item, true};
+    this->place_item(&current);
+
+    migrate_slots(slots_per_operation);
+}
+
+template <class T, class Hash>
+void incremental_cuckoo_hashing<T, Hash>::remove(const T& item) {
+    ItemOr* slot = this->find_slot(item);
+    if (slot == nullptr) {
+        slot = find_old_slot(item);
+    }
+    if (slot == nullptr) {
+        return;
+    }
+
+    this->clear_slot(slot);
+    --this->num_elements;
+    if (this->num_elements < this->min_number_elements) {
+        start_resize();
+    }
+
+    migrate_slots(slots_per_operation);
+}
+
+#endif  // HASH_INCREMENTAL_CUCKOO_H
@@ -0,0 +1,385 @@
+#include "incremental_cuckoo.h"
+
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+using milliseconds = std::chrono::milliseconds;
+using nanoseconds = std::chrono::nanoseconds;
+using Time = std::chrono::system_clock;
+using LatencyTime = std::chrono::steady_clock;
+using std::to_string;
+
+const int NumElementsInserted =        1000000;
+const int EveryIndexRemovedAfterInsert =    10;
+
+using multiply_shift = multiply_shift_hashing_function<int>;
+
+// Done differently than other Data Structures since want to get access to the data in the class
+class incremental_cuckoo_tests : public incremental_cuckoo_hashing<int, multiply_shift> {
+public:
+    using base = incremental_cuckoo_hashing<int, multiply_shift>;
+
+    // The rngs aren't randomly seeded, so the tests are repeatable.
+    incremental_cuckoo_tests()
+        : base(multiply_shift{std::mt19937_64{}, false},
+            multiply_shift{std::mt19937_64{1}, false}) {
+    }
+
+    size_t get_num_resize() const {
+        return this->num_resize;
+    }
+
+    bool get_is_migrating() const {
+        return is_migrating();
+    }
+
+    int get_number_inserts_required_to_increase_tablesize() const {
+        return this->max_number_elements - this->num_elements + 1;
+    }
+
+    int get_number_removes_required_to_decrease_tablesize() const {
+        return this->num_elements - this->min_number_elements + 1;
+    }
+
+    void assert_is_valid() const {
+        size_t number_elements =
+            assert_table_is_valid(this->tables[0], this->hashes[0], this->table_size) +
+            assert_table_is_valid(this->tables[1], this->hashes[1], this->table_size) +
+            this->stash.size() + this->contains_empty_item;
+
+        if (is_migrating()) {
+            number_elements +=
+                assert_table_is_valid(old_tables[0], old_hashes[0], old_table_size) +
+                assert_table_is_valid(old_tables[1], old_hashes[1], old_table_size);
+        }
+
+        if (this->size() != number_elements)
+            throw "The size wasn't updated properly: is " +
+                to_string(number_elements) + " while reports " + to_string(this->size());
+
+        if (number_elements < this->min_number_elements)
+            throw "Table should have been resized, number elements is " + to_string(number_elements) +
+                " vs min of " + to_string(this->min_number_elements);
+
+        if (number_elements > this->max_number_elements)
+            throw "Table should have been resized, number elements is " + to_string(number_elements) +
+                " vs max of " + to_string(this->max_number_elements);
+    }
+
+private:
+
+    size_t assert_table_is_valid(const std::vector<ItemOr>& table,
+            const multiply_shift& hash, size_t table_size) const {
+        // Count the number of elements, and ensure each element is in the correct index.
+        size_t number_elements = 0;
+        for (size_t i = 0; i < table_size; ++i) {
+            if (!table[i].contains_item()) {
+                continue;
+            }
+
+            ++number_elements;
+
+            size_t hash_using_tables_hash = hash.get_hash(table[i].item);
+            if (i != hash_using_tables_hash)
+                throw "Invalid index to store value " + to_string(table[i].item) + ": " +
+                   " at index " + to_string(i) + " but hashes to " +
+                   to_string(hash_using_tables_hash);
+        }
+
+        return number_elements;
+    }
+};
+
+void CheckContainsElement(const incremental_cuckoo_tests& cuckoo, int val) {
+    if (!cuckoo.contains(val))
+        throw "Expected cuckoo to contain " + to_string(val);
+}
+
+void CheckDoesntContainElement(const incremental_cuckoo_tests& cuckoo, int val) {
+    if (cuckoo.contains(val))
+        throw "Expected cuckoo to not contain " + to_string(val);
+}
+
+void CheckNumberElements(const incremental_cuckoo_tests& cuckoo, size_t expected_size) {
+    if (cuckoo.size() != expected_size)
+        throw "Cuckoo size is wrong: expected " + to_string(expected_size) + " got " + to_string(cuckoo.size());
+}
+
+void CheckNumberResize(const incremental_cuckoo_tests& cuckoo, size_t expected_count) {
+    if (cuckoo.get_num_resize() != expected_count)
+        throw "Unexpected number of resize, expected " + to_string(expected_count) +
+            " got " + to_string(cuckoo.get_num_resize());
+}
+
+void SimpleInsertion() {
+    incremental_cuckoo_tests cuckoo;
+
+    cuckoo.insert(5);
+    cuckoo.insert(6);
+    cuckoo.insert(7);
+    cuckoo.insert(7);
+
+    try {
+        CheckContainsElement(cuckoo, 5);
+        CheckContainsElement(cuckoo, 6);
+        CheckContainsElement(cuckoo, 7);
+
+        CheckDoesntContainElement(cuckoo, 4);
+        CheckDoesntContainElement(cuckoo, 9);
+
+        CheckNumberElements(cuckoo, 3);
+
+        // Only the initial setup when creating the object
+        CheckNumberResize(cuckoo, 1);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in SimpleInsertion: " << s << '\n';
+        throw s;
+    }
+}
+
+// Items must be found, and can be removed, while they are still in the old tables.
+void ItemsUsableWhileMigrating() {
+    incremental_cuckoo_tests cuckoo;
+
+    // Enough for the tables to be big enough that the migration takes a few inserts.
+    int to_insert = 0;
+    while (cuckoo.get_num_resize() < 4) {
+        cuckoo.insert(to_insert++);
+    }
+
+    try {
+        if (!cuckoo.get_is_migrating())
+            throw std::string("Expected the items to still be migrating right after a resize");
+
+        cuckoo.assert_is_valid();
+
+        for (int i = 0; i < to_insert; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+
+        // Most of these are still in the old tables.
+        for (int i = 0; i < to_insert; i += 2) {
+            cuckoo.remove(i);
+        }
+
+        for (int i = 0; i < to_insert; ++i) {
+            if (i % 2 == 0)
+                CheckDoesntContainElement(cuckoo, i);
+            else
+                CheckContainsElement(cuckoo, i);
+        }
+
+        CheckNumberElements(cuckoo, to_insert / 2);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in ItemsUsableWhileMigrating: " << s << '\n';
+        throw s;
+    }
+}
+
+// Every item hashes to index 0 of both tables, so all but two are stashed.
+class constant_hash {
+public:
+    void reset_hash(int p) {}
+
+    int get_hash(const int& t) const { return 0; }
+};
+
+class constant_incremental_cuckoo : public incremental_cuckoo_hashing<int, constant_hash> {
+public:
+    constant_incremental_cuckoo()
+        : incremental_cuckoo_hashing(constant_hash(), constant_hash()) {
+    }
+
+    size_t get_stash_size() const {
+        return this->stash.size();
+    }
+};
+
+// Removing a stashed item must take it out of the stash, not just empty its slot.
+void RemoveStashedItem() {
+    constant_incremental_cuckoo cuckoo;
+
+    cuckoo.insert(1);
+    cuckoo.insert(2);
+    cuckoo.insert(3);
+
+    try {
+        if (cuckoo.get_stash_size() != 1)
+            throw "Expected one stashed item, got " + to_string(cuckoo.get_stash_size());
+
+        // Whichever item was stashed, removing all of them must also empty the stash.
+        for (int i = 1; i <= 3; ++i) {
+            cuckoo.remove(i);
+            if (cuckoo.contains(i))
+                throw "Expected cuckoo to not contain " + to_string(i);
+        }
+
+        if (cuckoo.size() != 0)
+            throw "Cuckoo size is wrong: expected 0 got " + to_string(cuckoo.size());
+        if (cuckoo.get_stash_size() != 0)
+            throw "Expected the stash to be empty, has " + to_string(cuckoo.get_stash_size());
+    } catch (std::string& s) {
+        std::cout << "Error in RemoveStashedItem: " << s << '\n';
+        throw s;
+    }
+}
+
+void InsertionForceTableResize() {
+    incremental_cuckoo_tests cuckoo;
+
+    int to_insert = cuckoo.get_number_inserts_required_to_increase_tablesize();
+
+    for (int i = 0; i < to_insert; ++i) {
+        cuckoo.insert(i);
+    }
+
+    try {
+        for (int i = 0; i < to_insert; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+
+        CheckDoesntContainElement(cuckoo, to_insert);
+
+        CheckNumberElements(cuckoo, to_insert);
+
+        // Initial setup when creating the object, and an additional resize
+        CheckNumberResize(cuckoo, 2);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in InsertionForceTableResize: " << s << '\n';
+        throw s;
+    }
+}
+
+void RemoveItemsWhenHadManyBefore() {
+    incremental_cuckoo_tests cuckoo;
+
+    int to_insert = cuckoo.get_number_inserts_required_to_increase_tablesize();
+
+    // Insert enough items to force it to resize.
+    for (int i = 0; i < to_insert; ++i) {
+        cuckoo.insert(i);
+    }
+
+    int to_remove = cuckoo.get_number_removes_required_to_decrease_tablesize();
+    // Remove enough items to force it to decrease in size.
+    for (int i = 0; i < to_remove; ++i) {
+        cuckoo.remove(i);
+    }
+
+    try {
+        for (int i = 0; i < to_remove; ++i) {
+            CheckDoesntContainElement(cuckoo, i);
+        }
+        for (int i = to_remove; i < to_insert; ++i) {
+            CheckContainsElement(cuckoo, i);
+        }
+
+        CheckNumberElements(cuckoo, to_insert - to_remove);
+
+        // Initial setup when creating the object, additional increase
+        // additional decrease.
+        CheckNumberResize(cuckoo, 3);
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in RemoveItemsWhenHadManyBefore: " << s << '\n';
+        throw s;
+    }
+}
+
+void LargeTest() {
+    incremental_cuckoo_tests cuckoo;
+
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        cuckoo.insert(i);
+        if (i % EveryIndexRemovedAfterInsert == 0)
+            cuckoo.remove(i);
+    }
+
+    try {
+        for (int i = 0; i < NumElementsInserted; ++i) {
+            if (i % EveryIndexRemovedAfterInsert == 0)
+                CheckDoesntContainElement(cuckoo, i);
+            else
+                CheckContainsElement(cuckoo, i);
+        }
+
+        cuckoo.assert_is_valid();
+    } catch (std::string& s) {
+        std::cout << "Error in LargeTest: " << s << '\n';
+        throw s;
+    }
+}
+
+
+void PrintLatencyPercentiles(std::vector<nanoseconds>* latencies) {
+    std::sort(latencies->begin(), latencies->end());
+
+    auto percentile = [latencies](double fraction) {
+        size_t index = std::min(latencies->size() - 1,
+            static_cast<size_t>(fraction * latencies->size()));
+        return (*latencies)[index].count();
+    };
+
+    std::cout << "p50 " << percentile(0.5) << " ns, p99 " << percentile(0.99) <<
+        " ns, p999 " << percentile(0.999) << " ns, max " << latencies->back().count() << " ns";
+}
+
+// Times every insert individually, since a resize shows up as a rare but very
+// slow insert.
+template <class Set>
+void RunInsertLatencyBenchmark(const std::string& name, Set* set) {
+    std::vector<nanoseconds> latencies;
+    latencies.reserve(NumElementsInserted);
+
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        LatencyTime::time_point before = LatencyTime::now();
+        set->insert(i);
+        latencies.push_back(LatencyTime::now() - before);
+    }
+
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        if (!set->contains(i))
+            throw "Insert latency benchmark for " + name + " lost " + to_string(i);
+    }
+
+    nanoseconds total(0);
+    for (nanoseconds latency : latencies) {
+        total += latency;
+    }
+
+    std::cout << "  " << name << ": " <<
+        std::chrono::duration_cast<milliseconds>(total).count() << " ms, ";
+    PrintLatencyPercentiles(&latencies);
+    std::cout << '\n';
+}
+
+
+int main() {
+    SimpleInsertion();
+    ItemsUsableWhileMigrating();
+    RemoveStashedItem();
+    InsertionForceTableResize();
+    RemoveItemsWhenHadManyBefore();
+    LargeTest();
+
+    std::cout << "Inserting " << NumElementsInserted << " elements:\n";
+
+    // Both use the same hashing functions.
+    cuckoo_hashing<int, multiply_shift> cuckoo{multiply_shift{std::mt19937_64{}, false},
+        multiply_shift{std::mt19937_64{1}, false}};
+    RunInsertLatencyBenchmark("cuckoo", &cuckoo);
+
+    incremental_cuckoo_tests incremental_cuckoo;
+    RunInsertLatencyBenchmark("incremental cuckoo", &incremental_cuckoo);
+}
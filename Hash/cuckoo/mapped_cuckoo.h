@@ -0,0 +1,218 @@
+#ifndef HASH_MAPPED_CUCKOO_H
+#define HASH_MAPPED_CUCKOO_H
+
+#include "cuckoo.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Read-only cuckoo_hashing, which serves lookups directly from a file written by
+// cuckoo_hashing::save. The file is mapped into memory, so opening it doesn't
+// read or copy the tables, and the pages are only loaded as lookups touch them.
+// This makes opening a large set far cheaper than inserting its items again,
+// and several processes mapping the same file share its pages.
+//
+// T, Hash and NumTables must be the same as for the cuckoo_hashing that saved
+// the file, which is only checked by comparing their sizes. Hash::parameters
+// must have the p that every hash is less than, like basic_hashing_function.
+// The file mustn't be changed while it's open.
+template <class T, class Hash, size_t NumTables = 2>
+class mapped_cuckoo_hashing {
+public:
+    mapped_cuckoo_hashing();
+
+    ~mapped_cuckoo_hashing();
+
+    mapped_cuckoo_hashing(const mapped_cuckoo_hashing&) = delete;
+    mapped_cuckoo_hashing& operator=(const mapped_cuckoo_hashing&) = delete;
+
+    // Maps the file at path, closing any file that was already open. Returns
+    // false, and leaves the set empty, if it can't be mapped, or wasn't written
+    // by cuckoo_hashing::save with the current version and the same slot and
+    // Hash sizes, or its hashes could index past the end of the tables.
+    bool open_mmap(const std::string& path);
+
+    // Unmaps the file, which leaves the set empty.
+    void close();
+
+    bool is_open() const { return mapping != nullptr; }
+
+    bool contains(const T& item) const;
+
+    size_t size() const { return num_elements; }
+
+protected:
+    using ItemOr = cuckoo_internal::item_or<T>;
+    using header_type = cuckoo_internal::snapshot_header;
+
+    static_assert(std::is_trivially_copyable<ItemOr>::value,
+        "Slots are read as they are in the file, so T must be trivially copyable");
+
+    // Whether header describes a file of mapping_size bytes that this class can read.
+    // The offsets and sizes are checked for overflow, since they are from the file.
+    bool is_valid_header(const header_type& header) const;
+
+    void* mapping;
+    size_t mapping_size;
+
+    size_t num_elements;
+    size_t table_size;
+    // Point into the mapping.
+    const ItemOr* tables[NumTables];
+    const ItemOr* stash;
+    size_t stash_size;
+    bool contains_empty_item;
+
+    // Copied out of the file, since they are small and used by every lookup.
+    std::vector<Hash> hashes;
+};
+
+template <class T, class Hash, size_t NumTables>
+mapped_cuckoo_hashing<T, Hash, NumTables>::mapped_cuckoo_hashing()
+        : mapping(nullptr),
+        mapping_size(0),
+        num_elements(0),
+        table_size(0),
+        tables(),
+        stash(nullptr),
+        stash_size(0),
+        contains_empty_item(false) {
+}
+
+template <class T, class Hash, size_t NumTables>
+mapped_cuckoo_hashing<T, Hash, NumTables>::~mapped_cuckoo_hashing() {
+    close();
+}
+
+template <class T, class Hash, size_t NumTables>
+bool mapped_cuckoo_hashing<T, Hash, NumTables>::is_valid_header(const header_type& header) const {
+    uint64_t hashes_end;
+    uint64_t tables_size;
+    uint64_t tables_end;
+    uint64_t stash_bytes;
+    uint64_t stash_end;
+    if (__builtin_add_overflow(header.hashes_offset,
+                NumTables * sizeof(typename Hash::parameters), &hashes_end) ||
+            __builtin_mul_overflow(header.table_size, NumTables * sizeof(ItemOr), &tables_size) ||
+            __builtin_add_overflow(header.tables_offset, tables_size, &tables_end) ||
+            __builtin_mul_overflow(header.stash_size, sizeof(ItemOr), &stash_bytes) ||
+            __builtin_add_overflow(header.stash_offset, stash_bytes, &stash_end)) {
+        return false;
+    }
+
+    return std::memcmp(header.magic, cuckoo_internal::snapshot_magic, sizeof(header.magic)) == 0 &&
+        header.version == header_type::current_version &&
+        header.num_tables == NumTables &&
+        header.slot_size == sizeof(ItemOr) &&
+        header.hash_parameters_size == sizeof(typename Hash::parameters) &&
+        header.file_size == mapping_size &&
+        hashes_end <= header.tables_offset &&
+        header.tables_offset % alignof(ItemOr) == 0 &&
+        tables_end == header.stash_offset &&
+        stash_end == header.file_size;
+}
+
+template <class T, class Hash, size_t NumTables>
+bool mapped_cuckoo_hashing<T, Hash, NumTables>::open_mmap(const std::string& path) {
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(sizeof(header_type))) {
+        ::close(fd);
+        return false;
+    }
+
+    mapping_size = file_stat.st_size;
+    mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid once the file is closed.
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        mapping_size = 0;
+        return false;
+    }
+
+    const char* bytes = static_cast<const char*>(mapping);
+    header_type header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (!is_valid_header(header)) {
+        close();
+        return false;
+    }
+
+    num_elements = header.num_elements;
+    table_size = header.table_size;
+    for (size_t table = 0; table < NumTables; ++table) {
+        tables[table] = reinterpret_cast<const ItemOr*>(
+            bytes + header.tables_offset + table * table_size * sizeof(ItemOr));
+    }
+    stash = reinterpret_cast<const ItemOr*>(bytes + header.stash_offset);
+    stash_size = header.stash_size;
+    contains_empty_item = header.contains_empty_item;
+
+    for (size_t table = 0; table < NumTables; ++table) {
+        typename Hash::parameters params;
+        std::memcpy(&params, bytes + header.hashes_offset + table * sizeof(params), sizeof(params));
+        // Lookups index the tables with the hashes, so they must be in range.
+        if (params.p <= 0 || static_cast<uint64_t>(params.p) > table_size) {
+            close();
+            return false;
+        }
+        hashes.emplace_back(params);
+    }
+    return true;
+}
+
+template <class T, class Hash, size_t NumTables>
+void mapped_cuckoo_hashing<T, Hash, NumTables>::close() {
+    if (mapping != nullptr) {
+        ::munmap(mapping, mapping_size);
+    }
+
+    mapping = nullptr;
+    mapping_size = 0;
+    num_elements = 0;
+    table_size = 0;
+    stash_size = 0;
+    contains_empty_item = false;
+    hashes.clear();
+}
+
+template <class T, class Hash, size_t NumTables>
+bool mapped_cuckoo_hashing<T, Hash, NumTables>::contains(const T& item) const {
+    if (!is_open()) {
+        return false;
+    }
+    if (cuckoo_internal::is_empty_item<T>(item)) {
+        return contains_empty_item;
+    }
+
+    for (size_t table = 0; table < NumTables; ++table) {
+        const ItemOr& slot = tables[table][hashes[table].get_hash(item)];
+        if (slot.contains_item() && slot.item == item) {
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < stash_size; ++i) {
+        if (stash[i].item == item) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif  // HASH_MAPPED_CUCKOO_H
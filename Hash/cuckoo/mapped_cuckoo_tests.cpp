@@ -0,0 +1,385 @@
+#include "mapped_cuckoo.h"
+
+#include <cstdio>
+#include <iostream>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+
+using milliseconds = std::chrono::milliseconds;
+using Time = std::chrono::system_clock;
+using std::to_string;
+
+const int NumElementsInserted =        1000000;
+
+// Every test saves into this file, and removes it afterwards.
+const char* SnapshotPath = "mapped_tests.snapshot";
+
+using basic = basic_hashing_function<int>;
+using multiply_shift = multiply_shift_hashing_function<int>;
+using tabulation = tabulation_hashing_function<int>;
+
+// Puts every item into the same slots, so any more than two go into the stash.
+class constant_hash {
+public:
+    struct parameters {
+        int p;
+    };
+
+    constant_hash() {}
+
+    explicit constant_hash(const parameters& params) {}
+
+    // Every hash is 0, so is less than 1.
+    parameters get_parameters() const {
+        return {1};
+    }
+
+    void reset_hash(int p) {}
+
+    int get_hash(const int& t) const {
+        return 0;
+    }
+};
+
+// Done differently than other Data Structures since want to get access to the data in the class
+template <class Hash, size_t NumTables = 2>
+class mapped_cuckoo_tests : public mapped_cuckoo_hashing<int, Hash, NumTables> {
+public:
+    // The tables must be read from the mapping, instead of being copied out of it.
+    void assert_tables_are_mapped() const {
+        const char* begin = static_cast<const char*>(this->mapping);
+        const char* end = begin + this->mapping_size;
+        for (size_t table = 0; table < NumTables; ++table) {
+            const char* table_begin = reinterpret_cast<const char*>(this->tables[table]);
+            if (table_begin < begin || table_begin + this->table_size * sizeof(int) > end)
+                throw "Table " + to_string(table) + " isn't in the mapped file";
+        }
+    }
+
+    size_t get_stash_size() const {
+        return this->stash_size;
+    }
+};
+
+template <class Hash, size_t NumTables>
+void CheckContainsElement(const mapped_cuckoo_tests<Hash, NumTables>& cuckoo, int val) {
+    if (!cuckoo.contains(val))
+        throw "Expected mapped cuckoo to contain " + to_string(val);
+}
+
+template <class Hash, size_t NumTables>
+void CheckDoesntContainElement(const mapped_cuckoo_tests<Hash, NumTables>& cuckoo, int val) {
+    if (cuckoo.contains(val))
+        throw "Expected mapped cuckoo to not contain " + to_string(val);
+}
+
+template <class Hash, size_t NumTables>
+void CheckNumberElements(const mapped_cuckoo_tests<Hash, NumTables>& cuckoo, size_t expected_size) {
+    if (cuckoo.size() != expected_size)
+        throw "Mapped cuckoo size is wrong: expected " + to_string(expected_size) +
+            " got " + to_string(cuckoo.size());
+}
+
+// Saves a set with the keys [0, num_inserted) except every tenth one, and the
+// empty item, then checks the mapped set has exactly the same keys.
+// basic_hashing_function doesn't finish inserting keys with common factors.
+template <class Hash>
+void SaveAndOpen(const std::string& name, Hash first_hash, Hash second_hash) {
+    const int num_inserted = 10000;
+    cuckoo_hashing<int, Hash> cuckoo{std::move(first_hash), std::move(second_hash)};
+    for (int i = 0; i < num_inserted; ++i) {
+        cuckoo.insert(i);
+    }
+    for (int i = 0; i < num_inserted; i += 10) {
+        cuckoo.remove(i);
+    }
+    cuckoo.insert(std::numeric_limits<int>::max());
+
+    try {
+        if (!cuckoo.save(SnapshotPath))
+            throw std::string("Failed to save");
+
+        mapped_cuckoo_tests<Hash> mapped;
+        if (!mapped.open_mmap(SnapshotPath))
+            throw std::string("Failed to open the saved file");
+
+        mapped.assert_tables_are_mapped();
+        CheckNumberElements(mapped, cuckoo.size());
+        for (int i = 0; i < 2 * num_inserted; ++i) {
+            if (i < num_inserted && i % 10 != 0)
+                CheckContainsElement(mapped, i);
+            else
+                CheckDoesntContainElement(mapped, i);
+        }
+        CheckContainsElement(mapped, std::numeric_limits<int>::max());
+        CheckDoesntContainElement(mapped, -1);
+    } catch (std::string& s) {
+        std::cout << "Error in SaveAndOpen<" << name << ">: " << s << '\n';
+        std::remove(SnapshotPath);
+        throw s;
+    }
+    std::remove(SnapshotPath);
+}
+
+void SaveAndOpenStash() {
+    cuckoo_hashing<int, constant_hash> cuckoo{constant_hash{}, constant_hash{}};
+    // Two items fit in the tables, and four in the stash.
+    for (int i = 0; i < 6; ++i) {
+        cuckoo.insert(i);
+    }
+
+    try {
+        if (!cuckoo.save(SnapshotPath))
+            throw std::string("Failed to save");
+
+        mapped_cuckoo_tests<constant_hash> mapped;
+        if (!mapped.open_mmap(SnapshotPath))
+            throw std::string("Failed to open the saved file");
+
+        if (mapped.get_stash_size() != 4)
+            throw "Expected 4 stashed items, got " + to_string(mapped.get_stash_size());
+        for (int i = 0; i < 6; ++i) {
+            CheckContainsElement(mapped, i);
+        }
+        CheckDoesntContainElement(mapped, 6);
+        CheckNumberElements(mapped, 6);
+    } catch (std::string& s) {
+        std::cout << "Error in SaveAndOpenStash: " << s << '\n';
+        std::remove(SnapshotPath);
+        throw s;
+    }
+    std::remove(SnapshotPath);
+}
+
+// Overwrites the file at offset with bytes.
+void CorruptFile(size_t offset, const std::string& bytes) {
+    std::fstream file(SnapshotPath, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offset);
+    file.write(bytes.data(), bytes.size());
+}
+
+// Cuts the file down to its first length bytes.
+void TruncateFile(size_t length) {
+    std::ifstream in(SnapshotPath, std::ios::binary);
+    std::string contents(length, '\0');
+    in.read(&contents[0], length);
+    in.close();
+
+    std::ofstream out(SnapshotPath, std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), length);
+}
+
+// Returns the whole file.
+std::string ReadFile() {
+    std::ifstream in(SnapshotPath, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+cuckoo_internal::snapshot_header ReadHeader() {
+    cuckoo_internal::snapshot_header header;
+    std::ifstream in(SnapshotPath, std::ios::binary);
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    return header;
+}
+
+// Saving the same set twice gives the same file, including the padding of the
+// hash parameters.
+void SaveIsDeterministic() {
+    cuckoo_hashing<int, basic> cuckoo{basic{std::mt19937{}, false}, basic{std::mt19937{1}, false}};
+    for (int i = 0; i < 1000; ++i) {
+        cuckoo.insert(i);
+    }
+
+    try {
+        cuckoo.save(SnapshotPath);
+        const std::string first = ReadFile();
+        cuckoo.save(SnapshotPath);
+        if (ReadFile() != first)
+            throw std::string("Saving the same set twice gave different files");
+
+        using parameters = basic::parameters;
+        const size_t padding_start = offsetof(parameters, p) + sizeof(int);
+        const size_t hashes_offset = ReadHeader().hashes_offset;
+        for (size_t table = 0; table < 2; ++table) {
+            for (size_t i = padding_start; i < sizeof(parameters); ++i) {
+                if (first[hashes_offset + table * sizeof(parameters) + i] != 0)
+                    throw "Padding byte " + to_string(i) + " of hash " + to_string(table) +
+                        " isn't zero";
+            }
+        }
+    } catch (std::string& s) {
+        std::cout << "Error in SaveIsDeterministic: " << s << '\n';
+        std::remove(SnapshotPath);
+        throw s;
+    }
+    std::remove(SnapshotPath);
+}
+
+// Files that weren't written for the same type of set, or were damaged, are rejected.
+void RejectsInvalidFiles() {
+    mapped_cuckoo_tests<multiply_shift> mapped;
+
+    try {
+        std::remove(SnapshotPath);
+        if (mapped.open_mmap(SnapshotPath))
+            throw std::string("Opened a file that doesn't exist");
+
+        cuckoo_hashing<int, multiply_shift, 3> three_tables{{{
+            multiply_shift{std::mt19937_64{}, false}, multiply_shift{std::mt19937_64{1}, false},
+            multiply_shift{std::mt19937_64{2}, false}}}};
+        three_tables.insert(1);
+        three_tables.save(SnapshotPath);
+        if (mapped.open_mmap(SnapshotPath))
+            throw std::string("Opened a file with 3 tables as 2 tables");
+
+        cuckoo_hashing<int, basic> basic_cuckoo{
+            basic{std::mt19937{}, false}, basic{std::mt19937{1}, false}};
+        basic_cuckoo.insert(1);
+        basic_cuckoo.save(SnapshotPath);
+        if (mapped.open_mmap(SnapshotPath))
+            throw std::string("Opened a file saved with a different Hash");
+
+        cuckoo_hashing<int, multiply_shift> cuckoo{
+            multiply_shift{std::mt19937_64{}, false}, multiply_shift{std::mt19937_64{1}, false}};
+        for (int i = 0; i < 1000; ++i) {
+            cuckoo.insert(i);
+        }
+
+        cuckoo.save(SnapshotPath);
+        if (!mapped.open_mmap(SnapshotPath))
+            throw std::string("Failed to open a valid file");
+        CheckNumberElements(mapped, 1000);
+
+        // A failed open leaves the set closed and empty.
+        CorruptFile(0, "NOTCUCKO");
+        if (mapped.open_mmap(SnapshotPath))
+            throw std::string("Opened a file with the wrong magic");
+        CheckNumberElements(mapped, 0);
+        CheckDoesntContainElement(mapped, 1);
+
+        cuckoo.save(SnapshotPath);
+        CorruptFile(offsetof(cuckoo_internal::snapshot_header, version), std::string("\x07\0\0\0", 4));
+        if (mapped.open_mmap(SnapshotPath))
+            throw std::string("Opened a file with a different version");
+
+        cuckoo.save(SnapshotPath);
+        TruncateFile(1000);
+        if (mapped.open_mmap(SnapshotPath))
+            throw std::string("Opened a truncated file");
+
+        // A hash range larger than the tables would index past them.
+        cuckoo.save(SnapshotPath);
+        const cuckoo_internal::snapshot_header header = ReadHeader();
+        const int too_large_p = header.table_size + 1;
+        CorruptFile(header.hashes_offset + offsetof(multiply_shift::parameters, p),
+            std::string(reinterpret_cast<const char*>(&too_large_p), sizeof(too_large_p)));
+        if (mapped.open_mmap(SnapshotPath))
+            throw std::string("Opened a file with a hash range past the tables");
+
+        // Table sizes whose byte size wraps around to the right one.
+        cuckoo.save(SnapshotPath);
+        const uint64_t wrapping_table_size = header.table_size + (uint64_t(1) << 61);
+        CorruptFile(offsetof(cuckoo_internal::snapshot_header, table_size),
+            std::string(reinterpret_cast<const char*>(&wrapping_table_size),
+                sizeof(wrapping_table_size)));
+        if (mapped.open_mmap(SnapshotPath))
+            throw std::string("Opened a file whose table size overflows");
+
+        cuckoo.save(SnapshotPath);
+        if (!mapped.open_mmap(SnapshotPath))
+            throw std::string("Failed to open a valid file again");
+        mapped.close();
+        if (mapped.is_open())
+            throw std::string("Still open after close");
+        CheckDoesntContainElement(mapped, 1);
+    } catch (std::string& s) {
+        std::cout << "Error in RejectsInvalidFiles: " << s << '\n';
+        std::remove(SnapshotPath);
+        throw s;
+    }
+    std::remove(SnapshotPath);
+}
+
+
+milliseconds GetCurrentTime() {
+    return std::chrono::duration_cast<milliseconds>(
+        Time::now().time_since_epoch());
+}
+
+// Looks up every key 5 times, half of which are misses, and returns how many were found.
+template <class Set>
+size_t LookupKeys(const Set& set, const std::vector<int>& keys) {
+    size_t num_found = 0;
+    for (int round = 0; round < 5; ++round) {
+        for (int key : keys) {
+            num_found += set.contains(key);
+        }
+    }
+    return num_found;
+}
+
+// Compares building a set of NumElementsInserted keys from scratch against
+// opening a saved copy of it.
+void RunStartupBenchmark() {
+    std::vector<int> keys;
+    for (int i = 0; i < 2 * NumElementsInserted; ++i) {
+        keys.push_back(i * 2654435761u);
+    }
+
+    milliseconds start_time = GetCurrentTime();
+    cuckoo_hashing<int, multiply_shift> cuckoo{
+        multiply_shift{std::mt19937_64{}, false}, multiply_shift{std::mt19937_64{1}, false}};
+    for (int i = 0; i < NumElementsInserted; ++i) {
+        cuckoo.insert(keys[i]);
+    }
+    milliseconds build_time = GetCurrentTime() - start_time;
+
+    start_time = GetCurrentTime();
+    if (!cuckoo.save(SnapshotPath))
+        throw std::string("Startup benchmark failed to save");
+    milliseconds save_time = GetCurrentTime() - start_time;
+
+    start_time = GetCurrentTime();
+    mapped_cuckoo_hashing<int, multiply_shift> mapped;
+    if (!mapped.open_mmap(SnapshotPath))
+        throw std::string("Startup benchmark failed to open");
+    milliseconds open_time = GetCurrentTime() - start_time;
+
+    start_time = GetCurrentTime();
+    size_t num_found = LookupKeys(cuckoo, keys);
+    milliseconds lookup_time = GetCurrentTime() - start_time;
+
+    // The first lookups also fault in the pages of the file.
+    start_time = GetCurrentTime();
+    size_t num_found_mapped = LookupKeys(mapped, keys);
+    milliseconds mapped_lookup_time = GetCurrentTime() - start_time;
+
+    std::remove(SnapshotPath);
+    if (num_found != 5 * static_cast<size_t>(NumElementsInserted) || num_found_mapped != num_found)
+        throw "Startup benchmark found " + to_string(num_found) + " keys, and " +
+            to_string(num_found_mapped) + " in the mapped file";
+
+    std::cout << "Set of " << NumElementsInserted << " keys: inserting " << build_time.count() <<
+        " ms, save " << save_time.count() << " ms, open_mmap " << open_time.count() << " ms.\n" <<
+        "Time for " << 10 * NumElementsInserted << " lookups: cuckoo_hashing " <<
+        lookup_time.count() << " ms, mapped_cuckoo_hashing " << mapped_lookup_time.count() << " ms.\n";
+}
+
+
+int main() {
+    SaveAndOpen("basic", basic{std::mt19937{}, false}, basic{std::mt19937{1}, false});
+    SaveAndOpen("multiply-shift", multiply_shift{std::mt19937_64{}, false},
+        multiply_shift{std::mt19937_64{1}, false});
+    SaveAndOpen("tabulation", tabulation{std::mt19937_64{}, false},
+        tabulation{std::mt19937_64{1}, false});
+    SaveAndOpenStash();
+    SaveIsDeterministic();
+    RejectsInvalidFiles();
+
+    RunStartupBenchmark();
+}